@@ -0,0 +1,4 @@
+function f(a, b, c, d, e, g) { var x = a + b; var y = c + d; var z = e + g; return x + y + z; }
+var s = 0;
+for (var i = 0; i < 300000; i++) s += f(i, 1, 2, 3, 4, 5);
+print(s);
@@ -0,0 +1,102 @@
+/* Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+ * Copyright (C) 2014 Katsuya Iida. All rights reserved.
+ */
+
+// Micro-benchmark of hash_map: insert, lookup and erase at sizes from 1 to
+// 10^6 keys. Prints nanoseconds per operation.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <gc/gc.h>
+
+#include "nabla/coll.hh"
+
+namespace nabla {
+namespace internal {
+
+void* gc_malloc(size_t n) {
+  return GC_MALLOC(n);
+}
+
+void* gc_realloc(void* p, size_t n) {
+  return GC_REALLOC(p, n);
+}
+
+void* gc_malloc_atomic(size_t n) {
+  return GC_MALLOC_ATOMIC(n);
+}
+
+}  // namespace internal
+}  // namespace nabla
+
+using namespace nabla::internal;
+
+namespace {
+
+// Stands in for an atom: the hash is computed once, as strings cache theirs.
+struct key {
+  uint32_t v;
+  uint32_t h;
+  uint32_t hash() const { return h; }
+  bool operator == (const key& o) const { return v == o.v; }
+};
+
+key make_key(uint32_t v) {
+  uint32_t h = v * 0x9e3779b1u;
+  h ^= h >> 16;
+  return { v, h ? h : 1 };
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+double ns_per_op(clock_type::time_point start, size_t ops) {
+  std::chrono::duration<double, std::nano> d = clock_type::now() - start;
+  return d.count() / ops;
+}
+
+void run(size_t n) {
+  // Repeat small sizes so that each measurement covers about 10^6 operations.
+  size_t rounds = n < 1000000 ? 1000000 / n : 1;
+  key* keys = static_cast<key*>(GC_MALLOC_ATOMIC(n * sizeof (key)));
+  for (size_t i = 0; i < n; i++) keys[i] = make_key(static_cast<uint32_t>(i));
+
+  typedef hash_map<key, int> map_type;
+  map_type* maps = static_cast<map_type*>(GC_MALLOC(rounds * sizeof (map_type)));
+  for (size_t r = 0; r < rounds; r++) maps[r].init();
+  size_t ops = rounds * n;
+  long sum = 0;
+
+  clock_type::time_point t = clock_type::now();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < n; i++) maps[r][keys[i]] = static_cast<int>(i);
+  }
+  double insert = ns_per_op(t, ops);
+  t = clock_type::now();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < n; i++) sum += maps[r].find(keys[i])->second;
+  }
+  double hit = ns_per_op(t, ops);
+  t = clock_type::now();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < n; i++) sum += maps[r].find(make_key(static_cast<uint32_t>(i + n))) == maps[r].end();
+  }
+  double miss = ns_per_op(t, ops);
+  t = clock_type::now();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < n; i++) maps[r].erase(maps[r].find(keys[i]));
+    if (!maps[r].empty()) abort();
+  }
+  double erase = ns_per_op(t, ops);
+  printf("%8zu %10.1f %10.1f %10.1f %10.1f\n", n, insert, hit, miss, erase);
+  if (sum == 42) printf("\n");
+}
+
+}  // namespace
+
+int main() {
+  GC_INIT();
+  printf("%8s %10s %10s %10s %10s\n", "size", "insert", "hit", "miss", "erase");
+  for (size_t n = 1; n <= 1000000; n *= 10) run(n);
+  return 0;
+}
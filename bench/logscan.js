@@ -0,0 +1,13 @@
+var lines = [];
+for (var i = 0; i < 2000; i++) {
+  lines.push("2014-05-01 12:00:" + (i % 60) + " INFO  [worker-" + (i % 8) + "] request id=" + i + " path=/api/items/" + i + " status=" + (i % 7 ? 200 : 500) + " time=" + (i % 50) + "ms");
+}
+var errors = 0, total = 0;
+for (var r = 0; r < 20; r++) {
+  for (var i = 0; i < lines.length; i++) {
+    var l = lines[i];
+    if (l.indexOf("status=500") >= 0) errors++;
+    total += l.toLowerCase().indexOf("path=") + l.lastIndexOf("time=");
+  }
+}
+print(errors, total);
@@ -0,0 +1,9 @@
+var o = {};
+var names = [];
+for (var i = 0; i < 40; i++) { names.push("some_long_generated_identifier_" + i); o[names[i]] = i; }
+var s = 0;
+for (var k = 0; k < 20000; k++) {
+  for (var i = 0; i < 40; i++) { s = s + o[names[i]]; }
+  s = s + o.some_long_generated_identifier_3;
+}
+print(s);
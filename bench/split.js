@@ -0,0 +1,8 @@
+var parts = [];
+for (var i = 0; i < 20000; i++) parts.push("field" + i);
+var s = parts.join(",");
+var t = s.split(",");
+print(t.length, t[0], t[19999]);
+var n = 0;
+for (var i = 0; i < s.length; i += 7) { if (s[i] === ",") n++; }
+print(n);
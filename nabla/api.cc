@@ -9,9 +9,13 @@
 #include "config.h"
 #endif
 
+#include <cstdio>
 #include <gc/gc.h>
 #include "data.hh"
 #include "context.hh"
+#include "evalbc.hh"
+#include "profile.hh"
+#include "snapshot.hh"
 
 namespace nabla {
 
@@ -19,8 +23,9 @@ const int major_version = JS_MAJOR_VERSION;
 const int minor_version = JS_MINOR_VERSION;
 const int micro_version = JS_MICRO_VERSION;
 
-void init() {
-  nabla::internal::init();
+void init(gc_mode mode) {
+  nabla::internal::init(mode == gc_incremental);
+  nabla::internal::InitLayouts();
 }
 
 void gc() {
@@ -29,6 +34,81 @@ void gc() {
 
 void getmeminfo(meminfo* info) {
   nabla::internal::getmeminfo(info->heap_size, info->free_bytes);
+  info->guard_bytes = nabla::internal::get_guard_bytes();
+  static_assert(nabla::internal::kNumPauseBuckets == meminfo::pause_buckets &&
+                nabla::internal::kMinPauseMicros == meminfo::min_pause_us,
+                "meminfo doesn't match the pause histogram");
+  nabla::internal::get_pause_histogram(info->pauses);
+}
+
+void getallocinfo(allocinfo* info) {
+  typedef nabla::internal::heap_data heap_data;
+  static_assert(heap_data::kNumTags <= allocinfo::max_kinds, "allocinfo::kinds is too small");
+  size_t counts[heap_data::kNumTags];
+  size_t bytes[heap_data::kNumTags];
+  nabla::internal::get_alloc_stats(counts, bytes, info->cached, info->refills);
+  info->num_kinds = heap_data::kNumTags;
+  for (int i = 0; i < heap_data::kNumTags; i++) {
+    info->kinds[i].name = nabla::internal::tag_name(static_cast<heap_data::tag>(i));
+    info->kinds[i].count = counts[i];
+    info->kinds[i].bytes = bytes[i];
+  }
+}
+
+void getgcinfo(gcinfo* info) {
+  typedef nabla::internal::heap_data heap_data;
+  // The collection that counts the live objects is not the program's, so
+  // the statistics are read before it.
+  info->collections = GC_get_gc_no();
+  size_t buckets[nabla::internal::kNumPauseBuckets];
+  nabla::internal::get_pause_histogram(buckets);
+  info->pauses = 0;
+  for (size_t i = 0; i < nabla::internal::kNumPauseBuckets; i++) info->pauses += buckets[i];
+  nabla::internal::get_pause_times(info->total_pause_us, info->max_pause_us);
+  info->bytes_allocated = GC_get_total_bytes();
+  size_t counts[heap_data::kNumTags];
+  size_t bytes[heap_data::kNumTags];
+  nabla::internal::get_live_objects(counts, bytes);
+  info->num_kinds = heap_data::kNumTags;
+  for (int i = 0; i < heap_data::kNumTags; i++) {
+    info->live[i].name = nabla::internal::tag_name(static_cast<heap_data::tag>(i));
+    info->live[i].count = counts[i];
+    info->live[i].bytes = bytes[i];
+  }
+}
+
+void getcacheinfo(cacheinfo* info) {
+  nabla::internal::BytecodeEvaluator::GetCacheStats(info->hits, info->misses, info->megamorphic);
+}
+
+void start_alloc_profile(size_t interval) {
+  nabla::internal::StartAllocationProfile(interval);
+}
+
+bool write_alloc_profile(const char* path) {
+  FILE* out = fopen(path, "w");
+  if (!out) return false;
+  bool ok = nabla::internal::WriteAllocationProfile(out);
+  return fclose(out) == 0 && ok;
+}
+
+bool start_cpu_profile(int interval_us) {
+  return nabla::internal::StartCpuProfile(interval_us);
+}
+
+bool write_cpu_profile(const char* path) {
+  FILE* out = fopen(path, "w");
+  if (!out) return false;
+  bool ok = nabla::internal::WriteCpuProfile(out);
+  return fclose(out) == 0 && ok;
+}
+
+void set_evaluator(evaluator_type type) {
+  if (type == evaluator_ast) {
+    nabla::internal::Context::SetEvaluatorType(nabla::internal::Context::kEvaluatorAst);
+  } else {
+    nabla::internal::Context::SetEvaluatorType(nabla::internal::Context::kEvaluatorBytecode);
+  }
 }
 
 context::context() {
@@ -60,4 +140,12 @@ bool context::eval(const std::u16string& source, const std::u16string& name, std
   return true;
 }
 
+bool context::write_heap_snapshot(const char* path) {
+  nabla::internal::Context** data = reinterpret_cast<nabla::internal::Context**>(data_);
+  FILE* out = fopen(path, "w");
+  if (!out) return false;
+  bool ok = nabla::internal::WriteHeapSnapshot(*data, out);
+  return fclose(out) == 0 && ok;
+}
+
 }  // namespace nabla
@@ -24,7 +24,7 @@
 namespace nabla {
 namespace internal {
 
-#define GET_ARG(n) (argc > (n) ? argv[n] : undefined_data::alloc())
+#define GET_ARG(n) (argc > (n) ? argv[n] : any_ref::undefined())
 
 struct func_spec {
   const char* name;
@@ -35,7 +35,7 @@ struct func_spec {
 
 static any_ref Global_eval(Context* c, size_t argc, const any_ref* argv) {
   if (!argv[0]) return ThrowTypeError(c);
-  if (argc < 2) return undefined_data::alloc();
+  if (argc < 2) return any_ref::undefined();
   any_ref v = argv[1];
   if (!v.is_u16string()) return v;
   u16string s = v.as_u16string() + ";";
@@ -94,7 +94,7 @@ static any_ref Global_evalcx(Context* c, size_t argc, const any_ref* argv) {
 
 static any_ref Global_load(Context* c, size_t argc, const any_ref* argv) {
   if (!argv[0]) return ThrowTypeError(c);
-  any_ref rval = undefined_data::alloc();
+  any_ref rval = any_ref::undefined();
   for (const any_ref* it = &argv[1]; it != &argv[argc]; ++it) {
     any_ref fn_val = *it;
     u16string fn_str = ToString(c, fn_val);
@@ -144,7 +144,7 @@ static any_ref Global_print(Context* c, size_t argc, const any_ref* argv) {
     std::cout << std::string(s.begin(), s.end());
   }
   std::cout << std::endl;
-  return undefined_data::alloc();
+  return any_ref::undefined();
 }
 
 static any_ref Glolbal_quit(Context* c, size_t argc, const any_ref* argv) {
@@ -154,7 +154,7 @@ static any_ref Glolbal_quit(Context* c, size_t argc, const any_ref* argv) {
     if (!ToInteger<int>(c, argv[1], code)) return nullptr;
   }
   std::exit(code);
-  return undefined_data::alloc();
+  return any_ref::undefined();
 }
 
 // 15.2 Object Objects
@@ -175,7 +175,7 @@ static any_ref Object_getPrototypeOf(Context* c, size_t argc, const any_ref* arg
   if (!v.is<Object>()) return ThrowTypeError(c);
   Object* o = v.as<Object>();
   Object* proto = o->proto();
-  if (!proto) return null_data::alloc();
+  if (!proto) return any_ref::null();
   return proto;
 }
 
@@ -185,14 +185,14 @@ static any_ref Object_getOwnPropertyDescriptor(Context* c, size_t argc, const an
   any_ref v = argv[1];
   Object* o = v.as<Object>();
   u16string n = ToString(c, argv[2]);
-  auto it = o->own_props().find(n);
-  if (it == o->own_props().end())
-    return undefined_data::alloc();
-  Property* desc = &(*it).second;
-  if (!(desc->flags & Property::kAccessor)) {
+  if (!o->HasOwnProperty(n))
+    return any_ref::undefined();
+  // Array elements don't have a Property.
+  Property* desc = o->GetOwnProperty(n);
+  if (!desc || !(desc->flags & Property::kAccessor)) {
     // IsDetaDescriptor(desc) is true
     Object* robj = Object::Alloc(c->object_proto());
-    robj->Put(c, "value", desc->value_or_get, false);
+    robj->Put(c, "value", desc ? desc->value_or_get : o->Get(n), false);
     robj->Put(c, "writable", true, false);
     robj->Put(c, "enumerable", true, false);
     robj->Put(c, "configurable", true, false);
@@ -201,9 +201,9 @@ static any_ref Object_getOwnPropertyDescriptor(Context* c, size_t argc, const an
     // IsAccessorDescriptor(desc) is true
     Object* robj = Object::Alloc(c->object_proto());
     any_ref get = desc->value_or_get;
-    if (!get) get = undefined_data::alloc();
+    if (!get) get = any_ref::undefined();
     any_ref set = desc->set;
-    if (!set) set = undefined_data::alloc();
+    if (!set) set = any_ref::undefined();
     robj->Put(c, "get", get, false);
     robj->Put(c, "set", set, false);
     robj->Put(c, "enumerable", true, false);
@@ -211,7 +211,7 @@ static any_ref Object_getOwnPropertyDescriptor(Context* c, size_t argc, const an
     return robj;
   }
 
-  return undefined_data::alloc();
+  return any_ref::undefined();
 }
 
 static any_ref Object_defineProperty(Context* c, size_t argc, const any_ref* argv);
@@ -249,16 +249,20 @@ static any_ref Object_defineProperty(Context* c, size_t argc, const any_ref* arg
   if (!n) return nullptr;
   if (!argv[3].is<Object>()) return ThrowTypeError(c);
   Object* desc_obj = argv[3].as<Object>();
-  Property* desc = o->NewOwnProperty(n);
   any_ref value_val = desc_obj->Get("value");
   if (!(value_val.is_undefined() || value_val.is_null())) {
     // IsDetaDescriptor(desc) is true
+    Property* desc = o->NewOwnProperty(n);
     desc->value_or_get = value_val;
     desc->flags = Property::kEnumerable | Property::kConfigurable;
   } else {
     // IsAccessorDescriptor(desc) is true
-    desc->value_or_get = desc_obj->Get("get");
-    desc->set = desc_obj->Get("set");
+    any_ref get_val = desc_obj->Get("get");
+    any_ref set_val = desc_obj->Get("set");
+    // The getters above may add properties and move the slots of o.
+    Property* desc = o->NewOwnProperty(n);
+    desc->value_or_get = get_val;
+    desc->set = set_val;
     desc->flags = Property::kAccessor | Property::kEnumerable | Property::kConfigurable;
   }
 
@@ -272,16 +276,10 @@ static any_ref Object_keys(Context* c, size_t argc, const any_ref* argv) {
   any_ref v = argv[1];
   if (!v.is<Object>()) return ThrowTypeError(c);
   Object* o = v.as<Object>();
-  Object* robj = NewArrayObject(c);
-  int i = 0;
-  for (auto it = o->own_props().begin(); it != o->own_props().end(); ++it) {
-    Property* desc = &(*it).second;
-    if (desc->flags & Property::kEnumerable) {
-      u16string n = (*it).first;
-      robj->Put(c, i++, n, false);
-    }
-  }
-  return robj;
+  any_vector names;
+  names.init();
+  o->GetOwnEnumerableNames(names);
+  return NewArrayObject(c, names.size(), names.data());
 }
 
 static any_ref Object_prototype_toString(Context* c, size_t argc, const any_ref* argv) {
@@ -332,8 +330,7 @@ static any_ref Object_prototype_hasOwnProperty(Context* c, size_t argc, const an
   Object* this_obj = argv[0].as<Object>();
   any_ref v = argv[1];
   u16string n = ToString(c, v);
-  auto it = this_obj->own_props().find(n);
-  return it != this_obj->own_props().end();
+  return this_obj->HasOwnProperty(n);
 }
 
 // 15.3 Function Objects
@@ -375,12 +372,12 @@ static any_ref Function_prototype_apply(Context* c, size_t argc, const any_ref*
   any_ref arg_array;
 
   if (argc < 2) {
-    this_arg = undefined_data::alloc();
+    this_arg = any_ref::undefined();
   } else {
     this_arg = argv[1];
   }
   if (argc < 3) {
-    arg_array = undefined_data::alloc();
+    arg_array = any_ref::undefined();
   } else {
     arg_array = argv[2];
   }
@@ -399,8 +396,9 @@ static any_ref Function_prototype_apply(Context* c, size_t argc, const any_ref*
   // Too long arg array.
   if (len > 1000) return ThrowTypeError(c);
   
-  any_vector arg_list;
+  arg_vector arg_list;
   arg_list.init();
+  arg_list.reserve(len + 1);
   arg_list.push_back(this_arg);
   for (uint32_t i = 0; i < len; i++) {
     any_ref v = arg_array_obj->Get(i);
@@ -421,12 +419,12 @@ static any_ref Function_prototype_call(Context* c, size_t argc, const any_ref* a
     this_arg = *it;
     ++it;
   } else {
-    this_arg = undefined_data::alloc();
+    this_arg = any_ref::undefined();
   }
   if (this_arg.is_undefined() || this_arg.is_null()) {
     this_arg = c->global_obj();
   }
-  any_vector arg_list;
+  arg_vector arg_list;
   arg_list.init();
   arg_list.push_back(ToObject(c, this_arg));
   while (it != &argv[argc]) {
@@ -512,16 +510,15 @@ static any_ref Array_prototype_forEach(Context* c, size_t argc, const any_ref* a
 
   any_ref this_arg;
   if (argc < 3) {
-    this_arg = undefined_data::alloc();
+    this_arg = any_ref::undefined();
   } else {
     this_arg = ToObject(c, argv[2]);
     if (!this_arg) return nullptr;
   }
       
   for (uint32_t i = 0; i < len; i++) {
-    Property* desc = this_obj->GetProperty(i);
-    if (!desc) continue;
-    any_ref v = this_obj->Get(desc);
+    if (!this_obj->HasProperty(i)) continue;
+    any_ref v = this_obj->Get(i);
     if (!v) return nullptr;
     any_ref argv[4];
     argv[0] = this_arg;
@@ -530,7 +527,7 @@ static any_ref Array_prototype_forEach(Context* c, size_t argc, const any_ref* a
     argv[3] = this_obj;
     if (!func_obj->Call(4, argv)) return nullptr;
   }
-  return undefined_data::alloc();
+  return any_ref::undefined();
 }
 
 static any_ref Array_prototype_pop(Context* c, size_t argc, const any_ref* argv) {
@@ -539,7 +536,7 @@ static any_ref Array_prototype_pop(Context* c, size_t argc, const any_ref* argv)
   if (!this_obj->host_data || !this_obj->host_data.is<Array>())
     return ThrowTypeError(c);
   Array* arr = this_obj->host_data.as<Array>();
-  if (arr->length == 0) return undefined_data::alloc();
+  if (arr->length == 0) return any_ref::undefined();
   any_ref v = this_obj->Get(arr->length - 1);
   if (!this_obj->Put(c, "length", static_cast<double>(arr->length - 1), true))
     return nullptr;
@@ -637,7 +634,7 @@ static any_ref String_fromCharCode(Context* c, size_t argc, const any_ref* argv)
     any_ref v = argv[1];
     if (!ToInteger<char16_t>(c, v, buf[0])) return nullptr;
   }
-  return u16string(buf, 1);
+  return char_string(buf[0]);
 }
 
 static any_ref String_prototype_charCodeAt(Context* c, size_t argc, const any_ref* argv) {
@@ -652,7 +649,7 @@ static any_ref String_prototype_charCodeAt(Context* c, size_t argc, const any_re
   if (position < 0 || (size_t)position >= s.length()) {
     return std::numeric_limits<double>::quiet_NaN();
   }
-  return (int)(s.data()[position]);
+  return (int)(s[position]);
 }
 
 static any_ref String_prototype_substring(Context* c, size_t argc, const any_ref* argv) {
@@ -679,71 +676,41 @@ static any_ref String_prototype_substring(Context* c, size_t argc, const any_ref
     end = start;
     start = t;
   }
-  return u16string(s.data() + start, end - start);
+  if (end - start == 1) return char_string(s[start]);
+  return s.substring(start, end - start);
 }
 
 static any_ref String_prototype_indexOf(Context* c, size_t argc, const any_ref* argv) {
-  if (!argv[0] || !argv[0].is<Object>()) return ThrowTypeError(c);
+  // 15.5.4.7 String.prototype.indexOf (searchString, position)
+  if (!argv[0]) return ThrowTypeError(c);
   if (!CheckObjectCoercible(c, argv[0])) return nullptr;
   u16string s = ToString(c, argv[0]);
-  u16string search_str;
-  if (argc < 2) {
-    search_str = "undefined";
-  } else {
-    search_str = ToString(c, argv[1]);
-  }
-  int pos;
-  if (argc < 3) {
-    pos = 0;
-  } else {
-    if (!ToInteger(c, argv[2], pos)) return nullptr;
-  }
-  int end = s.length() - search_str.length();
-  int start = pos < 0 ? 0 : pos;
-  while (start < end) {
-    const char16_t* sp = s.data() + start;
-    const char16_t* dp = search_str.data();
-    int n = search_str.length();
-    while (n > 0) {
-      if (*sp++ != *dp++) break;
-      n--;
-    }
-    if (n == 0) return start;
-    start++;
-  }
-  return -1;
+  if (!s) return nullptr;
+  u16string search_str = ToString(c, GET_ARG(1));
+  if (!search_str) return nullptr;
+  double pos = 0;
+  if (argc >= 3 && !ToNumber(c, argv[2], pos)) return nullptr;
+  size_t len = s.length();
+  size_t start = !(pos > 0) ? 0 : pos < len ? static_cast<size_t>(pos) : len;
+  return static_cast<int>(s.index_of(search_str, start));
 }
 
 static any_ref String_prototype_lastIndexOf(Context* c, size_t argc, const any_ref* argv) {
-  if (!argv[0] || !argv[0].is<Object>()) return ThrowTypeError(c);
+  // 15.5.4.8 String.prototype.lastIndexOf (searchString, position)
+  if (!argv[0]) return ThrowTypeError(c);
   if (!CheckObjectCoercible(c, argv[0])) return nullptr;
   u16string s = ToString(c, argv[0]);
-  u16string search_str;
-  if (argc < 2) {
-    search_str = "undefined";
-  } else {
-    search_str = ToString(c, argv[1]);
-  }
-  int pos;
-  if (argc < 3) {
-    pos = 0;
-  } else {
-    if (!ToInteger(c, argv[2], pos)) return nullptr;
-  }
-  int start = s.length() - search_str.length();
-  if (pos < start) start = pos;
-  while (start >= 0) {
-    const char16_t* sp = s.data() + start;
-    const char16_t* dp = search_str.data();
-    int n = search_str.length();
-    while (n > 0) {
-      if (*sp++ != *dp++) break;
-      n--;
-    }
-    if (n == 0) return start;
-    start--;
+  if (!s) return nullptr;
+  u16string search_str = ToString(c, GET_ARG(1));
+  if (!search_str) return nullptr;
+  double pos = std::numeric_limits<double>::infinity();
+  if (argc >= 3) {
+    if (!ToNumber(c, argv[2], pos)) return nullptr;
+    if (std::isnan(pos)) pos = std::numeric_limits<double>::infinity();
   }
-  return -1;
+  size_t len = s.length();
+  size_t start = !(pos > 0) ? 0 : pos < len ? static_cast<size_t>(pos) : len;
+  return static_cast<int>(s.last_index_of(search_str, start));
 }
   
 static any_ref String_prototype_search(Context* c, size_t argc, const any_ref* argv) {
@@ -773,7 +740,9 @@ static any_ref String_prototype_search(Context* c, size_t argc, const any_ref* a
   pcre16* re = pcre16_compile(reinterpret_cast<PCRE_SPTR16>(p.c_str()), 0, &error, &erroffset, NULL);
   assert(re);
   int ovector[30];
-  int rc = pcre16_exec(re, NULL, reinterpret_cast<PCRE_SPTR16>(s.data()), s.length(), 0, 0, ovector, 30);
+  // PCRE reads two-byte units, which a one-byte subject is widened to.
+  std::u16string buf;
+  int rc = pcre16_exec(re, NULL, reinterpret_cast<PCRE_SPTR16>(s.data(buf)), s.length(), 0, 0, ovector, 30);
   int result;
   if (rc > 0) {
     result = ovector[0];
@@ -790,21 +759,7 @@ static any_ref String_prototype_toLowerCase(Context* c, size_t argc, const any_r
   if (!CheckObjectCoercible(c, argv[0])) return nullptr;
   u16string str = ToString(c, argv[0]);
   if (!str) return nullptr;
-  size_t len = str.length();
-  const char16_t* src = str.data();
-  char16_t* dst = new char16_t[len];
-  for (size_t i = 0; i < len; i++) {
-    char16_t ch = src[i];
-    if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
-    dst[i] = ch;
-  }
-  str = u16string(dst, len);
-  delete dst;
-#if 0
-  std::u16string u16str(str.data(), str.data() + str.length());
-  std::transform(u16str.begin(), u16str.end(), u16str.begin(), ::tolower);
-#endif
-  return str;
+  return str.to_lower();
 }
 
 static any_ref String_prototype_toUpperCase(Context* c, size_t argc, const any_ref* argv) {
@@ -812,21 +767,7 @@ static any_ref String_prototype_toUpperCase(Context* c, size_t argc, const any_r
   if (!CheckObjectCoercible(c, argv[0])) return nullptr;
   u16string str = ToString(c, argv[0]);
   if (!str) return nullptr;
-  size_t len = str.length();
-  const char16_t* src = str.data();
-  char16_t* dst = new char16_t[len];
-  for (size_t i = 0; i < len; i++) {
-    char16_t ch = src[i];
-    if (ch >= 'a' && ch <= 'a') ch -= 'a' - 'A';
-    dst[i] = ch;
-  }
-  str = u16string(dst, len);
-  delete dst;
-#if 0
-  std::u16string u16str(str.data(), str.data() + str.length());
-  std::transform(u16str.begin(), u16str.end(), u16str.begin(), ::tolower);
-#endif
-  return str;
+  return str.to_upper();
 }
 
 static any_ref String_prototype_toString(Context* c, size_t argc, const any_ref* argv) {
@@ -1002,7 +943,7 @@ static any_ref Date_prototype_getTime(Context* c, size_t argc, const any_ref* ar
   if (!this_obj->host_data.is<Date>()) return ThrowTypeError(c);
   Date* date = this_obj->host_data.as<Date>();
   double dval = static_cast<double>(date->value);
-  return double_data::alloc(dval);
+  return dval;
 }
 
 static any_ref Date_prototype_toString(Context* c, size_t argc, const any_ref* argv) {
@@ -1013,8 +954,11 @@ static any_ref Date_prototype_toString(Context* c, size_t argc, const any_ref* a
 // 15.10 RegExp (Regular Expression) Objects
 
 RegExp* RegExp::Alloc() {
-  RegExp* re = reinterpret_cast<RegExp*>(GC_MALLOC(sizeof (RegExp)));
+  // The compiled pattern is outside the GC heap.
+  RegExp* re = reinterpret_cast<RegExp*>(alloc_heap_data_atomic(kTagRegExp, sizeof (RegExp)));
   re->tag_ = kTagRegExp;
+  re->re = nullptr;
+  re->flags = 0;
   GC_REGISTER_FINALIZER(re, [] (GC_PTR obj, GC_PTR client_data) {
     RegExp* re = reinterpret_cast<RegExp*>(obj);
     pcre16_free(re->re);
@@ -1105,10 +1049,11 @@ static any_ref RegExp_prototype_exec(Context* c, size_t argc, const any_ref* arg
   uint32_t lastindex;
   if (!ToInteger<uint32_t>(c, lastindex_val, lastindex)) return nullptr;
   int ovector[30];
+  std::u16string buf;
   int rc = pcre16_exec(re->re, NULL,
-                       reinterpret_cast<PCRE_SPTR16>(str.data()),
+                       reinterpret_cast<PCRE_SPTR16>(str.data(buf)),
                        str.length(), lastindex, 0, ovector, 30);
-  if (rc <= 0) return null_data::alloc();
+  if (rc <= 0) return any_ref::null();
 
   Object* robj = NewArrayObject(c);
   robj->Put(c, "index", static_cast<double>(ovector[0]), true);
@@ -1117,7 +1062,10 @@ static any_ref RegExp_prototype_exec(Context* c, size_t argc, const any_ref* arg
   for (int i = 0; i < rc; i++) {
     int startindex = ovector[i * 2];
     int endindex = ovector[i * 2 + 1];
-    robj->Put(c, i, u16string(str.data() + startindex, endindex - startindex), true);
+    // Groups that took no part in the match are left at -1.
+    u16string capture = startindex < 0 ? u16string("") : str.substring(startindex, endindex - startindex);
+    if (!capture) return nullptr;
+    robj->Put(c, i, capture, true);
   }
   return robj;
 }
@@ -1221,7 +1169,8 @@ static func_spec array_prototype_funcs[] = {
 };
 
 static func_spec string_funcs[] = {
-  { "fromCharCode", String_fromCharCode }
+  { "fromCharCode", String_fromCharCode },
+  { nullptr, nullptr }
 };
 
 static func_spec string_prototype_funcs[] = {
@@ -1297,7 +1246,11 @@ void Context::InitStandardBuiltInObjects() {
     Property* desc = o->NewOwnProperty("length");
     desc->flags = Property::kWritable | Property::kEnumerable;
     desc->value_or_get = 0;
-    o->host_data = Array::Alloc();
+    Array* arr = Array::Alloc();
+    // Array.prototype keeps its elements in properties, so that they are
+    // found through the prototype chain by name.
+    arr->sparse = true;
+    o->host_data = arr;
     array_proto_ = o;
   }
 
@@ -1336,11 +1289,11 @@ static Object* make_global_object(Context* c, const func_spec* table) {
   o->host_data = c;
   if (!ExtendObjectWithNativeFunctions(c, o, table))
     return nullptr;
-  o->Put(c, "undefined", undefined_data::alloc(), false);
+  o->Put(c, "undefined", any_ref::undefined(), false);
   double NaN = std::numeric_limits<double>::quiet_NaN();
   double Infinity = std::numeric_limits<double>::infinity();
-  o->Put(c, "NaN", double_data::alloc(NaN), false);
-  o->Put(c, "Infinity", double_data::alloc(Infinity), false);
+  o->Put(c, "NaN", any_ref(NaN), false);
+  o->Put(c, "Infinity", any_ref(Infinity), false);
   return o;
 }
 
@@ -0,0 +1,1359 @@
+/* Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+ * Copyright (C) 2014 Katsuya Iida. All rights reserved.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "bytecode.hh"
+
+#include <algorithm>
+#include <cassert>
+
+#include "debug.hh"
+
+namespace nabla {
+namespace internal {
+
+Bytecode::~Bytecode() {
+  for (auto it = blocks.begin(); it != blocks.end(); ++it) delete *it;
+}
+
+Bytecode* BytecodeCompiler::Compile(Script* script) {
+  Bytecode* bytecode = new Bytecode();
+  SharedState shared;
+  auto& string_table = script->string_table();
+  for (size_t i = 0; i < string_table.size(); i++) {
+    u16string s = string_table[i];
+    shared.strings[std::u16string(s.begin(), s.end())] = static_cast<int>(i);
+  }
+  CodeBlock* block = new CodeBlock(nullptr);
+  bytecode->blocks.push_back(block);
+  BytecodeCompiler compiler(script, bytecode, block, &shared);
+  shared.arguments_name = compiler.AddString("arguments");
+  compiler.CompileProgram(script->program());
+  return bytecode;
+}
+
+BytecodeCompiler::BytecodeCompiler(Script* script, Bytecode* bytecode, CodeBlock* block, SharedState* shared)
+    : script_(script), bytecode_(bytecode), block_(block), scope_(nullptr), node_(nullptr), shared_(shared),
+      next_register_(0), completion_register_(-1) {
+}
+
+int BytecodeCompiler::CompileFunction(FunctionNode* node, Scope* outer) {
+  auto it = shared_->functions.find(node);
+  if (it != shared_->functions.end()) return (*it).second;
+  CodeBlock* block = new CodeBlock(node);
+  int index = static_cast<int>(bytecode_->blocks.size());
+  bytecode_->blocks.push_back(block);
+  shared_->functions[node] = index;
+  BytecodeCompiler compiler(script_, bytecode_, block, shared_);
+  compiler.CompileFunctionBody(node, outer);
+  return index;
+}
+
+// Compiles the declared functions once all the bindings of the scope
+// are known, so that they can resolve names to its slots.
+void BytecodeCompiler::CompileFunctionDeclarations(Scope* scope) {
+  for (size_t i = 0; i < function_declarations_.size(); i++) {
+    block_->function_bindings[i].block = CompileFunction(function_declarations_[i], scope);
+  }
+  function_declarations_.clear();
+}
+
+// Programs
+
+void BytecodeCompiler::CompileProgram(Program* program) {
+  Scope scope(Scope::kProgram, nullptr, block_);
+  scope_ = &scope;
+  node_ = program;
+  completion_register_ = AllocRegister();
+  CollectFunctionBindings(program->body);
+  CollectVariableBindings(program->body);
+  CompileFunctionDeclarations(&scope);
+  Emit(kOpLoadUndefined, completion_register_);
+  for (auto it = program->body.begin(); it != program->body.end(); ++it) {
+    CompileStatement(*it);
+  }
+  Emit(kOpReturn, completion_register_);
+  scope_ = nullptr;
+}
+
+// Functions
+
+void BytecodeCompiler::CompileFunctionBody(FunctionNode* node, Scope* outer) {
+  // 10.5 Declaration Binding Instantiation
+  Scope scope(Scope::kFunction, outer, block_);
+  scope_ = &scope;
+  node_ = node;
+  for (auto it = node->params.begin(); it != node->params.end(); ++it) {
+    block_->params.push_back(DeclareSlot(GetIdentifierIndex(*it)));
+  }
+  if (scope.slots.find(shared_->arguments_name) == scope.slots.end()) {
+    block_->arguments_slot = DeclareSlot(shared_->arguments_name);
+  }
+  CollectFunctionBindings(node->body->body);
+  CollectVariableBindings(node->body->body);
+  CompileFunctionDeclarations(&scope);
+  CompileStatement(node->body);
+  int r = AllocRegister();
+  Emit(kOpLoadUndefined, r);
+  Emit(kOpReturn, r);
+  scope_ = nullptr;
+}
+
+void BytecodeCompiler::CollectFunctionBindings(std::vector<Statement*>& body) {
+  for (auto it = body.begin(); it != body.end(); ++it) {
+    CollectFunctionBindings(*it);
+  }
+}
+
+void BytecodeCompiler::CollectFunctionBindings(Statement* stmt) {
+  if (!stmt) return;
+  switch (stmt->type) {
+    case SyntaxNode::kBlockStatement:
+      CollectFunctionBindings(static_cast<BlockStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kLabeledStatement:
+      CollectFunctionBindings(static_cast<LabeledStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kIfStatement:
+      CollectFunctionBindings(static_cast<IfStatement*>(stmt)->consequent);
+      CollectFunctionBindings(static_cast<IfStatement*>(stmt)->alternate);
+      break;
+    case SyntaxNode::kWithStatement:
+      CollectFunctionBindings(static_cast<WithStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kSwitchStatement: {
+      SwitchStatement* switch_stmt = static_cast<SwitchStatement*>(stmt);
+      for (auto it = switch_stmt->cases.begin(); it != switch_stmt->cases.end(); ++it) {
+        CollectFunctionBindings((*it)->consequent);
+      }
+      break;
+    }
+    case SyntaxNode::kTryStatement: {
+      TryStatement* try_stmt = static_cast<TryStatement*>(stmt);
+      CollectFunctionBindings(try_stmt->block);
+      if (try_stmt->handler) CollectFunctionBindings(try_stmt->handler->body);
+      CollectFunctionBindings(try_stmt->finalizer);
+      break;
+    }
+    case SyntaxNode::kWhileStatement:
+      CollectFunctionBindings(static_cast<WhileStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kDoWhileStatement:
+      CollectFunctionBindings(static_cast<DoWhileStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kForStatement:
+      CollectFunctionBindings(static_cast<ForStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kForInStatement:
+      CollectFunctionBindings(static_cast<ForInStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kFunctionDeclaration: {
+      FunctionNode* node = static_cast<FunctionDeclaration*>(stmt)->function;
+      FunctionBinding binding;
+      binding.name = GetIdentifierIndex(node->id);
+      binding.slot = scope_->kind == Scope::kFunction ? DeclareSlot(binding.name) : -1;
+      binding.block = -1;
+      block_->function_bindings.push_back(binding);
+      function_declarations_.push_back(node);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void BytecodeCompiler::CollectVariableBindings(std::vector<Statement*>& body) {
+  for (auto it = body.begin(); it != body.end(); ++it) {
+    CollectVariableBindings(*it);
+  }
+}
+
+void BytecodeCompiler::CollectVariableBindings(Statement* stmt) {
+  if (!stmt) return;
+  switch (stmt->type) {
+    case SyntaxNode::kBlockStatement:
+      CollectVariableBindings(static_cast<BlockStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kLabeledStatement:
+      CollectVariableBindings(static_cast<LabeledStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kIfStatement:
+      CollectVariableBindings(static_cast<IfStatement*>(stmt)->consequent);
+      CollectVariableBindings(static_cast<IfStatement*>(stmt)->alternate);
+      break;
+    case SyntaxNode::kWithStatement:
+      CollectVariableBindings(static_cast<WithStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kSwitchStatement: {
+      SwitchStatement* switch_stmt = static_cast<SwitchStatement*>(stmt);
+      for (auto it = switch_stmt->cases.begin(); it != switch_stmt->cases.end(); ++it) {
+        CollectVariableBindings((*it)->consequent);
+      }
+      break;
+    }
+    case SyntaxNode::kTryStatement: {
+      TryStatement* try_stmt = static_cast<TryStatement*>(stmt);
+      CollectVariableBindings(try_stmt->block);
+      if (try_stmt->handler) CollectVariableBindings(try_stmt->handler->body);
+      CollectVariableBindings(try_stmt->finalizer);
+      break;
+    }
+    case SyntaxNode::kWhileStatement:
+      CollectVariableBindings(static_cast<WhileStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kDoWhileStatement:
+      CollectVariableBindings(static_cast<DoWhileStatement*>(stmt)->body);
+      break;
+    case SyntaxNode::kForStatement: {
+      ForStatement* for_stmt = static_cast<ForStatement*>(stmt);
+      if (for_stmt->init && for_stmt->init->type == SyntaxNode::kVariableDeclaration) {
+        CollectVariableBindings(static_cast<VariableDeclaration*>(for_stmt->init));
+      }
+      CollectVariableBindings(for_stmt->body);
+      break;
+    }
+    case SyntaxNode::kForInStatement: {
+      ForInStatement* for_in_stmt = static_cast<ForInStatement*>(stmt);
+      if (for_in_stmt->left && for_in_stmt->left->type == SyntaxNode::kVariableDeclaration) {
+        CollectVariableBindings(static_cast<VariableDeclaration*>(for_in_stmt->left));
+      }
+      CollectVariableBindings(for_in_stmt->body);
+      break;
+    }
+    case SyntaxNode::kVariableDeclaration:
+      CollectVariableBindings(static_cast<VariableDeclaration*>(stmt));
+      break;
+    default:
+      break;
+  }
+}
+
+void BytecodeCompiler::CollectVariableBindings(VariableDeclaration* stmt) {
+  for (auto it = stmt->declarations.begin(); it != stmt->declarations.end(); ++it) {
+    int name = GetIdentifierIndex((*it)->id);
+    if (scope_->kind == Scope::kFunction) {
+      block_->variable_bindings.push_back(DeclareSlot(name));
+    } else {
+      block_->variable_bindings.push_back(name);
+    }
+  }
+}
+
+// Statements
+
+void BytecodeCompiler::CompileStatementWithLabel(Statement* stmt, const std::vector<int>& labels) {
+  assert(stmt);
+  int saved_register = next_register_;
+  const SyntaxNode* saved_node = node_;
+  node_ = stmt;
+  switch (stmt->type) {
+    case SyntaxNode::kEmptyStatement:
+      break;
+    case SyntaxNode::kBlockStatement:
+      CompileStatement_(static_cast<BlockStatement*>(stmt));
+      break;
+    case SyntaxNode::kExpressionStatement:
+      CompileStatement_(static_cast<ExpressionStatement*>(stmt));
+      break;
+    case SyntaxNode::kIfStatement:
+      CompileStatement_(static_cast<IfStatement*>(stmt));
+      break;
+    case SyntaxNode::kLabeledStatement:
+      CompileStatementWithLabel_(static_cast<LabeledStatement*>(stmt), labels);
+      break;
+    case SyntaxNode::kBreakStatement:
+      CompileStatement_(static_cast<BreakStatement*>(stmt));
+      break;
+    case SyntaxNode::kContinueStatement:
+      CompileStatement_(static_cast<ContinueStatement*>(stmt));
+      break;
+    case SyntaxNode::kWithStatement:
+      CompileStatement_(static_cast<WithStatement*>(stmt));
+      break;
+    case SyntaxNode::kSwitchStatement:
+      CompileStatementWithLabel_(static_cast<SwitchStatement*>(stmt), labels);
+      break;
+    case SyntaxNode::kReturnStatement:
+      CompileStatement_(static_cast<ReturnStatement*>(stmt));
+      break;
+    case SyntaxNode::kThrowStatement:
+      CompileStatement_(static_cast<ThrowStatement*>(stmt));
+      break;
+    case SyntaxNode::kTryStatement:
+      CompileStatement_(static_cast<TryStatement*>(stmt));
+      break;
+    case SyntaxNode::kWhileStatement:
+      CompileStatementWithLabel_(static_cast<WhileStatement*>(stmt), labels);
+      break;
+    case SyntaxNode::kDoWhileStatement:
+      CompileStatementWithLabel_(static_cast<DoWhileStatement*>(stmt), labels);
+      break;
+    case SyntaxNode::kForStatement:
+      CompileStatementWithLabel_(static_cast<ForStatement*>(stmt), labels);
+      break;
+    case SyntaxNode::kForInStatement:
+      CompileStatementWithLabel_(static_cast<ForInStatement*>(stmt), labels);
+      break;
+    case SyntaxNode::kDebuggerStatement:
+      Emit(kOpNop);
+      break;
+    case SyntaxNode::kFunctionDeclaration:
+      // no-op
+      break;
+    case SyntaxNode::kVariableDeclaration:
+      CompileStatement_(static_cast<VariableDeclaration*>(stmt));
+      break;
+    default:
+      assert(false);
+      break;
+  }
+  FreeRegisters(saved_register);
+  node_ = saved_node;
+}
+
+void BytecodeCompiler::CompileStatement_(BlockStatement* stmt) {
+  // 12.1 Block
+  for (auto it = stmt->body.begin(); it != stmt->body.end(); ++it) {
+    CompileStatement(*it);
+  }
+}
+
+void BytecodeCompiler::CompileStatement_(ExpressionStatement* stmt) {
+  // 12.4 Expression Statement
+  if (completion_register_ >= 0) {
+    CompileExpression(stmt->expression, completion_register_);
+  } else {
+    CompileExpression(stmt->expression, AllocRegister());
+  }
+}
+
+void BytecodeCompiler::CompileStatement_(IfStatement* stmt) {
+  // 12.5 The if Statement
+  int t = AllocRegister();
+  CompileExpression(stmt->test, t);
+  int jump_to_alternate = Emit(kOpJumpIfFalse, t);
+  FreeRegisters(t);
+  CompileStatement(stmt->consequent);
+  if (stmt->alternate) {
+    int jump_to_end = Emit(kOpJump);
+    PatchJump(jump_to_alternate, Here());
+    CompileStatement(stmt->alternate);
+    PatchJump(jump_to_end, Here());
+  } else {
+    PatchJump(jump_to_alternate, Here());
+  }
+}
+
+void BytecodeCompiler::CompileStatementWithLabel_(LabeledStatement* stmt, const std::vector<int>& labels) {
+  // 12.12 Labelled Statements
+  std::vector<int> label_list(labels);
+  label_list.push_back(GetIdentifierIndex(stmt->label));
+  switch (stmt->body->type) {
+    case SyntaxNode::kLabeledStatement:
+    case SyntaxNode::kSwitchStatement:
+    case SyntaxNode::kWhileStatement:
+    case SyntaxNode::kDoWhileStatement:
+    case SyntaxNode::kForStatement:
+    case SyntaxNode::kForInStatement:
+      CompileStatementWithLabel(stmt->body, label_list);
+      break;
+    default: {
+      ControlScope scope(ControlScope::kLabel);
+      scope.labels = label_list;
+      scopes_.push_back(scope);
+      CompileStatement(stmt->body);
+      PatchJumps(scopes_.back().breaks, Here());
+      scopes_.pop_back();
+      break;
+    }
+  }
+}
+
+void BytecodeCompiler::CompileStatement_(BreakStatement* stmt) {
+  // 12.8 The break Statement
+  size_t i = scopes_.size();
+  while (i-- > 0) {
+    const ControlScope& scope = scopes_[i];
+    if (stmt->label) {
+      int label = GetIdentifierIndex(stmt->label);
+      if (std::find(scope.labels.begin(), scope.labels.end(), label) != scope.labels.end()) break;
+    } else if (scope.kind == ControlScope::kLoop || scope.kind == ControlScope::kSwitch) {
+      break;
+    }
+  }
+  if (i == static_cast<size_t>(-1)) {
+    // Nothing to break.
+    Emit(kOpThrowSyntaxError);
+    return;
+  }
+  CompileUnwind(i + 1);
+  scopes_[i].breaks.push_back(Emit(kOpJump));
+  CompileRewind(i + 1);
+}
+
+void BytecodeCompiler::CompileStatement_(ContinueStatement* stmt) {
+  // 12.7 The continue Statement
+  size_t i = scopes_.size();
+  while (i-- > 0) {
+    const ControlScope& scope = scopes_[i];
+    if (scope.kind != ControlScope::kLoop) continue;
+    if (!stmt->label) break;
+    int label = GetIdentifierIndex(stmt->label);
+    if (std::find(scope.labels.begin(), scope.labels.end(), label) != scope.labels.end()) break;
+  }
+  if (i == static_cast<size_t>(-1)) {
+    // Nothing to continue.
+    Emit(kOpThrowSyntaxError);
+    return;
+  }
+  CompileUnwind(i + 1);
+  scopes_[i].continues.push_back(Emit(kOpJump));
+  CompileRewind(i + 1);
+}
+
+void BytecodeCompiler::CompileStatement_(WithStatement* stmt) {
+  // 12.10 The with Statement
+  int obj = AllocRegister();
+  CompileExpression(stmt->object, obj);
+  int env = AllocRegister();
+  Emit(kOpGetEnv, env);
+  Emit(kOpEnterWith, obj);
+  ControlScope scope(ControlScope::kWith);
+  scope.env = env;
+  scopes_.push_back(scope);
+  // Any name in the body may resolve to a property of the object.
+  Scope with_scope(Scope::kWith, scope_, block_);
+  scope_ = &with_scope;
+  CompileStatement(stmt->body);
+  scope_ = with_scope.outer;
+  scopes_.pop_back();
+  Emit(kOpSetEnv, env);
+}
+
+void BytecodeCompiler::CompileStatementWithLabel_(SwitchStatement* stmt, const std::vector<int>& labels) {
+  // 12.11 The switch Statement
+  int d = AllocRegister();
+  CompileExpression(stmt->discriminant, d);
+  int t = AllocRegister();
+  std::vector<int> case_jumps;
+  for (auto it = stmt->cases.begin(); it != stmt->cases.end(); ++it) {
+    SwitchCase* sc = *it;
+    if (sc->test) {
+      CompileExpression(sc->test, t);
+      Emit(kOpStrictEquals, t, t, d);
+      case_jumps.push_back(Emit(kOpJumpIfTrue, t));
+    } else {
+      case_jumps.push_back(-1);
+    }
+  }
+  int default_jump = Emit(kOpJump);
+  FreeRegisters(d);
+
+  ControlScope scope(ControlScope::kSwitch);
+  scope.labels = labels;
+  scopes_.push_back(scope);
+  int default_target = -1;
+  for (size_t i = 0; i < stmt->cases.size(); i++) {
+    SwitchCase* sc = stmt->cases[i];
+    if (case_jumps[i] >= 0) {
+      PatchJump(case_jumps[i], Here());
+    } else {
+      default_target = Here();
+    }
+    for (auto it = sc->consequent.begin(); it != sc->consequent.end(); ++it) {
+      CompileStatement(*it);
+    }
+  }
+  PatchJump(default_jump, default_target >= 0 ? default_target : Here());
+  PatchJumps(scopes_.back().breaks, Here());
+  scopes_.pop_back();
+}
+
+void BytecodeCompiler::CompileStatement_(ReturnStatement* stmt) {
+  // 12.9 The return Statement
+  int r = AllocRegister();
+  if (stmt->argument) {
+    CompileExpression(stmt->argument, r);
+  } else {
+    Emit(kOpLoadUndefined, r);
+  }
+  CompileUnwind(0);
+  Emit(kOpReturn, r);
+  CompileRewind(0);
+}
+
+void BytecodeCompiler::CompileStatement_(ThrowStatement* stmt) {
+  // 12.13 The throw Statement
+  int r = AllocRegister();
+  CompileExpression(stmt->argument, r);
+  Emit(kOpThrow, r);
+}
+
+void BytecodeCompiler::CompileStatement_(TryStatement* stmt) {
+  // 12.14 The try Statement
+  int env = AllocRegister();
+  Emit(kOpGetEnv, env);
+  if (stmt->finalizer) {
+    ControlScope scope(ControlScope::kFinally);
+    scope.env = env;
+    scope.finalizer = stmt->finalizer;
+    scope.handlers.push_back(OpenHandler(env));
+    scopes_.push_back(scope);
+  }
+  if (stmt->handler) {
+    ControlScope scope(ControlScope::kCatch);
+    scope.env = env;
+    scope.handlers.push_back(OpenHandler(env));
+    scopes_.push_back(scope);
+  }
+
+  CompileStatement(stmt->block);
+
+  if (stmt->handler) {
+    ControlScope scope = scopes_.back();
+    scopes_.pop_back();
+    CloseHandler(scope.handlers.back());
+    int jump_to_end = Emit(kOpJump);
+    PatchHandlers(scope.handlers, Here());
+    int r = AllocRegister();
+    Emit(kOpCatch, r);
+    if (completion_register_ >= 0) Emit(kOpMove, completion_register_, r);
+    // Each run of the catch block gets a new environment binding the
+    // parameter, so that closures made in different runs don't share it.
+    int name = GetIdentifierIndex(stmt->handler->param);
+    Scope catch_scope(Scope::kCatch, scope_, block_);
+    catch_scope.slots[name] = 0;
+    block_->catch_names.push_back(name);
+    Emit(kOpEnterCatch, r, static_cast<int>(block_->catch_names.size()) - 1);
+    FreeRegisters(r);
+    ControlScope body_scope(ControlScope::kCatchBody);
+    body_scope.env = env;
+    scopes_.push_back(body_scope);
+    scope_ = &catch_scope;
+    CompileStatement(stmt->handler->body);
+    scope_ = catch_scope.outer;
+    scopes_.pop_back();
+    Emit(kOpSetEnv, env);
+    PatchJump(jump_to_end, Here());
+  }
+
+  if (stmt->finalizer) {
+    ControlScope scope = scopes_.back();
+    scopes_.pop_back();
+    CloseHandler(scope.handlers.back());
+    CompileStatement(stmt->finalizer);
+    int jump_to_end = Emit(kOpJump);
+    PatchHandlers(scope.handlers, Here());
+    int r = AllocRegister();
+    Emit(kOpCatch, r);
+    CompileStatement(stmt->finalizer);
+    Emit(kOpThrow, r);
+    FreeRegisters(r);
+    PatchJump(jump_to_end, Here());
+  }
+}
+
+void BytecodeCompiler::CompileStatementWithLabel_(WhileStatement* stmt, const std::vector<int>& labels) {
+  // 12.6.2 The while Statement
+  ControlScope scope(ControlScope::kLoop);
+  scope.labels = labels;
+  scopes_.push_back(scope);
+  int jump_to_test = Emit(kOpJump);
+  int body = Here();
+  CompileStatement(stmt->body);
+  int test = Here();
+  PatchJump(jump_to_test, test);
+  int t = AllocRegister();
+  CompileExpression(stmt->test, t);
+  Emit(kOpJumpIfTrue, t, body);
+  FreeRegisters(t);
+  PatchJumps(scopes_.back().continues, test);
+  PatchJumps(scopes_.back().breaks, Here());
+  scopes_.pop_back();
+}
+
+void BytecodeCompiler::CompileStatementWithLabel_(DoWhileStatement* stmt, const std::vector<int>& labels) {
+  // 12.6.1 The do-while Statement
+  ControlScope scope(ControlScope::kLoop);
+  scope.labels = labels;
+  scopes_.push_back(scope);
+  int body = Here();
+  CompileStatement(stmt->body);
+  int test = Here();
+  int t = AllocRegister();
+  CompileExpression(stmt->test, t);
+  Emit(kOpJumpIfTrue, t, body);
+  FreeRegisters(t);
+  PatchJumps(scopes_.back().continues, test);
+  PatchJumps(scopes_.back().breaks, Here());
+  scopes_.pop_back();
+}
+
+void BytecodeCompiler::CompileStatementWithLabel_(ForStatement* stmt, const std::vector<int>& labels) {
+  // 12.6.3 The for Statement
+  if (stmt->init) {
+    if (stmt->init->type == SyntaxNode::kVariableDeclaration) {
+      CompileStatement(static_cast<VariableDeclaration*>(stmt->init));
+    } else {
+      int t = AllocRegister();
+      CompileExpression(static_cast<Expression*>(stmt->init), t);
+      FreeRegisters(t);
+    }
+  }
+  ControlScope scope(ControlScope::kLoop);
+  scope.labels = labels;
+  scopes_.push_back(scope);
+  int jump_to_test = Emit(kOpJump);
+  int body = Here();
+  CompileStatement(stmt->body);
+  int update = Here();
+  if (stmt->update) {
+    int t = AllocRegister();
+    CompileExpression(stmt->update, t);
+    FreeRegisters(t);
+  }
+  PatchJump(jump_to_test, Here());
+  if (stmt->test) {
+    int t = AllocRegister();
+    CompileExpression(stmt->test, t);
+    Emit(kOpJumpIfTrue, t, body);
+    FreeRegisters(t);
+  } else {
+    Emit(kOpJump, body);
+  }
+  PatchJumps(scopes_.back().continues, update);
+  PatchJumps(scopes_.back().breaks, Here());
+  scopes_.pop_back();
+}
+
+void BytecodeCompiler::CompileStatementWithLabel_(ForInStatement* stmt, const std::vector<int>& labels) {
+  // 12.6.4 The for-in Statement
+  int obj = AllocRegister();
+  CompileExpression(stmt->right, obj);
+  int names = AllocRegisters(2);
+  Emit(kOpForInPrepare, names, obj);
+  int name = AllocRegister();
+
+  ControlScope scope(ControlScope::kLoop);
+  scope.labels = labels;
+  scopes_.push_back(scope);
+  int next = Emit(kOpForInNext, name, names);
+  if (stmt->left->type == SyntaxNode::kVariableDeclaration) {
+    VariableDeclaration* decl = static_cast<VariableDeclaration*>(stmt->left);
+    for (auto it = decl->declarations.begin(); it != decl->declarations.end(); ++it) {
+      CompileStoreName(GetIdentifierIndex((*it)->id), name);
+    }
+  } else if (stmt->left->type == SyntaxNode::kIdentifier) {
+    CompileStoreName(GetIdentifierIndex(static_cast<Identifier*>(stmt->left)), name);
+  } else if (stmt->left->type == SyntaxNode::kMemberExpression) {
+    MemberExpression* member = static_cast<MemberExpression*>(stmt->left);
+    int o = AllocRegister();
+    CompileExpression(member->object, o);
+    if (member->computed) {
+      int k = AllocRegister();
+      CompileExpression(member->property, k);
+      Emit(kOpPutElem, o, k, name);
+    } else {
+      Emit(kOpPutProp, o, AddPropertyCache(GetIdentifierIndex(static_cast<Identifier*>(member->property))), name);
+    }
+    FreeRegisters(o);
+  }
+  CompileStatement(stmt->body);
+  Emit(kOpJump, next);
+  block_->code[next].c = Here();
+  PatchJumps(scopes_.back().continues, next);
+  PatchJumps(scopes_.back().breaks, Here());
+  scopes_.pop_back();
+}
+
+// Declarations
+
+void BytecodeCompiler::CompileStatement_(VariableDeclaration* stmt) {
+  for (auto it = stmt->declarations.begin(); it != stmt->declarations.end(); ++it) {
+    VariableDeclarator* decl = *it;
+    if (decl->init) {
+      int r = AllocRegister();
+      CompileExpression(decl->init, r);
+      CompileStoreName(GetIdentifierIndex(decl->id), r);
+      FreeRegisters(r);
+    }
+  }
+}
+
+// Identifiers
+
+void BytecodeCompiler::CompileLoadName(int name, int dst) {
+  // 11.1.2 Identifier Reference
+  int depth, slot;
+  switch (Resolve(name, depth, slot)) {
+    case kResolvedLocal:
+      Emit(kOpLoadLocal, dst, slot);
+      break;
+    case kResolvedSlot:
+      Emit(kOpLoadScoped, dst, depth, slot);
+      break;
+    case kResolvedGlobal:
+      Emit(kOpLoadGlobal, dst, AddPropertyCache(name));
+      break;
+    case kResolvedName:
+      Emit(kOpLoadName, dst, name);
+      break;
+  }
+}
+
+void BytecodeCompiler::CompileStoreName(int name, int src) {
+  int depth, slot;
+  switch (Resolve(name, depth, slot)) {
+    case kResolvedLocal:
+      Emit(kOpStoreLocal, slot, src);
+      break;
+    case kResolvedSlot:
+      Emit(kOpStoreScoped, depth, slot, src);
+      break;
+    case kResolvedGlobal:
+      Emit(kOpStoreGlobal, AddPropertyCache(name), src);
+      break;
+    case kResolvedName:
+      Emit(kOpStoreName, name, src);
+      break;
+  }
+}
+
+// Finds the binding of name statically. slot is the index in the
+// slots of the environment holding it, which for kResolvedSlot is
+// depth environments of functions and catch blocks out. Names which
+// can be shadowed at runtime, that is inside with statements, are
+// resolved by name.
+BytecodeCompiler::Resolution BytecodeCompiler::Resolve(int name, int& depth, int& slot) {
+  depth = 0;
+  for (Scope* scope = scope_; scope; scope = scope->outer) {
+    switch (scope->kind) {
+      case Scope::kProgram:
+        return kResolvedGlobal;
+      case Scope::kWith:
+        MarkDynamicScope(scope);
+        return kResolvedName;
+      case Scope::kCatch:
+      case Scope::kFunction: {
+        auto it = scope->slots.find(name);
+        if (it != scope->slots.end()) {
+          slot = (*it).second;
+          if (scope->kind == Scope::kCatch) return kResolvedSlot;
+          if (slot == scope->block->arguments_slot) scope->block->needs_arguments = true;
+          // The slots of the running function are also its locals.
+          return scope->block == block_ ? kResolvedLocal : kResolvedSlot;
+        }
+        depth++;
+        break;
+      }
+    }
+  }
+  return kResolvedGlobal;
+}
+
+// Bindings found by name may be any of the slots of the enclosing
+// functions, including arguments.
+void BytecodeCompiler::MarkDynamicScope(Scope* scope) {
+  for (; scope; scope = scope->outer) {
+    if (scope->block->function) scope->block->needs_arguments = true;
+  }
+}
+
+int BytecodeCompiler::DeclareSlot(int name) {
+  assert(scope_->kind == Scope::kFunction);
+  auto it = scope_->slots.find(name);
+  if (it != scope_->slots.end()) return (*it).second;
+  int slot = static_cast<int>(block_->slot_names.size());
+  block_->slot_names.push_back(name);
+  scope_->slots[name] = slot;
+  return slot;
+}
+
+// Leaves the control scopes inner than depth, running finally blocks
+// and restoring environments on the way.
+void BytecodeCompiler::CompileUnwind(size_t depth) {
+  for (size_t i = scopes_.size(); i-- > depth;) {
+    switch (scopes_[i].kind) {
+      case ControlScope::kWith:
+      case ControlScope::kCatchBody:
+        Emit(kOpSetEnv, scopes_[i].env);
+        break;
+      case ControlScope::kCatch:
+        CloseHandler(scopes_[i].handlers.back());
+        break;
+      case ControlScope::kFinally: {
+        CloseHandler(scopes_[i].handlers.back());
+        Emit(kOpSetEnv, scopes_[i].env);
+        std::vector<ControlScope> inner_scopes(scopes_.begin() + i, scopes_.end());
+        scopes_.erase(scopes_.begin() + i, scopes_.end());
+        CompileStatement(inner_scopes[0].finalizer);
+        scopes_.insert(scopes_.end(), inner_scopes.begin(), inner_scopes.end());
+        break;
+      }
+      default:
+        break;
+    }
+  }
+}
+
+// Resumes the exception handlers closed by CompileUnwind().
+void BytecodeCompiler::CompileRewind(size_t depth) {
+  for (size_t i = depth; i < scopes_.size(); i++) {
+    ControlScope& scope = scopes_[i];
+    if (scope.kind == ControlScope::kCatch || scope.kind == ControlScope::kFinally) {
+      ExceptionHandler handler = block_->handlers[scope.handlers.back()];
+      scope.handlers.push_back(OpenHandler(handler.env));
+    }
+  }
+}
+
+// Expressions
+
+void BytecodeCompiler::CompileExpression(Expression* expr, int dst) {
+  assert(expr);
+  const SyntaxNode* saved_node = node_;
+  node_ = expr;
+  switch (expr->type) {
+    case SyntaxNode::kThisExpression:
+      Emit(kOpLoadThis, dst);
+      break;
+    case SyntaxNode::kArrayExpression:
+      CompileExpression_(static_cast<ArrayExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kObjectExpression:
+      CompileExpression_(static_cast<ObjectExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kFunctionExpression:
+      Emit(kOpClosure, dst, CompileFunction(static_cast<FunctionExpression*>(expr)->function, scope_));
+      break;
+    case SyntaxNode::kSequenceExpression:
+      CompileExpression_(static_cast<SequenceExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kUnaryExpression:
+      CompileExpression_(static_cast<UnaryExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kBinaryExpression:
+      CompileExpression_(static_cast<BinaryExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kAssignmentExpression:
+      CompileExpression_(static_cast<AssignmentExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kUpdateExpression:
+      CompileExpression_(static_cast<UpdateExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kLogicalExpression:
+      CompileExpression_(static_cast<LogicalExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kConditionalExpression:
+      CompileExpression_(static_cast<ConditionalExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kNewExpression:
+      CompileExpression_(static_cast<NewExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kCallExpression:
+      CompileExpression_(static_cast<CallExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kMemberExpression:
+      CompileExpression_(static_cast<MemberExpression*>(expr), dst);
+      break;
+    case SyntaxNode::kIdentifier:
+      CompileLoadName(GetIdentifierIndex(static_cast<Identifier*>(expr)), dst);
+      break;
+    case SyntaxNode::kNullLiteral:
+      Emit(kOpLoadNull, dst);
+      break;
+    case SyntaxNode::kBooleanLiteral:
+      Emit(kOpLoadBool, dst, static_cast<BooleanLiteral*>(expr)->value ? 1 : 0);
+      break;
+    case SyntaxNode::kNumberLiteral:
+      CompileExpression_(static_cast<NumberLiteral*>(expr), dst);
+      break;
+    case SyntaxNode::kStringLiteral:
+      CompileExpression_(static_cast<StringLiteral*>(expr), dst);
+      break;
+    case SyntaxNode::kRegExpLiteral:
+      Emit(kOpLoadRegExp, dst, static_cast<int>(block_->regexps.size()));
+      block_->regexps.push_back(static_cast<RegExpLiteral*>(expr));
+      break;
+    default:
+      assert(false);
+      break;
+  }
+  node_ = saved_node;
+}
+
+void BytecodeCompiler::CompileExpression_(ArrayExpression* expr, int dst) {
+  // 11.1.4 Array Initialiser
+  Emit(kOpNewArray, dst);
+  int t = AllocRegister();
+  int i = 0;
+  for (auto it = expr->elements.begin(); it != expr->elements.end(); ++it, ++i) {
+    // Elisions are nullptr.
+    if (!*it) continue;
+    CompileExpression(*it, t);
+    Emit(kOpInitElem, dst, i, t);
+  }
+  FreeRegisters(t);
+}
+
+void BytecodeCompiler::CompileExpression_(ObjectExpression* expr, int dst) {
+  // 11.1.5 Object Initialiser
+  Emit(kOpNewObject, dst);
+  int t = AllocRegister();
+  for (auto it = expr->properties.begin(); it != expr->properties.end(); ++it) {
+    PropertyNode* pa = *it;
+    int key = GetPropertyKeyIndex(pa->key);
+    CompileExpression(pa->value, t);
+    switch (pa->kind) {
+      case SyntaxNode::kPropertySet:
+        Emit(kOpInitSetter, dst, key, t);
+        break;
+      case SyntaxNode::kPropertyGet:
+        Emit(kOpInitGetter, dst, key, t);
+        break;
+      case SyntaxNode::kPropertyInit:
+        Emit(kOpInitProp, dst, key, t);
+        break;
+    }
+  }
+  FreeRegisters(t);
+}
+
+void BytecodeCompiler::CompileExpression_(SequenceExpression* expr, int dst) {
+  // 11.14 Comma Operator ( , )
+  for (auto it = expr->expressions.begin(); it != expr->expressions.end(); ++it) {
+    CompileExpression(*it, dst);
+  }
+}
+
+void BytecodeCompiler::CompileExpression_(UnaryExpression* expr, int dst) {
+  switch (expr->_operator) {
+    case SyntaxNode::kUnaryDelete:
+      // 11.4.1 The delete Operator
+      if (expr->argument->type == SyntaxNode::kIdentifier) {
+        int name = GetIdentifierIndex(static_cast<Identifier*>(expr->argument));
+        int depth, slot;
+        Resolution resolution = Resolve(name, depth, slot);
+        if (resolution == kResolvedLocal || resolution == kResolvedSlot) {
+          // Declared bindings can't be deleted.
+          Emit(kOpLoadBool, dst, 0);
+        } else {
+          Emit(kOpDeleteName, dst, name);
+        }
+      } else if (expr->argument->type == SyntaxNode::kMemberExpression) {
+        MemberExpression* member = static_cast<MemberExpression*>(expr->argument);
+        int o = AllocRegister();
+        CompileExpression(member->object, o);
+        int k = AllocRegister();
+        CompileMemberKey(member, k);
+        Emit(kOpDeleteElem, dst, o, k);
+        FreeRegisters(o);
+      } else {
+        Emit(kOpThrowReferenceError);
+      }
+      break;
+    case SyntaxNode::kUnaryTypeOf:
+      // 11.4.3 The typeof Operator
+      if (expr->argument->type == SyntaxNode::kIdentifier) {
+        int name = GetIdentifierIndex(static_cast<Identifier*>(expr->argument));
+        int depth, slot;
+        switch (Resolve(name, depth, slot)) {
+          case kResolvedLocal:
+          case kResolvedSlot:
+            CompileLoadName(name, dst);
+            Emit(kOpTypeOf, dst, dst);
+            break;
+          case kResolvedGlobal:
+            Emit(kOpTypeOfGlobal, dst, AddPropertyCache(name));
+            break;
+          case kResolvedName:
+            Emit(kOpTypeOfName, dst, name);
+            break;
+        }
+      } else {
+        CompileExpression(expr->argument, dst);
+        Emit(kOpTypeOf, dst, dst);
+      }
+      break;
+    case SyntaxNode::kUnaryVoid:
+      CompileExpression(expr->argument, dst);
+      Emit(kOpLoadUndefined, dst);
+      break;
+    case SyntaxNode::kUnaryPositive:
+      CompileExpression(expr->argument, dst);
+      Emit(kOpPositive, dst, dst);
+      break;
+    case SyntaxNode::kUnaryNegative:
+      CompileExpression(expr->argument, dst);
+      Emit(kOpNegative, dst, dst);
+      break;
+    case SyntaxNode::kUnaryBitwiseNot:
+      CompileExpression(expr->argument, dst);
+      Emit(kOpBitwiseNot, dst, dst);
+      break;
+    case SyntaxNode::kUnaryLogicalNot:
+      CompileExpression(expr->argument, dst);
+      Emit(kOpLogicalNot, dst, dst);
+      break;
+    default:
+      assert(false);
+      break;
+  }
+}
+
+static Opcode GetBinaryOpcode(SyntaxNode::BinaryOperator op) {
+  switch (op) {
+    case SyntaxNode::kBinaryMultiplication: return kOpMultiply;
+    case SyntaxNode::kBinaryDivision: return kOpDivide;
+    case SyntaxNode::kBinaryRemainder: return kOpRemainder;
+    case SyntaxNode::kBinaryAddition: return kOpAdd;
+    case SyntaxNode::kBinarySubtraction: return kOpSubtract;
+    case SyntaxNode::kBinaryLeftShift: return kOpLeftShift;
+    case SyntaxNode::kBinarySignedRightShift: return kOpSignedRightShift;
+    case SyntaxNode::kBinaryUnsignedRightShift: return kOpUnsignedRightShift;
+    case SyntaxNode::kBinaryLessThan: return kOpLessThan;
+    case SyntaxNode::kBinaryGreaterThan: return kOpGreaterThan;
+    case SyntaxNode::kBinaryLessThanOrEqual: return kOpLessThanOrEqual;
+    case SyntaxNode::kBinaryGreaterThanOrEqual: return kOpGreaterThanOrEqual;
+    case SyntaxNode::kBinaryInstanceOf: return kOpInstanceOf;
+    case SyntaxNode::kBinaryIn: return kOpIn;
+    case SyntaxNode::kBinaryEquals: return kOpEquals;
+    case SyntaxNode::kBinaryDoesNotEqual: return kOpDoesNotEqual;
+    case SyntaxNode::kBinaryStrictEquals: return kOpStrictEquals;
+    case SyntaxNode::kBinaryStrictDoesNotEqual: return kOpStrictDoesNotEqual;
+    case SyntaxNode::kBinaryBitwiseAnd: return kOpBitwiseAnd;
+    case SyntaxNode::kBinaryBitwiseXor: return kOpBitwiseXor;
+    case SyntaxNode::kBinaryBitwiseOr: return kOpBitwiseOr;
+  }
+  assert(false);
+  return kOpNop;
+}
+
+static Opcode GetAssignmentOpcode(SyntaxNode::AssignmentOperator op) {
+  switch (op) {
+    case SyntaxNode::kAssignmentMultiplication: return kOpMultiply;
+    case SyntaxNode::kAssignmentDivision: return kOpDivide;
+    case SyntaxNode::kAssignmentRemainder: return kOpRemainder;
+    case SyntaxNode::kAssignmentAddition: return kOpAdd;
+    case SyntaxNode::kAssignmentSubtraction: return kOpSubtract;
+    case SyntaxNode::kAssignmentLeftShift: return kOpLeftShift;
+    case SyntaxNode::kAssignmentSignedRightShift: return kOpSignedRightShift;
+    case SyntaxNode::kAssignmentUnsignedRightShift: return kOpUnsignedRightShift;
+    case SyntaxNode::kAssignmentBitwiseAnd: return kOpBitwiseAnd;
+    case SyntaxNode::kAssignmentBitwiseXor: return kOpBitwiseXor;
+    case SyntaxNode::kAssignmentBitwiseOr: return kOpBitwiseOr;
+    case SyntaxNode::kAssignmentNone:
+      break;
+  }
+  assert(false);
+  return kOpNop;
+}
+
+void BytecodeCompiler::CompileExpression_(BinaryExpression* expr, int dst) {
+  CompileExpression(expr->left, dst);
+  int t = AllocRegister();
+  CompileExpression(expr->right, t);
+  Emit(GetBinaryOpcode(expr->_operator), dst, dst, t);
+  FreeRegisters(t);
+}
+
+void BytecodeCompiler::CompileExpression_(AssignmentExpression* expr, int dst) {
+  // 11.13 Assignment Operators
+  if (expr->left->type == SyntaxNode::kIdentifier) {
+    int name = GetIdentifierIndex(static_cast<Identifier*>(expr->left));
+    if (expr->_operator == SyntaxNode::kAssignmentNone) {
+      CompileExpression(expr->right, dst);
+    } else {
+      CompileLoadName(name, dst);
+      int t = AllocRegister();
+      CompileExpression(expr->right, t);
+      Emit(GetAssignmentOpcode(expr->_operator), dst, dst, t);
+      FreeRegisters(t);
+    }
+    CompileStoreName(name, dst);
+  } else if (expr->left->type == SyntaxNode::kMemberExpression) {
+    MemberExpression* member = static_cast<MemberExpression*>(expr->left);
+    int o = AllocRegister();
+    CompileExpression(member->object, o);
+    int k = -1;
+    int name = -1;
+    if (member->computed) {
+      k = AllocRegister();
+      CompileExpression(member->property, k);
+    } else {
+      name = GetIdentifierIndex(static_cast<Identifier*>(member->property));
+    }
+    if (expr->_operator == SyntaxNode::kAssignmentNone) {
+      CompileExpression(expr->right, dst);
+    } else {
+      if (member->computed) {
+        Emit(kOpGetElem, dst, o, k);
+      } else {
+        Emit(kOpGetProp, dst, o, AddPropertyCache(name));
+      }
+      int t = AllocRegister();
+      CompileExpression(expr->right, t);
+      Emit(GetAssignmentOpcode(expr->_operator), dst, dst, t);
+    }
+    if (member->computed) {
+      Emit(kOpPutElem, o, k, dst);
+    } else {
+      Emit(kOpPutProp, o, AddPropertyCache(name), dst);
+    }
+    FreeRegisters(o);
+  } else {
+    Emit(kOpThrowReferenceError);
+  }
+}
+
+void BytecodeCompiler::CompileExpression_(UpdateExpression* expr, int dst) {
+  // 11.3 Postfix Expressions
+  // 11.4.4 Prefix Increment Operator
+  // 11.4.5 Prefix Decrement Operator
+  Opcode op = expr->_operator == SyntaxNode::kUpdateIncrement ? kOpIncrement : kOpDecrement;
+  int t = AllocRegister();
+  int old_val = expr->prefix ? t : dst;
+  int new_val = expr->prefix ? dst : t;
+  if (expr->argument->type == SyntaxNode::kIdentifier) {
+    int name = GetIdentifierIndex(static_cast<Identifier*>(expr->argument));
+    CompileLoadName(name, old_val);
+    Emit(op, new_val, old_val);
+    CompileStoreName(name, new_val);
+  } else if (expr->argument->type == SyntaxNode::kMemberExpression) {
+    MemberExpression* member = static_cast<MemberExpression*>(expr->argument);
+    int o = AllocRegister();
+    CompileExpression(member->object, o);
+    if (member->computed) {
+      int k = AllocRegister();
+      CompileExpression(member->property, k);
+      Emit(kOpGetElem, old_val, o, k);
+      Emit(op, new_val, old_val);
+      Emit(kOpPutElem, o, k, new_val);
+    } else {
+      int name = GetIdentifierIndex(static_cast<Identifier*>(member->property));
+      Emit(kOpGetProp, old_val, o, AddPropertyCache(name));
+      Emit(op, new_val, old_val);
+      Emit(kOpPutProp, o, AddPropertyCache(name), new_val);
+    }
+  } else {
+    Emit(kOpThrowReferenceError);
+  }
+  FreeRegisters(t);
+}
+
+void BytecodeCompiler::CompileExpression_(LogicalExpression* expr, int dst) {
+  // 11.11 Binary Logical Operators
+  CompileExpression(expr->left, dst);
+  int jump_to_end = Emit(expr->_operator == SyntaxNode::kLogicalAnd ? kOpJumpIfFalse : kOpJumpIfTrue, dst);
+  CompileExpression(expr->right, dst);
+  PatchJump(jump_to_end, Here());
+}
+
+void BytecodeCompiler::CompileExpression_(ConditionalExpression* expr, int dst) {
+  // 11.12 Conditional Operator ( ? : )
+  int t = AllocRegister();
+  CompileExpression(expr->test, t);
+  int jump_to_alternate = Emit(kOpJumpIfFalse, t);
+  FreeRegisters(t);
+  CompileExpression(expr->consequent, dst);
+  int jump_to_end = Emit(kOpJump);
+  PatchJump(jump_to_alternate, Here());
+  CompileExpression(expr->alternate, dst);
+  PatchJump(jump_to_end, Here());
+}
+
+void BytecodeCompiler::CompileExpression_(NewExpression* expr, int dst) {
+  // 11.2.2 The new Operator
+  int argc = static_cast<int>(expr->arguments.size());
+  int base = AllocRegisters(argc + 2);
+  CompileExpression(expr->callee, base);
+  for (int i = 0; i < argc; i++) {
+    CompileExpression(expr->arguments[i], base + 2 + i);
+  }
+  Emit(kOpNew, dst, base, argc + 1);
+  FreeRegisters(base);
+}
+
+void BytecodeCompiler::CompileExpression_(CallExpression* expr, int dst) {
+  // 11.2.3 Function Calls
+  int argc = static_cast<int>(expr->arguments.size());
+  int base = AllocRegisters(argc + 2);
+  if (expr->callee->type == SyntaxNode::kIdentifier) {
+    int name = GetIdentifierIndex(static_cast<Identifier*>(expr->callee));
+    int depth, slot;
+    switch (Resolve(name, depth, slot)) {
+      case kResolvedLocal:
+      case kResolvedSlot:
+        CompileLoadName(name, base);
+        Emit(kOpLoadUndefined, base + 1);
+        break;
+      case kResolvedGlobal:
+        Emit(kOpLoadGlobalAndThis, base, AddPropertyCache(name));
+        break;
+      case kResolvedName:
+        Emit(kOpLoadNameAndThis, base, name);
+        break;
+    }
+  } else if (expr->callee->type == SyntaxNode::kMemberExpression) {
+    MemberExpression* member = static_cast<MemberExpression*>(expr->callee);
+    CompileExpression(member->object, base + 1);
+    if (member->computed) {
+      int k = AllocRegister();
+      CompileExpression(member->property, k);
+      Emit(kOpGetElem, base, base + 1, k);
+      FreeRegisters(k);
+    } else {
+      Emit(kOpGetProp, base, base + 1, AddPropertyCache(GetIdentifierIndex(static_cast<Identifier*>(member->property))));
+    }
+  } else {
+    CompileExpression(expr->callee, base);
+    Emit(kOpLoadUndefined, base + 1);
+  }
+  for (int i = 0; i < argc; i++) {
+    CompileExpression(expr->arguments[i], base + 2 + i);
+  }
+  Emit(kOpCall, dst, base, argc + 1);
+  FreeRegisters(base);
+}
+
+void BytecodeCompiler::CompileExpression_(MemberExpression* expr, int dst) {
+  // 11.2.1 Property Accessors
+  CompileExpression(expr->object, dst);
+  if (expr->computed) {
+    int k = AllocRegister();
+    CompileExpression(expr->property, k);
+    Emit(kOpGetElem, dst, dst, k);
+    FreeRegisters(k);
+  } else {
+    Emit(kOpGetProp, dst, dst, AddPropertyCache(GetIdentifierIndex(static_cast<Identifier*>(expr->property))));
+  }
+}
+
+void BytecodeCompiler::CompileExpression_(NumberLiteral* expr, int dst) {
+  double d = expr->value;
+  if (d >= INT32_MIN && d <= INT32_MAX) {
+    int n = static_cast<int>(d);
+    if (any_ref(n).smi() == d) {
+      Emit(kOpLoadInt, dst, n);
+      return;
+    }
+  }
+  Emit(kOpLoadNumber, dst, static_cast<int>(block_->numbers.size()));
+  block_->numbers.push_back(d);
+}
+
+void BytecodeCompiler::CompileExpression_(StringLiteral* expr, int dst) {
+  Emit(kOpLoadString, dst, GetStringIndex(expr));
+}
+
+void BytecodeCompiler::CompileMemberKey(MemberExpression* expr, int dst) {
+  if (expr->computed) {
+    CompileExpression(expr->property, dst);
+  } else {
+    Emit(kOpLoadString, dst, GetIdentifierIndex(static_cast<Identifier*>(expr->property)));
+  }
+}
+
+// Misc
+
+int BytecodeCompiler::Emit(Opcode op, int a, int b, int c) {
+  Instruction inst;
+  inst.op = op;
+  inst.a = a;
+  inst.b = b;
+  inst.c = c;
+  block_->code.push_back(inst);
+  block_->positions.push_back(node_->loc.start);
+  return static_cast<int>(block_->code.size()) - 1;
+}
+
+void BytecodeCompiler::PatchJump(int pc, int target) {
+  Instruction& inst = block_->code[pc];
+  if (inst.op == kOpJump) {
+    inst.a = target;
+  } else {
+    assert(inst.op == kOpJumpIfTrue || inst.op == kOpJumpIfFalse);
+    inst.b = target;
+  }
+}
+
+void BytecodeCompiler::PatchJumps(const std::vector<int>& pcs, int target) {
+  for (auto it = pcs.begin(); it != pcs.end(); ++it) {
+    PatchJump(*it, target);
+  }
+}
+
+int BytecodeCompiler::OpenHandler(int env) {
+  ExceptionHandler handler;
+  handler.start = Here();
+  handler.end = -1;
+  handler.target = -1;
+  handler.env = env;
+  block_->handlers.push_back(handler);
+  return static_cast<int>(block_->handlers.size()) - 1;
+}
+
+void BytecodeCompiler::CloseHandler(int handler) {
+  block_->handlers[handler].end = Here();
+}
+
+void BytecodeCompiler::PatchHandlers(const std::vector<int>& handlers, int target) {
+  for (auto it = handlers.begin(); it != handlers.end(); ++it) {
+    block_->handlers[*it].target = target;
+  }
+}
+
+int BytecodeCompiler::AddString(u16string s) {
+  std::u16string key(s.begin(), s.end());
+  auto it = shared_->strings.find(key);
+  if (it != shared_->strings.end()) return (*it).second;
+  auto& string_table = script_->string_table();
+  int index = static_cast<int>(string_table.size());
+  string_table.push_back(const_cast<u16string_data*>(intern(s).get__()));
+  shared_->strings[key] = index;
+  return index;
+}
+
+int BytecodeCompiler::AddPropertyCache(int name) {
+  PropertyCache cache;
+  cache.name = name;
+  cache.size = 0;
+  int index = static_cast<int>(block_->caches.size());
+  block_->caches.push_back(cache);
+  return index;
+}
+
+int BytecodeCompiler::GetStringIndex(StringLiteral* expr) {
+  // 0 is the empty string.
+  return expr->value;
+}
+
+int BytecodeCompiler::GetPropertyKeyIndex(Expression* key) {
+  // 11.1.5 Object Initialiser
+  switch (key->type) {
+    case SyntaxNode::kIdentifier:
+      return GetIdentifierIndex(static_cast<Identifier*>(key));
+    case SyntaxNode::kStringLiteral:
+      return GetStringIndex(static_cast<StringLiteral*>(key));
+    case SyntaxNode::kNumberLiteral: {
+      double d = static_cast<NumberLiteral*>(key)->value;
+      any_ref v;
+      int n = static_cast<int>(d);
+      if (n == d) {
+        v = n;
+      } else {
+        v = d;
+      }
+      return AddString(ToString(nullptr, v));
+    }
+    default:
+      assert(false);
+      return 0;
+  }
+}
+
+}  // namespace internal
+}  // namespace nabla
@@ -0,0 +1,354 @@
+/* Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+ * Copyright (C) 2014 Katsuya Iida. All rights reserved.
+ */
+
+#pragma once
+
+#ifndef NABLA_BYTECODE_HH_
+#define NABLA_BYTECODE_HH_
+
+#include <map>
+#include <vector>
+
+#include "ast.hh"
+#include "context.hh"
+#include "data.hh"
+
+namespace nabla {
+namespace internal {
+
+// Instructions have up to three operands a, b and c. Unless noted
+// otherwise an operand is a register index. `name' and `str' are
+// indices of the string table of the script, `target' is an index
+// into the instruction array of the block, `cache' is an index of
+// the property caches of the block, which also holds the name.
+#define NABLA_OPCODE_LIST(V) \
+  V(Nop)              /* */ \
+  V(LoadUndefined)    /* a */ \
+  V(LoadNull)         /* a */ \
+  V(LoadBool)         /* a, b: 0 or 1 */ \
+  V(LoadInt)          /* a, b: immediate */ \
+  V(LoadNumber)       /* a, b: numbers[b] */ \
+  V(LoadString)       /* a, b: str */ \
+  V(LoadRegExp)       /* a, b: regexps[b] */ \
+  V(LoadThis)         /* a */ \
+  V(Move)             /* a, b */ \
+  V(LoadLocal)        /* a, b: slot */ \
+  V(StoreLocal)       /* a: slot, b */ \
+  V(LoadScoped)       /* a, b: depth, c: slot */ \
+  V(StoreScoped)      /* a: depth, b: slot, c */ \
+  V(LoadGlobal)       /* a, b: cache */ \
+  V(LoadGlobalAndThis) /* a, b: cache; sets a and a + 1 */ \
+  V(TypeOfGlobal)     /* a, b: cache */ \
+  V(StoreGlobal)      /* a: cache, b */ \
+  V(LoadName)         /* a, b: name */ \
+  V(LoadNameAndThis)  /* a, b: name; sets a and a + 1 */ \
+  V(TypeOfName)       /* a, b: name */ \
+  V(StoreName)        /* a: name, b */ \
+  V(DeleteName)       /* a, b: name */ \
+  V(GetProp)          /* a, b: object, c: cache */ \
+  V(GetElem)          /* a, b: object, c: key */ \
+  V(PutProp)          /* a: object, b: cache, c */ \
+  V(PutElem)          /* a: object, b: key, c */ \
+  V(DeleteElem)       /* a, b: object, c: key */ \
+  V(Multiply)         /* a, b, c */ \
+  V(Divide)           /* a, b, c */ \
+  V(Remainder)        /* a, b, c */ \
+  V(Add)              /* a, b, c */ \
+  V(Subtract)         /* a, b, c */ \
+  V(LeftShift)        /* a, b, c */ \
+  V(SignedRightShift) /* a, b, c */ \
+  V(UnsignedRightShift) /* a, b, c */ \
+  V(LessThan)         /* a, b, c */ \
+  V(GreaterThan)      /* a, b, c */ \
+  V(LessThanOrEqual)  /* a, b, c */ \
+  V(GreaterThanOrEqual) /* a, b, c */ \
+  V(InstanceOf)       /* a, b, c */ \
+  V(In)               /* a, b, c */ \
+  V(Equals)           /* a, b, c */ \
+  V(DoesNotEqual)     /* a, b, c */ \
+  V(StrictEquals)     /* a, b, c */ \
+  V(StrictDoesNotEqual) /* a, b, c */ \
+  V(BitwiseAnd)       /* a, b, c */ \
+  V(BitwiseXor)       /* a, b, c */ \
+  V(BitwiseOr)        /* a, b, c */ \
+  V(Positive)         /* a, b */ \
+  V(Negative)         /* a, b */ \
+  V(BitwiseNot)       /* a, b */ \
+  V(LogicalNot)       /* a, b */ \
+  V(TypeOf)           /* a, b */ \
+  V(Increment)        /* a, b */ \
+  V(Decrement)        /* a, b */ \
+  V(Jump)             /* a: target */ \
+  V(JumpIfTrue)       /* a, b: target */ \
+  V(JumpIfFalse)      /* a, b: target */ \
+  V(NewObject)        /* a */ \
+  V(NewArray)         /* a */ \
+  V(InitProp)         /* a: object, b: name, c */ \
+  V(InitGetter)       /* a: object, b: name, c */ \
+  V(InitSetter)       /* a: object, b: name, c */ \
+  V(InitElem)         /* a: array, b: immediate index, c */ \
+  V(Closure)          /* a, b: block */ \
+  V(Call)             /* a, b: callee, then this and arguments, c: argc */ \
+  V(New)              /* a, b: callee, then a slot and arguments, c: argc */ \
+  V(Return)           /* a */ \
+  V(Throw)            /* a */ \
+  V(ThrowReferenceError) /* */ \
+  V(ThrowSyntaxError) /* */ \
+  V(Catch)            /* a */ \
+  V(GetEnv)           /* a */ \
+  V(SetEnv)           /* a */ \
+  V(EnterWith)        /* a */ \
+  V(EnterCatch)       /* a, b: catch name */ \
+  V(ForInPrepare)     /* a: names, a + 1: position, b: object */ \
+  V(ForInNext)        /* a, b: names, c: target */
+
+enum Opcode {
+#define NABLA_OPCODE_ENUM(name) kOp##name,
+  NABLA_OPCODE_LIST(NABLA_OPCODE_ENUM)
+#undef NABLA_OPCODE_ENUM
+  kOpCount
+};
+
+struct Instruction {
+  Opcode op;
+  int a;
+  int b;
+  int c;
+};
+
+// Instructions in [start, end) transfer control to target when an
+// exception is thrown, restoring the environment saved in env.
+struct ExceptionHandler {
+  int start;
+  int end;
+  int target;
+  int env;
+};
+
+// Inline cache of a property access. An entry remembers where the
+// property was found for objects of a shape: in the slot index of the
+// object itself when depth is 0, or of holder, depth objects up in the
+// prototype chain. Objects in between are checked by proto_shape.
+// The caches aren't scanned by the collector, so entries only point
+// to shared shapes, which the transitions from the empty shape keep
+// alive. Dictionary shapes are never cached: they can be collected and
+// their addresses reused. holder is only compared with live objects
+// and checked by holder_shape, so an entry for a collected holder
+// finds the same slot of any object of that shape at its address.
+struct PropertyCache {
+  static const int kMaxEntries = 4;
+  static const int kMaxDepth = 2;
+  // size of a cache that missed with all the entries in use.
+  static const int kMegamorphic = -1;
+
+  struct Entry {
+    Shape* shape;
+    Shape* proto_shape;
+    Object* holder;
+    Shape* holder_shape;
+    int depth;
+    uint32_t index;
+  };
+
+  int name;
+  int size;
+  Entry entries[kMaxEntries];
+};
+
+struct FunctionBinding {
+  int name;
+  int slot;
+  int block;
+};
+
+// Compiled code of the program or a function.
+class CodeBlock {
+ public:
+  CodeBlock(FunctionNode* function)
+      : function(function), arguments_slot(-1), needs_arguments(false), num_registers(0) {}
+
+  // nullptr for the program.
+  FunctionNode* function;
+  std::vector<Instruction> code;
+  // Start of the node each instruction was compiled from.
+  std::vector<Position> positions;
+  std::vector<double> numbers;
+  std::vector<RegExpLiteral*> regexps;
+  std::vector<ExceptionHandler> handlers;
+  std::vector<PropertyCache> caches;
+
+  // 10.5 Declaration Binding Instantiation
+  // The program creates its bindings by name in the global
+  // environment. Function code keeps them in the slots of its
+  // environment; params and variable_bindings are then slots.
+  std::vector<int> params;
+  std::vector<FunctionBinding> function_bindings;
+  std::vector<int> variable_bindings;
+  // Names of the slots, to find them by name inside with statements.
+  std::vector<int> slot_names;
+  // Names of the catch parameters, each the only slot of the
+  // environment its catch block runs in.
+  std::vector<int> catch_names;
+  int arguments_slot;
+  // The arguments object is only created when it may be referred.
+  bool needs_arguments;
+
+  int num_registers;
+};
+
+// Compiled code of a script. blocks[0] is the program.
+class Bytecode {
+ public:
+  ~Bytecode();
+  CodeBlock* program() { return blocks[0]; }
+
+  std::vector<CodeBlock*> blocks;
+};
+
+class BytecodeCompiler {
+ public:
+  static Bytecode* Compile(Script* script);
+
+ private:
+  // Static scope in which identifiers are resolved.
+  struct Scope {
+    enum Kind { kProgram, kFunction, kCatch, kWith };
+
+    Scope(Kind kind, Scope* outer, CodeBlock* block) : kind(kind), outer(outer), block(block) {}
+
+    Kind kind;
+    Scope* outer;
+    // The block whose environment holds the slots.
+    CodeBlock* block;
+    // Name to slot.
+    std::map<int, int> slots;
+  };
+
+  enum Resolution { kResolvedLocal, kResolvedSlot, kResolvedGlobal, kResolvedName };
+
+  struct ControlScope {
+    // kCatch covers the try block, and kCatchBody the catch block,
+    // which runs in an environment of its own.
+    enum Kind { kLoop, kSwitch, kLabel, kWith, kCatch, kCatchBody, kFinally };
+
+    ControlScope(Kind kind) : kind(kind), env(-1), finalizer(nullptr) {}
+
+    Kind kind;
+    std::vector<int> labels;
+    std::vector<int> breaks;
+    std::vector<int> continues;
+    int env;
+    // Handler entries covering the protected code. A new entry is
+    // started each time the code leaves the scope by a jump.
+    std::vector<int> handlers;
+    BlockStatement* finalizer;
+  };
+
+  // State shared by the compilers of all the blocks of a script.
+  struct SharedState {
+    std::map<std::u16string, int> strings;
+    std::map<FunctionNode*, int> functions;
+    int arguments_name;
+  };
+
+  BytecodeCompiler(Script* script, Bytecode* bytecode, CodeBlock* block, SharedState* shared);
+
+  int CompileFunction(FunctionNode* node, Scope* outer);
+  void CompileProgram(Program* program);
+  void CompileFunctionBody(FunctionNode* node, Scope* outer);
+  void CompileFunctionDeclarations(Scope* scope);
+
+  void CollectFunctionBindings(std::vector<Statement*>& body);
+  void CollectFunctionBindings(Statement* stmt);
+  void CollectVariableBindings(std::vector<Statement*>& body);
+  void CollectVariableBindings(Statement* stmt);
+  void CollectVariableBindings(VariableDeclaration* stmt);
+
+  void CompileStatement(Statement* stmt) { CompileStatementWithLabel(stmt, std::vector<int>()); }
+  void CompileStatementWithLabel(Statement* stmt, const std::vector<int>& labels);
+  void CompileStatement_(BlockStatement* stmt);
+  void CompileStatement_(ExpressionStatement* stmt);
+  void CompileStatement_(IfStatement* stmt);
+  void CompileStatementWithLabel_(LabeledStatement* stmt, const std::vector<int>& labels);
+  void CompileStatement_(BreakStatement* stmt);
+  void CompileStatement_(ContinueStatement* stmt);
+  void CompileStatement_(WithStatement* stmt);
+  void CompileStatementWithLabel_(SwitchStatement* stmt, const std::vector<int>& labels);
+  void CompileStatement_(ReturnStatement* stmt);
+  void CompileStatement_(ThrowStatement* stmt);
+  void CompileStatement_(TryStatement* stmt);
+  void CompileStatementWithLabel_(WhileStatement* stmt, const std::vector<int>& labels);
+  void CompileStatementWithLabel_(DoWhileStatement* stmt, const std::vector<int>& labels);
+  void CompileStatementWithLabel_(ForStatement* stmt, const std::vector<int>& labels);
+  void CompileStatementWithLabel_(ForInStatement* stmt, const std::vector<int>& labels);
+  void CompileStatement_(VariableDeclaration* stmt);
+
+  void CompileExpression(Expression* expr, int dst);
+  void CompileExpression_(ArrayExpression* expr, int dst);
+  void CompileExpression_(ObjectExpression* expr, int dst);
+  void CompileExpression_(SequenceExpression* expr, int dst);
+  void CompileExpression_(UnaryExpression* expr, int dst);
+  void CompileExpression_(BinaryExpression* expr, int dst);
+  void CompileExpression_(AssignmentExpression* expr, int dst);
+  void CompileExpression_(UpdateExpression* expr, int dst);
+  void CompileExpression_(LogicalExpression* expr, int dst);
+  void CompileExpression_(ConditionalExpression* expr, int dst);
+  void CompileExpression_(NewExpression* expr, int dst);
+  void CompileExpression_(CallExpression* expr, int dst);
+  void CompileExpression_(MemberExpression* expr, int dst);
+  void CompileExpression_(NumberLiteral* expr, int dst);
+  void CompileExpression_(StringLiteral* expr, int dst);
+  void CompileMemberKey(MemberExpression* expr, int dst);
+  void CompileLoadName(int name, int dst);
+  void CompileStoreName(int name, int src);
+  Resolution Resolve(int name, int& depth, int& slot);
+  void MarkDynamicScope(Scope* scope);
+  int DeclareSlot(int name);
+  void CompileUnwind(size_t depth);
+  void CompileRewind(size_t depth);
+
+  int AllocRegister() {
+    int r = next_register_++;
+    if (next_register_ > block_->num_registers) block_->num_registers = next_register_;
+    return r;
+  }
+  int AllocRegisters(int n) {
+    int r = next_register_;
+    next_register_ += n;
+    if (next_register_ > block_->num_registers) block_->num_registers = next_register_;
+    return r;
+  }
+  void FreeRegisters(int r) { next_register_ = r; }
+
+  int Emit(Opcode op, int a = 0, int b = 0, int c = 0);
+  int Here() const { return static_cast<int>(block_->code.size()); }
+  void PatchJump(int pc, int target);
+  void PatchJumps(const std::vector<int>& pcs, int target);
+  int OpenHandler(int env);
+  void CloseHandler(int handler);
+  void PatchHandlers(const std::vector<int>& handlers, int target);
+
+  int AddString(u16string s);
+  int AddPropertyCache(int name);
+  int GetStringIndex(StringLiteral* expr);
+  int GetPropertyKeyIndex(Expression* key);
+  int GetIdentifierIndex(Identifier* ident) const { return ident->name; }
+
+  Script* script_;
+  Bytecode* bytecode_;
+  CodeBlock* block_;
+  std::vector<ControlScope> scopes_;
+  Scope* scope_;
+  std::vector<FunctionNode*> function_declarations_;
+  // The node being compiled, whose position Emit() records.
+  const SyntaxNode* node_;
+  SharedState* shared_;
+  int next_register_;
+  int completion_register_;
+};
+
+}  // namespace internal
+}  // namespace nabla
+
+#endif  // NABLA_BYTECODE_HH_
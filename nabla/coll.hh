@@ -8,8 +8,12 @@
 #define NABLA_COLL_HH_
 
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <cassert>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace nabla {
 namespace internal {
@@ -118,21 +122,64 @@ class list {
   node list_;
 };
 
+// Types that can be moved to another address by copying their bytes.
+// Containers grow them with GC_REALLOC and move the others one by one.
 template <typename T>
-class vector {
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+template <typename T>
+inline void relocate(T* src, size_t n, T* dst) {
+  if (is_trivially_relocatable<T>::value) {
+    if (n) memcpy(static_cast<void*>(dst), static_cast<const void*>(src), n * sizeof (T));
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    new (&dst[i]) T(std::move(src[i]));
+    src[i].~T();
+  }
+}
+
+template <typename V, size_t N>
+struct inline_storage {
+  V* inline_data() { return inline_; }
+  V inline_[N];
+};
+
+template <typename V>
+struct inline_storage<V, 0> {
+  V* inline_data() { return nullptr; }
+};
+
+// A GC-backed vector. The first N elements are stored in the vector itself,
+// which saves the allocation for short lists such as call arguments as long
+// as the vector isn't copied. Capacity doubles as it grows.
+template <typename T, size_t N = 0>
+class vector : private inline_storage<T, N> {
  public:
   typedef T* iterator;
   typedef const T* const_iterator;
-  void init() { data_ = nullptr; size_ = 0; capacity_ = 0; }
+  void init() { data_ = this->inline_data(); size_ = 0; capacity_ = N; }
   T& operator [] (size_t i) { return data_[i]; }
   const T& operator [] (size_t i) const { return data_[i]; }
   size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  // Bytes of the block holding the elements beyond the inline ones.
+  size_t heap_bytes() const { return capacity_ > N ? capacity_ * sizeof (T) : 0; }
   void resize(size_t n) { reserve(n); size_ = n; }
   void reserve(size_t n) {
-    if (n >= capacity_) {
-      data_ = gc_realloc_array_cast<T>(data_, (n + 63) & ~63);
-      capacity_ = n;
+    if (n <= capacity_) return;
+    size_t capacity = capacity_ * 2;
+    if (capacity < n) capacity = n;
+    if (capacity < 8) capacity = 8;
+    T* data;
+    if (is_trivially_relocatable<T>::value && data_ != this->inline_data()) {
+      data = gc_realloc_array_cast<T>(data_, capacity);
+    } else {
+      data = reinterpret_cast<T*>(gc_malloc(capacity * sizeof (T)));
+      relocate(data_, size_, data);
     }
+    data_ = data;
+    capacity_ = capacity;
   }
   iterator begin() { return data_; }
   iterator end() { return data_ + size_; }
@@ -141,7 +188,7 @@ class vector {
   iterator erase(iterator first, iterator last) {
     iterator ret = first;
     while (last != end()) {
-      *first = *last;
+      *first = std::move(*last);
       ++first;
       ++last;
     }
@@ -152,8 +199,23 @@ class vector {
     return erase(position, position + 1);
   }
   void push_back(const T& val) {
-    reserve(size_ + 1);
-    (*this)[size_++] = val;
+    if (size_ == capacity_) {
+      // val may be one of the elements, which are about to move.
+      T copy(val);
+      reserve(size_ + 1);
+      new (&data_[size_++]) T(std::move(copy));
+      return;
+    }
+    new (&data_[size_++]) T(val);
+  }
+  void push_back(T&& val) {
+    if (size_ == capacity_) {
+      T moved(std::move(val));
+      reserve(size_ + 1);
+      new (&data_[size_++]) T(std::move(moved));
+      return;
+    }
+    new (&data_[size_++]) T(std::move(val));
   }
   T& pop_back() {
     return (*this)[--size_];
@@ -165,213 +227,329 @@ class vector {
   size_t capacity_;
 };
 
-template <typename K, typename T>
-class map {
+// Hash of a map key. Keys provide hash() unless they are pointers, which are
+// hashed by address.
+template <typename K>
+inline uint32_t key_hash(const K& k) {
+  return k.hash();
+}
+
+template <typename T>
+inline uint32_t key_hash(T* const& p) {
+  uintptr_t v = reinterpret_cast<uintptr_t>(p);
+  return static_cast<uint32_t>((v >> 3) * 0x9e3779b1u);
+}
+
+// A map for a handful of entries, iterated in insertion order. Up to N
+// entries are kept inside the map itself. Beyond that they move to a GC
+// block, which is searched linearly while it holds at most kMaxLinear
+// entries. Larger maps also keep an open-addressing index of their
+// positions, so that lookups stay O(1), in an atomic block the collector
+// doesn't scan.
+template <typename K, typename T, size_t N = 0>
+class map : private inline_storage<pair<K, T>, N> {
  public:
   typedef K key_type;
   typedef T mapped_type;
   typedef pair<key_type, mapped_type> value_type;
-  typedef list<value_type> list_type;
-  typedef typename list_type::iterator iterator;
-  typedef typename list_type::const_iterator const_iterator;
+  typedef value_type* iterator;
+  typedef const value_type* const_iterator;
+
+  static const size_t kMaxLinear = 8;
 
  public:
-  void init() { list_.init(); }
+  void init() {
+    entries_ = this->inline_data();
+    index_ = nullptr;
+    size_ = 0;
+    capacity_ = N;
+  }
 
   mapped_type& operator [] (const key_type& k) {
     iterator it = find(k);
-    if (it == end()) {
-      value_type v;
-      v.first = k;
-      list_.push_back(v);
-      it = end();
-      --it;
-    }
-    return (*it).second;
-  }
-
-  void erase(iterator first, iterator last) {
-    list_.erase(first, last);
+    if (it != end()) return it->second;
+    if (size_ == capacity_) grow();
+    value_type& v = entries_[size_];
+    v.first = k;
+    v.second = mapped_type();
+    if (index_) add_to_index(size_);
+    size_++;
+    return v.second;
   }
 
   void erase(iterator position) {
-    list_.erase(position);
+    iterator last = end() - 1;
+    while (position < last) {
+      *position = *(position + 1);
+      position++;
+    }
+    size_--;
+    if (index_) rebuild_index();
   }
 
   iterator find(const key_type& k) {
-    auto it = list_.begin();
-    while (it != list_.end()) {
-      value_type& v = *it;
-      if (v.first == k) return it;
-      ++it;
-    }
-    return it;
+    return const_cast<iterator>(static_cast<const map*>(this)->find(k));
   }
 
   const_iterator find(const key_type& k) const {
-    auto it = list_.begin();
-    while (it != list_.end()) {
-      const value_type& v = *it;
-      if (v.first == k) return it;
-      ++it;
+    if (!index_) {
+      for (size_t i = 0; i < size_; i++) {
+        if (entries_[i].first == k) return &entries_[i];
+      }
+      return end();
+    }
+    size_t mask = index_size() - 1;
+    size_t h = key_hash(k) & mask;
+    while (uint32_t pos = index_[h]) {
+      if (entries_[pos - 1].first == k) return &entries_[pos - 1];
+      h = (h + 1) & mask;
     }
-    return it;
+    return end();
   }
 
-  iterator begin() { return list_.begin(); }
-  iterator end() { return list_.end(); }
-  const_iterator begin() const { return list_.begin(); }
-  const_iterator end() const { return list_.end(); }
+  size_t size() const { return size_; }
+  // Bytes of the entry block and the index, if any.
+  size_t heap_bytes() const {
+    if (capacity_ <= N) return 0;
+    return capacity_ * sizeof (value_type) + (index_ ? index_size() * sizeof (uint32_t) : 0);
+  }
+  iterator begin() { return entries_; }
+  iterator end() { return entries_ + size_; }
+  const_iterator begin() const { return entries_; }
+  const_iterator end() const { return entries_ + size_; }
 
  private:
-  list_type list_;
+  // The index has twice as many slots as there are entries, each holding
+  // the position of an entry plus one, or 0 when empty. Only grown blocks
+  // have an index, and their capacity is a power of two whatever N is, so
+  // the index size is one too.
+  size_t index_size() const { return capacity_ * 2; }
+
+  void grow() {
+    size_t capacity = 4;
+    while (capacity <= capacity_) capacity *= 2;
+    value_type* entries = reinterpret_cast<value_type*>(gc_malloc(capacity * sizeof (value_type)));
+    for (size_t i = 0; i < size_; i++) entries[i] = entries_[i];
+    entries_ = entries;
+    capacity_ = capacity;
+    if (capacity > kMaxLinear) {
+      index_ = reinterpret_cast<uint32_t*>(gc_malloc_atomic(index_size() * sizeof (uint32_t)));
+      rebuild_index();
+    }
+  }
+
+  void add_to_index(size_t pos) {
+    size_t mask = index_size() - 1;
+    size_t h = key_hash(entries_[pos].first) & mask;
+    while (index_[h]) h = (h + 1) & mask;
+    index_[h] = pos + 1;
+  }
+
+  void rebuild_index() {
+    memset(index_, 0, index_size() * sizeof (uint32_t));
+    for (size_t i = 0; i < size_; i++) add_to_index(i);
+  }
+
+  value_type* entries_;
+  uint32_t* index_;
+  uint32_t size_;
+  uint32_t capacity_;
 };
 
-#define HASH_SIZE 128
-  
+// A growable hash map iterated in insertion order. Entries are appended to
+// an array and located through a power-of-two Robin Hood index that stores
+// their hashes, so that probing rarely touches the entries themselves.
+// Erased entries leave a hole in the array until the next rehash. The index
+// holds no pointers and is allocated atomic, so the collector only scans
+// the entries. Neither is allocated until the first insertion.
 template <typename K, typename T>
 class hash_map {
  public:
   typedef K key_type;
   typedef T mapped_type;
   typedef pair<key_type, mapped_type> value_type;
-  typedef list<value_type> list_type;
 
   class node_type {
    public:
-    size_t hash;
+    uint32_t hash;
+    bool erased;
     value_type value;
   };
 
   class iterator {
    public:
-    iterator& operator ++ () {
-      node++;
-      if (node >= m->table[index] + m->table_len[index]) {
-        while (++index < HASH_SIZE) {
-          if (m->table[index]) {
-            node = m->table[index];
-            return *this;
-          }
-        }
-        node = nullptr;
-        return *this;
-      }
-      return *this;
-    }
+    iterator& operator ++ () { node = next_live(node + 1, last); return *this; }
     value_type& operator * () { return node->value; }
+    value_type* operator -> () { return &node->value; }
     bool operator == (const iterator& other) const { return node == other.node; }
     bool operator != (const iterator& other) const { return !((*this) == other); }
 
-    hash_map* m;
-    int index;
     node_type* node;
+    node_type* last;
   };
 
   class const_iterator {
    public:
-    const_iterator& operator ++ () {
-      node++;
-      if (node >= m->table[index] + m->table_len[index]) {
-        while (++index < HASH_SIZE) {
-          if (m->table[index]) {
-            node = m->table[index];
-            return *this;
-          }
-        }
-        node = nullptr;
-        return *this;
-      }
-      return *this;
-    }
+    const_iterator& operator ++ () { node = next_live(node + 1, last); return *this; }
     const value_type& operator * () const { return node->value; }
+    const value_type* operator -> () const { return &node->value; }
     bool operator == (const const_iterator& other) const { return node == other.node; }
     bool operator != (const const_iterator& other) const { return !((*this) == other); }
 
-    const hash_map *m;
-    int index;
     const node_type* node;
+    const node_type* last;
   };
 
+  static const uint32_t kMinIndexSize = 8;
+
  public:
   void init() {
-    memset(table, 0, sizeof table);
-    memset(table_len, 0, sizeof table_len);
+    index_ = nullptr;
+    nodes_ = nullptr;
+    index_size_ = 0;
+    num_nodes_ = 0;
+    size_ = 0;
   }
 
   mapped_type& operator [] (const key_type& k) {
-    iterator it = find(k);
-    if (it == end()) {
-      size_t hash = k.hash();
-      int i = hash & (HASH_SIZE - 1);
-      int& len = table_len[i];
-      node_type* n = gc_realloc_array_cast<node_type>(table[i], len + 1);
-      n[len].hash = hash;
-      n[len].value.first = k;
-      table[i] = n;
-      return n[len++].value.second;
-    }
-    return (*it).second;
+    uint32_t hash = key_hash(k);
+    uint32_t i = find_slot(hash, k);
+    if (i != kNotFound) return nodes_[index_[i].pos - 1].value.second;
+    if (num_nodes_ == capacity()) rehash();
+    node_type* n = &nodes_[num_nodes_++];
+    n->hash = hash;
+    n->erased = false;
+    n->value.first = k;
+    n->value.second = mapped_type();
+    insert_slot(hash, num_nodes_);
+    size_++;
+    return n->value.second;
   }
 
   iterator find(const key_type& k) {
-    size_t hash = k.hash();
-    int i = hash & (HASH_SIZE - 1);
-    node_type* node = table[i];
-    
-    while (node < table[i] + table_len[i]) {
-      if (node->hash == hash && k == node->value.first) {
-        return { this, i, node };
-      }
-      node++;
-    }
-    return end();
+    uint32_t i = find_slot(key_hash(k), k);
+    if (i == kNotFound) return end();
+    return { &nodes_[index_[i].pos - 1], nodes_ + num_nodes_ };
   }
 
   const_iterator find(const key_type& k) const {
-    size_t hash = k.hash();
-    int i = hash & (HASH_SIZE - 1);
-    const node_type* node = table[i];
-    
-    while (node < table[i] + table_len[i]) {
-      if (node->hash == hash && k == node->value.first) {
-        return { this, i, node };
-      }
-      node++;
-    }
-    return end();
+    uint32_t i = find_slot(key_hash(k), k);
+    if (i == kNotFound) return end();
+    return { &nodes_[index_[i].pos - 1], nodes_ + num_nodes_ };
   }
 
   void erase(iterator position) {
-    node_type* node = table[position.index];
-    size_t len = table_len[position.index];
-    node_type* end = node + len - 1;
-    node_type* pos = position.node;
-    while (pos < end) {
-      *pos = *(pos + 1);
-      pos++;
+    node_type* n = position.node;
+    uint32_t i = find_slot(n->hash, n->value.first);
+    assert(i != kNotFound);
+    // Backward-shift deletion: pull the following entries of the probe
+    // sequence one slot closer to home, so no tombstones are needed.
+    uint32_t mask = index_size_ - 1;
+    uint32_t j = (i + 1) & mask;
+    while (index_[j].pos && ((j - index_[j].hash) & mask) != 0) {
+      index_[i] = index_[j];
+      i = j;
+      j = (j + 1) & mask;
     }
-    table_len[position.index]--;
+    index_[i].pos = 0;
+    n->erased = true;
+    n->value = value_type();
+    size_--;
   }
 
-  iterator begin() {
-    for (int i = 0; i < HASH_SIZE; i++) {
-      if (table[i]) return { this, i, table[i] };
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  // Bytes of the index and the entry array.
+  size_t heap_bytes() const {
+    return index_size_ * sizeof (slot) + capacity() * sizeof (node_type);
+  }
+
+  iterator begin() { return { next_live(nodes_, nodes_ + num_nodes_), nodes_ + num_nodes_ }; }
+  iterator end() { return { nodes_ + num_nodes_, nodes_ + num_nodes_ }; }
+  const_iterator begin() const { return { next_live(nodes_, nodes_ + num_nodes_), nodes_ + num_nodes_ }; }
+  const_iterator end() const { return { nodes_ + num_nodes_, nodes_ + num_nodes_ }; }
+
+ private:
+  struct slot {
+    uint32_t hash;
+    // Position of the node plus one, or 0 when the slot is empty.
+    uint32_t pos;
+  };
+
+  static const uint32_t kNotFound = UINT32_MAX;
+
+  template <typename N>
+  static N* next_live(N* node, N* last) {
+    while (node < last && node->erased) node++;
+    return node;
+  }
+
+  // The index is kept at most 3/4 full.
+  uint32_t capacity() const { return index_size_ / 4 * 3; }
+
+  uint32_t find_slot(uint32_t hash, const key_type& k) const {
+    if (!index_) return kNotFound;
+    uint32_t mask = index_size_ - 1;
+    uint32_t i = hash & mask;
+    for (uint32_t dist = 0; ; dist++) {
+      const slot& s = index_[i];
+      // An entry closer to its home slot than we are to ours means the key
+      // would have displaced it, so it isn't in the map.
+      if (!s.pos || ((i - s.hash) & mask) < dist) return kNotFound;
+      if (s.hash == hash && nodes_[s.pos - 1].value.first == k) return i;
+      i = (i + 1) & mask;
     }
-    return end();
   }
-  iterator end() { return { this, HASH_SIZE, nullptr }; }
-  const_iterator begin() const {
-    for (int i = 0; i < HASH_SIZE; i++) {
-      if (table[i]) return { this, i, table[i] };
+
+  void insert_slot(uint32_t hash, uint32_t pos) {
+    uint32_t mask = index_size_ - 1;
+    uint32_t i = hash & mask;
+    slot cur = { hash, pos };
+    for (uint32_t dist = 0; ; dist++) {
+      slot& s = index_[i];
+      if (!s.pos) {
+        s = cur;
+        return;
+      }
+      uint32_t d = (i - s.hash) & mask;
+      if (d < dist) {
+        slot t = s;
+        s = cur;
+        cur = t;
+        dist = d;
+      }
+      i = (i + 1) & mask;
     }
-    return end();
   }
-  const_iterator end() const { return { this, HASH_SIZE, nullptr }; }
 
- private:
-  node_type* table[HASH_SIZE];
-  int table_len[HASH_SIZE];
+  // Moves the live entries to a new block, doubling the index unless
+  // enough entries were erased to make room.
+  void rehash() {
+    uint32_t index_size = index_size_ ? index_size_ : kMinIndexSize;
+    if (size_ >= capacity() / 2) index_size = index_size_ ? index_size_ * 2 : kMinIndexSize;
+    uint32_t n = index_size / 4 * 3;
+    slot* index = reinterpret_cast<slot*>(gc_malloc_atomic(index_size * sizeof (slot)));
+    node_type* nodes = reinterpret_cast<node_type*>(gc_malloc(n * sizeof (node_type)));
+    memset(index, 0, index_size * sizeof (slot));
+    node_type* old_nodes = nodes_;
+    uint32_t old_num_nodes = num_nodes_;
+    index_ = index;
+    nodes_ = nodes;
+    index_size_ = index_size;
+    num_nodes_ = 0;
+    for (uint32_t i = 0; i < old_num_nodes; i++) {
+      if (old_nodes[i].erased) continue;
+      nodes_[num_nodes_++] = old_nodes[i];
+      insert_slot(old_nodes[i].hash, num_nodes_);
+    }
+  }
+
+  slot* index_;
+  node_type* nodes_;
+  uint32_t index_size_;
+  // Nodes in use, including erased ones.
+  uint32_t num_nodes_;
+  uint32_t size_;
 };
 
 }  // namespace internal
@@ -17,32 +17,35 @@
 #include <nabla/data.hh>
 
 #include "ast.hh"
+#include "bytecode.hh"
 #include "evalast.hh"
+#include "evalbc.hh"
 #include "debug.hh"
 
 namespace nabla {
 namespace internal {
 
-static uint32_t array_index(const char16_t *s, size_t n) {
-  if (n == 0) return UINT32_MAX;
-  int ch = *s++;
+static uint32_t array_index(u16string s) {
+  // 15.4 Array Objects
+  // UINT32_MAX isn't an array index.
+  size_t n = s.length();
+  if (n == 0 || n > 10) return UINT32_MAX;
+  int ch = s[0];
   if (ch == '0') return n == 1 ? 0 : UINT32_MAX;
   if (ch < '1' || ch > '9') return UINT32_MAX;
-  int index = (ch - '0');
-  while (--n) {
-    ch = *s++;
+  uint64_t index = (ch - '0');
+  for (size_t i = 1; i < n; i++) {
+    ch = s[i];
     if (ch < '0' || ch > '9') return UINT32_MAX;
     index = index * 10 + (ch - '0');
   }
-  return index;
+  if (index >= UINT32_MAX) return UINT32_MAX;
+  return static_cast<uint32_t>(index);
 }
 
 static u16string uint32_to_u16string(uint32_t n) {
   char16_t buf[32];
-  if (n < 10) {
-    buf[0] = '0' + n;
-    return u16string(buf, 1);
-  }
+  if (n < 10) return char_string('0' + n);
   char16_t* p = &buf[32];
   do {
     uint32_t r = n % 10;
@@ -52,44 +55,236 @@ static u16string uint32_to_u16string(uint32_t n) {
   return u16string(p, &buf[32] - p);
 }
 
+static Shape* empty_shape = nullptr;
+
+heap_layout Shape::layout_;
+
+void Shape::InitLayout() {
+  alignas(Shape) char buf[sizeof (Shape)];
+  const Shape* s = reinterpret_cast<const Shape*>(buf);
+  layout_.init(sizeof (Shape));
+  layout_.add(s, &s->keys_);
+  layout_.add(s, &s->transitions_);
+  layout_.add(s, &s->table_);
+  layout_.commit();
+}
+
+Shape* Shape::Alloc(bool dictionary, uint32_t capacity) {
+  Shape* shape = reinterpret_cast<Shape*>(alloc_heap_data(kTagShape, layout_));
+  if (!shape) return nullptr;
+  shape->tag_ = kTagShape;
+  shape->dictionary_ = dictionary;
+  shape->size_ = 0;
+  shape->capacity_ = capacity;
+  shape->num_removed_ = 0;
+  shape->has_index_keys_ = false;
+  shape->keys_ = capacity > 0 ? gc_realloc_array_cast<u16string>(nullptr, capacity) : nullptr;
+  shape->transitions_.init();
+  shape->table_ = nullptr;
+  if (dictionary) {
+    shape->table_ = gc_malloc_cast<hash_map<u16string, int> >();
+    shape->table_->init();
+  }
+  return shape;
+}
+
+Shape* Shape::Empty() {
+  if (!empty_shape) empty_shape = Alloc(false, 0);
+  return empty_shape;
+}
+
+Shape* Shape::AllocDictionary(const Shape* shape) {
+  Shape* dict = Alloc(true, shape->size_ - shape->num_removed_ + 1);
+  for (uint32_t i = 0; i < shape->size_; i++) {
+    if (!shape->keys_[i]) continue;
+    dict->AddKey(shape->keys_[i]);
+  }
+  return dict;
+}
+
+int Shape::Lookup(u16string n) const {
+  // Keys are atoms, so a name without an atom can't be one of them.
+  if (!n.is_atom()) {
+    n = find_atom(n);
+    if (!n) return -1;
+  }
+  if (dictionary_) {
+    auto it = table_->find(n);
+    if (it == table_->end()) return -1;
+    return (*it).second;
+  }
+  for (uint32_t i = 0; i < size_; i++) {
+    if (keys_[i].get__() == n.get__()) return i;
+  }
+  return -1;
+}
+
+Shape* Shape::AddTransition(u16string n) {
+  assert(!dictionary_);
+  n = intern(n);
+  if (!n) return nullptr;
+  auto it = transitions_.find(n);
+  if (it != transitions_.end()) return (*it).second;
+  Shape* shape = Alloc(false, size_ + 1);
+  if (!shape) return nullptr;
+  for (uint32_t i = 0; i < size_; i++) {
+    shape->keys_[i] = keys_[i];
+  }
+  shape->keys_[size_] = n;
+  shape->size_ = size_ + 1;
+  shape->has_index_keys_ = has_index_keys_ || array_index(n) != UINT32_MAX;
+  transitions_[n] = shape;
+  return shape;
+}
+
+uint32_t Shape::AddKey(u16string n) {
+  assert(dictionary_);
+  n = intern(n);
+  if (size_ >= capacity_) {
+    capacity_ = capacity_ * 2 + 4;
+    keys_ = gc_realloc_array_cast<u16string>(keys_, capacity_);
+  }
+  keys_[size_] = n;
+  (*table_)[n] = size_;
+  if (array_index(n) != UINT32_MAX) has_index_keys_ = true;
+  return size_++;
+}
+
+void Shape::RemoveKey(uint32_t i) {
+  assert(dictionary_);
+  table_->erase(table_->find(keys_[i]));
+  keys_[i] = nullptr;
+  num_removed_++;
+}
+
+static_assert(sizeof (Object) <= kMaxCachedSize && sizeof (Function) <= kMaxCachedSize,
+              "objects should come from the size-class caches");
+
+heap_layout Object::layout_;
+
+void Object::InitLayout() {
+  alignas(Object) char buf[sizeof (Object)];
+  const Object* o = reinterpret_cast<const Object*>(buf);
+  layout_.init(sizeof (Object));
+  layout_.add(o, &o->host_data);
+  layout_.add(o, &o->proto_);
+  layout_.add(o, &o->shape_);
+  layout_.add(o, &o->slots_);
+  layout_.commit();
+}
+
 Object* Object::Alloc(Object* proto) {
   // 13.2.2 [[Construct]]
-  Object* o = reinterpret_cast<Object*>(GC_MALLOC(sizeof (Object)));
+  Object* o = reinterpret_cast<Object*>(alloc_heap_data(kTagObject, layout_));
   if (!o) return nullptr;
   o->tag_ = kTagObject;
-  o->own_props_.init();
   o->proto_ = proto;
+  o->shape_ = Shape::Empty();
+  o->slots_ = nullptr;
+  o->slots_capacity_ = 0;
   o->flags = kExtensible;
   return o;
 }
 
+Property* Object::NewOwnProperty(u16string n) {
+  Property* desc = GetOwnProperty(n);
+  if (desc) return desc;
+  if (dense_array() && array_index(n) != UINT32_MAX) {
+    // Elements with attributes are kept in properties, which already
+    // include n if it was an element.
+    MakeSparseElements();
+    desc = GetOwnProperty(n);
+    if (desc) return desc;
+  }
+  if (!shape_->is_dictionary() && shape_->size() >= Shape::kMaxSharedProperties) {
+    MakeDictionary();
+  }
+  uint32_t i;
+  if (shape_->is_dictionary()) {
+    i = shape_->AddKey(n);
+  } else {
+    shape_ = shape_->AddTransition(n);
+    i = shape_->size() - 1;
+  }
+  if (i >= slots_capacity_) {
+    slots_capacity_ = slots_capacity_ < 4 ? 4 : slots_capacity_ * 2;
+    slots_ = gc_realloc_array_cast<Property>(slots_, slots_capacity_);
+  }
+  desc = &slots_[i];
+  desc->value_or_get = nullptr;
+  desc->set = nullptr;
+  desc->flags = Property::kNone;
+  return desc;
+}
+
+void Object::MakeDictionary() {
+  // Moves the slots to the indices they have in the new dictionary,
+  // which drops the removed ones.
+  Shape* shape = Shape::AllocDictionary(shape_);
+  uint32_t j = 0;
+  for (uint32_t i = 0; i < shape_->size(); i++) {
+    if (!shape_->key(i)) continue;
+    slots_[j++] = slots_[i];
+  }
+  shape_ = shape;
+}
+
 Property* Object::GetProperty(u16string n) {
   // 8.12.2 [[GetProperty]] (P)
   Object* o = this;
   do {
-    auto it = o->own_props_.find(n);
-    if (it != o->own_props_.end()) return &(*it).second;
+    Property* desc = o->GetOwnProperty(n);
+    if (desc) return desc;
     o = o->proto_;
   } while (o);
   return nullptr;
 }
 
+bool Object::HasOwnProperty(u16string n) {
+  Array* arr = dense_array();
+  if (arr) {
+    uint32_t index = array_index(n);
+    if (index != UINT32_MAX) return index < arr->capacity && !!arr->elements[index];
+  }
+  return !!GetOwnProperty(n);
+}
+
+bool Object::HasProperty(uint32_t n) {
+  // 8.12.6 [[HasProperty]] (P)
+  Object* o = this;
+  do {
+    Array* arr = o->dense_array();
+    if (arr) {
+      if (n < arr->capacity && !!arr->elements[n]) return true;
+    } else if (o->shape_->has_index_keys()) {
+      if (o->GetOwnProperty(uint32_to_u16string(n))) return true;
+    }
+    o = o->proto_;
+  } while (o);
+  return false;
+}
+
 any_ref Object::Get(u16string n) {
+  Array* arr = dense_array();
+  if (arr) {
+    uint32_t index = array_index(n);
+    if (index != UINT32_MAX) return Get(index);
+  }
   if (!!host_data && host_data.is_u16string()) {
     // 15.5.5.2 [[GetOwnProperty]] ( P )
     u16string s = host_data.as_u16string();
-    uint32_t index = array_index(n.data(), n.length());
+    uint32_t index = array_index(n);
     if (index != UINT32_MAX) {
       if (index < s.length()) {
-        return u16string(s.data() + index, 1);
+        return char_string(s[index]);
       } else {
-        return undefined_data::alloc();
+        return any_ref::undefined();
       }
     }
   }
 
   Property* desc = GetProperty(n);
-  if (!desc) return undefined_data::alloc();
+  if (!desc) return any_ref::undefined();
   return Get(desc);
 }
 
@@ -101,20 +296,33 @@ any_ref Object::Get(const Property* desc) {
   }
   // IsAccessorDescriptor(desc) is true
   if (!desc->value_or_get)
-    return undefined_data::alloc();
+    return any_ref::undefined();
   Object* func = desc->value_or_get.as<Object>();
   any_ref this_val = this;
   return func->Call(1, &this_val);
 }
 
 any_ref Object::Get(uint32_t n) {
-  u16string s = uint32_to_u16string(n);
-  return Get(s);
-}
-
-Property* Object::GetProperty(uint32_t n) {
-  u16string s = uint32_to_u16string(n);
-  return GetProperty(s);
+  // The name of n is only made for objects whose shape may have it.
+  Object* o = this;
+  do {
+    Array* arr = o->dense_array();
+    if (arr) {
+      if (n < arr->capacity && !!arr->elements[n]) return arr->elements[n];
+    } else {
+      if (!!o->host_data && o->host_data.is_u16string()) {
+        // 15.5.5.2 [[GetOwnProperty]] ( P )
+        u16string s = o->host_data.as_u16string();
+        if (n < s.length()) return char_string(s[n]);
+      }
+      if (o->shape_->has_index_keys()) {
+        Property* desc = o->GetOwnProperty(uint32_to_u16string(n));
+        if (desc) return Get(desc);
+      }
+    }
+    o = o->proto_;
+  } while (o);
+  return any_ref::undefined();
 }
 
 bool Object::DefineOwnArrayProperty(Context* c, u16string n, any_ref v, bool do_throw, Property* own_desc) {
@@ -127,31 +335,99 @@ bool Object::DefineOwnArrayProperty(Context* c, u16string n, any_ref v, bool do_
     if (static_cast<double>(newlen) != d) return ThrowTypeError(c);
     uint32_t oldlen = arr->length;
     if (newlen < oldlen) {
-      for (uint32_t i = oldlen; i < newlen; i++) {
-        u16string s = uint32_to_u16string(i);
-        Property* idx_desc = GetOwnProperty(s);
-        idx_desc->value_or_get = undefined_data::alloc();
-        idx_desc->flags = Property::kWritable | Property::kEnumerable | Property::kConfigurable;
+      if (!arr->sparse) {
+        for (uint32_t i = newlen; i < oldlen && i < arr->capacity; i++) {
+          arr->elements[i] = nullptr;
+        }
+      } else {
+        any_vector names;
+        names.init();
+        for (uint32_t i = 0; i < num_own_slots(); i++) {
+          u16string s = OwnSlotName(i);
+          if (!s) continue;
+          uint32_t index = array_index(s);
+          if (index != UINT32_MAX && index >= newlen) names.push_back(s);
+        }
+        for (auto it = names.begin(); it != names.end(); ++it) {
+          Delete(c, (*it).as_u16string(), false);
+        }
       }
     }
-    arr->length = newlen;
-    v = static_cast<double>(newlen);
-    own_desc->value_or_get = v;
+    SetArrayLength(arr, newlen);
     return true;
   } else {
-    uint32_t index = array_index(n.data(), n.length());
-    if (index != UINT32_MAX) {
-      if (index >= arr->length) {
-        arr->length = index + 1;
-        Property* len_desc = GetOwnProperty("length");
-        len_desc->value_or_get = (double)(index + 1);
-      }
+    uint32_t index = array_index(n);
+    if (index != UINT32_MAX && index >= arr->length) {
+      SetArrayLength(arr, index + 1);
     }
     own_desc->value_or_get = v;
     return true;
   }
 }
 
+void Object::SetArrayLength(Array* arr, uint32_t len) {
+  arr->length = len;
+  // length is the first property of arrays and can't be deleted.
+  Property* desc = OwnSlot(0);
+  if (len <= INT32_MAX) {
+    desc->value_or_get = static_cast<int>(len);
+  } else {
+    desc->value_or_get = static_cast<double>(len);
+  }
+}
+
+// Arrays grow their elements up to twice or to this many without
+// becoming sparse.
+static const uint32_t kMinSparseIndex = 1024;
+
+// Makes room for the element n, or makes the array sparse and returns
+// false when that would leave too many holes.
+bool Object::ReserveElements(Array* arr, uint32_t n) {
+  if (n < arr->capacity) return true;
+  if (n >= kMinSparseIndex && n / 2 >= arr->capacity) {
+    MakeSparseElements();
+    return false;
+  }
+  uint32_t capacity = arr->capacity < 4 ? 4 : arr->capacity * 2;
+  if (capacity <= n) capacity = n + 1;
+  arr->elements = gc_realloc_array_cast<any_ref>(arr->elements, capacity);
+  for (uint32_t i = arr->capacity; i < capacity; i++) {
+    arr->elements[i] = nullptr;
+  }
+  arr->capacity = capacity;
+  return true;
+}
+
+void Object::MakeSparseElements() {
+  Array* arr = host_data.as<Array>();
+  any_ref* elements = arr->elements;
+  uint32_t capacity = arr->capacity;
+  arr->sparse = true;
+  arr->elements = nullptr;
+  arr->capacity = 0;
+  for (uint32_t i = 0; i < capacity; i++) {
+    if (!elements[i]) continue;
+    DefineOwnDataPropertyNoCheck(uint32_to_u16string(i), elements[i], Property::kWritable | Property::kEnumerable | Property::kConfigurable);
+  }
+}
+
+void Object::GetOwnEnumerableNames(any_vector& names) {
+  // Dense elements are listed right after length, the first slot of
+  // arrays, as they were when every element was a property.
+  Array* arr = dense_array();
+  for (uint32_t i = 0; i < num_own_slots(); i++) {
+    u16string n = OwnSlotName(i);
+    if (!!n && (OwnSlot(i)->flags & Property::kEnumerable)) {
+      names.push_back(n);
+    }
+    if (i == 0 && arr) {
+      for (uint32_t j = 0; j < arr->capacity; j++) {
+        if (!!arr->elements[j]) names.push_back(uint32_to_u16string(j));
+      }
+    }
+  }
+}
+
 void Object::DefineOwnDataPropertyNoCheck(u16string n, any_ref v, int flags) {
   Property* desc = NewOwnProperty(n);
   desc->value_or_get = v;
@@ -161,6 +437,10 @@ void Object::DefineOwnDataPropertyNoCheck(u16string n, any_ref v, int flags) {
 bool Object::Put(Context* c, u16string n, any_ref v, bool do_throw) {
   // 8.12.4 [[CanPut]] (P)
   // 8.12.5 [[Put]] ( P, V, Throw )
+  if (dense_array()) {
+    uint32_t index = array_index(n);
+    if (index != UINT32_MAX) return Put(c, index, v, do_throw);
+  }
   Property* own_desc = GetOwnProperty(n);
   if (own_desc) {
     if (own_desc->flags & Property::kWritable) {
@@ -224,17 +504,62 @@ bool Object::Put(Context* c, u16string n, any_ref v, bool do_throw) {
 }
 
 bool Object::Put(Context* c, uint32_t n, any_ref v, bool do_throw) {
+  Array* arr = dense_array();
+  if (arr) {
+    if (!(flags & kExtensible) && !(n < arr->capacity && !!arr->elements[n])) {
+      // [[CanPut]] returns false
+      return !(do_throw && !ThrowTypeError(c));
+    }
+    if (ReserveElements(arr, n)) {
+      // 15.4.5.1 [[DefineOwnProperty]] ( P, Desc, Throw )
+      // Elements are writable, so the prototype chain isn't consulted.
+      arr->elements[n] = v;
+      if (n >= arr->length) SetArrayLength(arr, n + 1);
+      return true;
+    }
+  }
   u16string s = uint32_to_u16string(n);
   return Put(c, s, v, do_throw);
 }
 
+bool Object::Delete(Context* c, u16string n, bool do_throw) {
+  // 8.12.7 [[Delete]] (P, Throw)
+  if (dense_array()) {
+    uint32_t index = array_index(n);
+    if (index != UINT32_MAX) return Delete(c, index, do_throw);
+  }
+  int i = shape_->Lookup(n);
+  if (i < 0) return true;
+  if (!(slots_[i].flags & Property::kConfigurable)) {
+    if (do_throw) return ThrowTypeError(c);
+    return true;
+  }
+  if (!shape_->is_dictionary()) {
+    MakeDictionary();
+  }
+  shape_->RemoveKey(i);
+  slots_[i].value_or_get = nullptr;
+  slots_[i].set = nullptr;
+  if (shape_->num_removed() > shape_->size() / 2) {
+    MakeDictionary();
+  }
+  return true;
+}
+
 bool Object::Delete(Context* c, uint32_t n, bool do_throw) {
+  Array* arr = dense_array();
+  if (arr) {
+    if (n < arr->capacity) arr->elements[n] = nullptr;
+    return true;
+  }
   u16string s = uint32_to_u16string(n);
   return Delete(c, s, do_throw);
 }
 
 Thread* Thread::current_thread_ = nullptr;
 
+Context::EvaluatorType Context::evaluator_type_ = Context::kEvaluatorBytecode;
+
 Thread::Thread() {
   if (!current_thread_) current_thread_ = this;
 }
@@ -340,6 +665,9 @@ any_ref Object::Call(size_t argc, const any_ref* argv) {
         this_val = this_obj;
       }
     }
+    if (fn->block) {
+      return BytecodeEvaluator::CallFunction(fn, this_val, argc - 1, argv + 1);
+    }
     return AstEvaluator::CallFunction(fn->context, fn->script, fn->scope, fn->code, fn->strict, this_val, argc - 1, argv + 1);
   }
 }
@@ -355,30 +683,69 @@ any_ref Object::Construct(size_t argc, const any_ref* argv) {
     // 13.2.2 [[Construct]]
     any_ref proto_val = Get("prototype");
     Object* this_obj = Object::Alloc(proto_val.as<Object>());
-    any_ref rval = AstEvaluator::CallFunction(fn->context, fn->script, fn->scope, fn->code, fn->strict, this_obj, argc - 1, argv + 1);
+    any_ref rval;
+    if (fn->block) {
+      rval = BytecodeEvaluator::CallFunction(fn, this_obj, argc - 1, argv + 1);
+    } else {
+      rval = AstEvaluator::CallFunction(fn->context, fn->script, fn->scope, fn->code, fn->strict, this_obj, argc - 1, argv + 1);
+    }
+    if (!rval) return nullptr;
     if (rval.is<Object>()) return rval;
     return this_obj;
   }
 }
 
+heap_layout Function::layout_;
+
+void Function::InitLayout() {
+  alignas(Function) char buf[sizeof (Function)];
+  const Function* fn = reinterpret_cast<const Function*>(buf);
+  layout_.init(sizeof (Function));
+  layout_.add(fn, &fn->script);
+  layout_.add(fn, &fn->context);
+  layout_.add(fn, &fn->scope);
+  layout_.commit();
+}
+
 Function* Function::Alloc() {
-  Function* fn = reinterpret_cast<Function*>(GC_MALLOC(sizeof (Function)));
+  Function* fn = reinterpret_cast<Function*>(alloc_heap_data(Function::class_tag, layout_));
   fn->tag_ = Function::class_tag;
   return fn;
 }
 
+heap_layout Array::layout_;
+
+void Array::InitLayout() {
+  alignas(Array) char buf[sizeof (Array)];
+  const Array* arr = reinterpret_cast<const Array*>(buf);
+  layout_.init(sizeof (Array));
+  layout_.add(arr, &arr->elements);
+  layout_.commit();
+}
+
 Array* Array::Alloc() {
-  Array* fn = reinterpret_cast<Array*>(GC_MALLOC(sizeof (Array)));
+  Array* fn = reinterpret_cast<Array*>(alloc_heap_data(Array::class_tag, layout_));
   fn->tag_ = Array::class_tag;
+  fn->length = 0;
+  fn->elements = nullptr;
+  fn->capacity = 0;
+  fn->sparse = false;
   return fn;
 }
 
 Date* Date::Alloc() {
-  Date* fn = reinterpret_cast<Date*>(GC_MALLOC(sizeof (Date)));
+  Date* fn = reinterpret_cast<Date*>(alloc_heap_data_atomic(Date::class_tag, sizeof (Date)));
   fn->tag_ = Date::class_tag;
   return fn;
 }
 
+void InitLayouts() {
+  Shape::InitLayout();
+  Object::InitLayout();
+  Function::InitLayout();
+  Array::InitLayout();
+}
+
 any_ref ToPrimitive(Context* c, any_ref v, Object::PreferredType hint) {
   // 9.1 ToPrimitive
   if (!v.is<Object>()) return v;
@@ -393,9 +760,9 @@ bool ToBoolean(any_ref v) {
   } else if (v.is_undefined() || v.is_null()) {
     return false;
   } else if (v.is_bool()) {
-    return v.as<bool_data>()->data();
+    return v.as_bool();
   } else if (v.is_double()) {
-    double num = v.as<double_data>()->data();
+    double num = v.as_double();
     return !(num == 0. || std::isnan(num));
   } else if (v.is_u16string()) {
     return v.as<u16string_data>()->length() != 0;
@@ -471,7 +838,7 @@ u16string ToString(Context* c, any_ref v) {
   } else if (v.is_null()) {
     return "null";
   } else if (v.is_bool()) {
-    return v.as<bool_data>()->data() ? "true" : "false";
+    return v.as_bool() ? "true" : "false";
   } else if (v.is_double()) {
     double dval = v.as_double();
     if (std::isnan(dval)) {
@@ -543,19 +910,19 @@ bool IsStrictSameValue(any_ref lval, any_ref rval) {
       return lval.smi() == rval.smi();
     } else if (rval.is_double()) {
       double lnum = lval.smi();
-      double rnum = rval.as<double_data>()->data();
+      double rnum = rval.as_double();
       return lnum == rnum;
     } else {
       return false;
     }
   } else if (lval.is_double()) {
     if (rval.is_smi()) {
-      double lnum = lval.as<double_data>()->data();
+      double lnum = lval.as_double();
       double rnum = rval.smi();
       return lnum == rnum;
     } else if (rval.is_double()) {
-      double lnum = lval.as<double_data>()->data();
-      double rnum = rval.as<double_data>()->data();
+      double lnum = lval.as_double();
+      double rnum = rval.as_double();
       return lnum == rnum;
     } else {
       return false;
@@ -574,8 +941,8 @@ bool IsStrictSameValue(any_ref lval, any_ref rval) {
     }
   } else if (lval.is_bool()) {
     if (rval.is_bool()) {
-      bool l = lval.as<bool_data>()->data();
-      bool r = lval.as<bool_data>()->data();
+      bool l = lval.as_bool();
+      bool r = rval.as_bool();
       return l == r;
     } else {
       return false;
@@ -662,33 +1029,576 @@ bool IsCallable(Object* o) {
   return !!o->host_data && o->host_data.is<Function>();
 }
 
+// Operators
+
+// 9.5 ToInt32
+static int32_t DoubleToInt32(double d) {
+  if (std::isnan(d) || std::isinf(d)) return 0;
+  double m = std::fmod(std::trunc(d), 4294967296.0);
+  if (m < 0) m += 4294967296.0;
+  return static_cast<int32_t>(static_cast<uint32_t>(m));
+}
+
+any_ref ApplyUnaryOperator(Context* c, SyntaxNode::UnaryOperator op, any_ref val) {
+  switch (op) {
+    case SyntaxNode::kUnaryVoid:
+      val = any_ref::undefined();
+      break;
+    case SyntaxNode::kUnaryPositive: {
+      double d;
+      if (!ToNumber(c, val, d)) return nullptr;
+      val = d;
+      break;
+    }
+    case SyntaxNode::kUnaryNegative: {
+      double d;
+      if (!ToNumber(c, val, d)) return nullptr;
+      val = -d;
+      break;
+    }
+    case SyntaxNode::kUnaryBitwiseNot: {
+      double d;
+      if (!ToNumber(c, val, d)) return nullptr;
+      val = ~DoubleToInt32(d);
+      break;
+    }
+    case SyntaxNode::kUnaryLogicalNot:
+      val = !ToBoolean(val);
+      break;
+    default:
+      assert(false);
+  }
+  return val;
+}
+
+static any_ref ApplyShiftOperator(SyntaxNode::BinaryOperator optype, int32_t l, int32_t r) {
+  int shift = r & 31;
+  switch (optype) {
+    case SyntaxNode::kBinaryLeftShift:
+      return static_cast<int32_t>(static_cast<uint32_t>(l) << shift);
+    case SyntaxNode::kBinarySignedRightShift:
+      return l >> shift;
+    case SyntaxNode::kBinaryUnsignedRightShift: {
+      uint32_t u = static_cast<uint32_t>(l) >> shift;
+      if (u > static_cast<uint32_t>(std::numeric_limits<int32_t>::max())) {
+        return static_cast<double>(u);
+      }
+      return static_cast<int32_t>(u);
+    }
+    default:
+      assert(false);
+      return 0;
+  }
+}
+
+// Falls back to double arithmetic when the int32 result would overflow or
+// would be -0, so the SMI path always agrees with the double path.
+inline static any_ref ApplyBinaryOperator(SyntaxNode::BinaryOperator optype, int l, int r) {
+  any_ref val;
+  int res;
+  switch (optype) {
+    case SyntaxNode::kBinaryAddition:
+      if (SmiAdd(l, r, res)) {
+        val = res;
+      } else {
+        val = static_cast<double>(l) + r;
+      }
+      break;
+    case SyntaxNode::kBinarySubtraction:
+      if (SmiSubtract(l, r, res)) {
+        val = res;
+      } else {
+        val = static_cast<double>(l) - r;
+      }
+      break;
+    case SyntaxNode::kBinaryMultiplication:
+      if (SmiMultiply(l, r, res)) {
+        val = res;
+      } else {
+        val = static_cast<double>(l) * r;
+      }
+      break;
+    case SyntaxNode::kBinaryRemainder:
+      if (r == 0) {
+        val = std::numeric_limits<double>::quiet_NaN();
+      } else if (l < 0 && (r == -1 || l % r == 0)) {
+        val = -0.0;
+      } else if (r == -1) {
+        val = 0;
+      } else {
+        val = l % r;
+      }
+      break;
+    case SyntaxNode::kBinaryDivision:
+      // INT_MIN / -1 overflows, so it is ruled out before l % r is taken.
+      if (r != 0 && !(l == std::numeric_limits<int>::min() && r == -1) &&
+          !(l == 0 && r < 0) && l % r == 0) {
+        val = l / r;
+      } else {
+        val = static_cast<double>(l) / r;
+      }
+      break;
+    case SyntaxNode::kBinaryLeftShift:
+    case SyntaxNode::kBinarySignedRightShift:
+    case SyntaxNode::kBinaryUnsignedRightShift:
+      val = ApplyShiftOperator(optype, l, r);
+      break;
+    case SyntaxNode::kBinaryLessThan:
+      val = l < r;
+      break;
+    case SyntaxNode::kBinaryGreaterThan:
+      val = l > r;
+      break;
+    case SyntaxNode::kBinaryLessThanOrEqual:
+      val = l <= r;
+      break;
+    case SyntaxNode::kBinaryGreaterThanOrEqual:
+      val = l >= r;
+      break;
+    case SyntaxNode::kBinaryEquals:
+    case SyntaxNode::kBinaryStrictEquals:
+      val = l == r;
+      break;
+    case SyntaxNode::kBinaryDoesNotEqual:
+    case SyntaxNode::kBinaryStrictDoesNotEqual:
+      val = l != r;
+      break;
+    case SyntaxNode::kBinaryBitwiseAnd:
+      val = l & r;
+      break;
+    case SyntaxNode::kBinaryBitwiseXor:
+      val = l ^ r;
+      break;
+    case SyntaxNode::kBinaryBitwiseOr:
+      val = l | r;
+      break;
+    default:
+      assert(false);
+      val = 0;
+      break;
+  }
+  return val;
+}
+
+inline static any_ref ApplyBinaryOperator(SyntaxNode::BinaryOperator optype, double l, double r) {
+  any_ref val;
+  switch (optype) {
+    case SyntaxNode::kBinaryAddition:
+      val = l + r;
+      break;
+    case SyntaxNode::kBinarySubtraction:
+      val = l - r;
+      break;
+    case SyntaxNode::kBinaryMultiplication:
+      val = l * r;
+      break;
+    case SyntaxNode::kBinaryDivision:
+      val = l / r;
+      break;
+    case SyntaxNode::kBinaryRemainder:
+      val = std::fmod(l, r);
+      break;
+    case SyntaxNode::kBinaryLeftShift:
+    case SyntaxNode::kBinarySignedRightShift:
+    case SyntaxNode::kBinaryUnsignedRightShift:
+      val = ApplyShiftOperator(optype, DoubleToInt32(l), DoubleToInt32(r));
+      break;
+    case SyntaxNode::kBinaryLessThan:
+      val = l < r;
+      break;
+    case SyntaxNode::kBinaryGreaterThan:
+      val = l > r;
+      break;
+    case SyntaxNode::kBinaryLessThanOrEqual:
+      val = l <= r;
+      break;
+    case SyntaxNode::kBinaryGreaterThanOrEqual:
+      val = l >= r;
+      break;
+    case SyntaxNode::kBinaryEquals:
+    case SyntaxNode::kBinaryStrictEquals:
+      val = l == r;
+      break;
+    case SyntaxNode::kBinaryDoesNotEqual:
+    case SyntaxNode::kBinaryStrictDoesNotEqual:
+      val = l != r;
+      break;
+    case SyntaxNode::kBinaryBitwiseAnd:
+      val = DoubleToInt32(l) & DoubleToInt32(r);
+      break;
+    case SyntaxNode::kBinaryBitwiseXor:
+      val = DoubleToInt32(l) ^ DoubleToInt32(r);
+      break;
+    case SyntaxNode::kBinaryBitwiseOr:
+      val = DoubleToInt32(l) | DoubleToInt32(r);
+      break;
+    case SyntaxNode::kBinaryInstanceOf:
+    case SyntaxNode::kBinaryIn:
+    default:
+      assert(false);
+      val = 0;
+      break;
+  }
+  return val;
+}
+
+any_ref ApplyBinaryOperator(Context* c, SyntaxNode::BinaryOperator op, any_ref lval, any_ref rval) {
+  if (op == SyntaxNode::kBinaryStrictEquals) {
+    return IsStrictSameValue(lval, rval);
+  } else if (op == SyntaxNode::kBinaryStrictDoesNotEqual) {
+    return !IsStrictSameValue(lval, rval);
+  } else if (op == SyntaxNode::kBinaryEquals) {
+    bool bval;
+    if (!IsAbstractSameValue(c, lval, rval, bval)) return nullptr;
+    return bval;
+  } else if (op == SyntaxNode::kBinaryDoesNotEqual) {
+    bool bval;
+    if (!IsAbstractSameValue(c, lval, rval, bval)) return nullptr;
+    return !bval;
+  } else if (op == SyntaxNode::kBinaryInstanceOf) {
+    Object* lobj = ToObject(c, lval);
+    Object* robj = ToObject(c, rval);
+    any_ref robj_proto_val = robj->Get("prototype");
+    Object* robj_proto = robj_proto_val.as<Object>();
+    Object* proto = lobj->proto();
+    while (proto) {
+      if (proto == robj_proto) {
+        return true;
+      }
+      proto = proto->proto();
+    }
+    return false;
+  } else if (op == SyntaxNode::kBinaryIn) {
+    u16string n = ToString(c, lval);
+    Object* o = ToObject(c, rval);
+    bool bval = o->HasOwnProperty(n);
+    return bval;
+  } else {
+    any_ref val;
+    lval = ToPrimitive(c, lval);
+    if (!lval) return nullptr;
+    rval = ToPrimitive(c, rval);
+    if (!rval) return nullptr;
+
+    if (op == SyntaxNode::kBinaryAddition) {
+      if (lval.is_u16string() || rval.is_u16string()) {
+        u16string lstr = ToString(c, lval);
+        if (!lstr) return nullptr;
+        u16string rstr = ToString(c, rval);
+        if (!rstr) return nullptr;
+        return lstr + rstr;
+      }
+    }
+
+    if (lval.is_smi() && rval.is_smi()) {
+      val = ApplyBinaryOperator(op, lval.smi(), rval.smi());
+    } else if (lval.is_double() && rval.is_double()) {
+      double lnum = lval.as_double();
+      double rnum = rval.as_double();
+      val = ApplyBinaryOperator(op, lnum, rnum);
+    } else {
+      double lnum, rnum;
+      if (!ToNumber(c, lval, lnum) || !ToNumber(c, rval, rnum)) return nullptr;
+      val = ApplyBinaryOperator(op, lnum, rnum);
+    }
+    return val;
+  }
+}
+
+any_ref ApplyAssignmentOperator(Context* c, SyntaxNode::AssignmentOperator op, any_ref lval, any_ref rval) {
+  SyntaxNode::BinaryOperator bin_op;
+  switch (op) {
+    case SyntaxNode::kAssignmentMultiplication:
+      bin_op = SyntaxNode::kBinaryMultiplication;
+      break;
+    case SyntaxNode::kAssignmentDivision:
+      bin_op = SyntaxNode::kBinaryDivision;
+      break;
+    case SyntaxNode::kAssignmentRemainder:
+      bin_op = SyntaxNode::kBinaryRemainder;
+      break;
+    case SyntaxNode::kAssignmentAddition:
+      bin_op = SyntaxNode::kBinaryAddition;
+      break;
+    case SyntaxNode::kAssignmentSubtraction:
+      bin_op = SyntaxNode::kBinarySubtraction;
+      break;
+    case SyntaxNode::kAssignmentLeftShift:
+      bin_op = SyntaxNode::kBinaryLeftShift;
+      break;
+    case SyntaxNode::kAssignmentSignedRightShift:
+      bin_op = SyntaxNode::kBinarySignedRightShift;
+      break;
+    case SyntaxNode::kAssignmentUnsignedRightShift:
+      bin_op = SyntaxNode::kBinaryUnsignedRightShift;
+      break;
+    case SyntaxNode::kAssignmentBitwiseAnd:
+      bin_op = SyntaxNode::kBinaryBitwiseAnd;
+      break;
+    case SyntaxNode::kAssignmentBitwiseXor:
+      bin_op = SyntaxNode::kBinaryBitwiseXor;
+      break;
+    case SyntaxNode::kAssignmentBitwiseOr:
+      bin_op = SyntaxNode::kBinaryBitwiseOr;
+      break;
+    case SyntaxNode::kAssignmentNone:
+    default:
+      assert(false);
+      return nullptr;
+  }
+  any_ref val;
+
+  if (bin_op == SyntaxNode::kBinaryAddition) {
+    if (lval.is_u16string() || rval.is_u16string()) {
+      u16string lstr = ToString(c, lval);
+      if (!lstr) return nullptr;
+      u16string rstr = ToString(c, rval);
+      if (!rstr) return nullptr;
+      return lstr + rstr;
+    }
+  }
+
+  if (lval.is_smi() && rval.is_smi()) {
+    return ApplyBinaryOperator(bin_op, lval.smi(), rval.smi());
+  } else if (lval.is_double() && rval.is_double()) {
+    double lnum = lval.as_double();
+    double rnum = rval.as_double();
+    return ApplyBinaryOperator(bin_op, lnum, rnum);
+  } else {
+    double lnum, rnum;
+    if (!ToNumber(c, lval, lnum) || !ToNumber(c, rval, rnum)) {
+      return nullptr;
+    }
+    return ApplyBinaryOperator(bin_op, lnum, rnum);
+  }
+}
+
+any_ref ApplyUpdateOperator(SyntaxNode::UpdateOperator op, any_ref val) {
+  if (val.is_smi()) {
+    int num = val.smi();
+    int res;
+    switch (op) {
+      case SyntaxNode::kUpdateIncrement:
+        if (SmiAdd(num, 1, res)) {
+          val = res;
+        } else {
+          val = static_cast<double>(num) + 1;
+        }
+        break;
+      case SyntaxNode::kUpdateDecrement:
+        if (SmiSubtract(num, 1, res)) {
+          val = res;
+        } else {
+          val = static_cast<double>(num) - 1;
+        }
+        break;
+      default:
+        assert(false);
+        val = 0;
+        break;
+    }
+  } else {
+    double num = val.as_double();
+    switch (op) {
+      case SyntaxNode::kUpdateIncrement:
+        val = num + 1;
+        break;
+      case SyntaxNode::kUpdateDecrement:
+        val = num - 1;
+        break;
+      default:
+        assert(false);
+        val = 0;
+        break;
+    }
+  }
+  return val;
+}
+
+// Identifier resolution
+
+/**
+ * @returns false for exception.
+ */
+bool PutIdentifierValue(Context* c, Environment* env, u16string n, any_ref v, bool strict) {
+  // 10.3.1 Identifier Resolution
+  // 10.2.2.1 GetIdentifierReference (lex, name, strict)
+  while (env) {
+    if (env->is<DeclarativeEnvironment>()) {
+      DeclarativeEnvironment* decl_env = static_cast<DeclarativeEnvironment*>(env);
+      bool found;
+      if (!decl_env->SetMutableBindingIfFound(c, n, v, strict, found)) return false;
+      if (found) return true;
+    } else {
+      assert(env->is<ObjectEnvironment>());
+      ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(env);
+      bool found;
+      if (!obj_env->SetMutableBindingIfFound(c, n, v, strict, found)) return false;
+      if (found) return true;
+    }
+    env = env->outer;
+  }
+  // Do PutValue()
+  if (strict) {
+    return ThrowReferenceError(c);
+  } else {
+    Object* obj = c->global_obj();
+    return obj->Put(c, n, v, false);
+  }
+}
+
+bool DeleteIdentifier(Environment* env, u16string n) {
+  if (env->is<DeclarativeEnvironment>()) {
+    DeclarativeEnvironment* decl_env = static_cast<DeclarativeEnvironment*>(env);
+    return decl_env->DeleteBinding(n);
+  } else {
+    assert(env->is<ObjectEnvironment>());
+    ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(env);
+    return obj_env->DeleteBinding(n);
+  }
+}
+
+any_ref GetIdentifierValue(Context* c, Environment* env, u16string n, bool do_throw, Environment*& resolved_env) {
+  // 10.3.1 Identifier Resolution
+  // 10.2.2.1 GetIdentifierReference (lex, name, strict)
+  while (env) {
+    if (env->is<DeclarativeEnvironment>()) {
+      DeclarativeEnvironment* decl_env = static_cast<DeclarativeEnvironment*>(env);
+      any_ref v = decl_env->GetBindingValue(n);
+      if (!!v) {
+        // HasBinding() is true.
+        resolved_env = env;
+        return v;
+      }
+    } else {
+      assert(env->is<ObjectEnvironment>());
+      ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(env);
+      Object* bindings_obj = obj_env->bindings_obj;
+      Property* prop = bindings_obj->GetProperty(n);
+      if (!!prop) {
+        // HasBinding() is true.
+        resolved_env = env;
+        // Do GetBindingValue().
+        return bindings_obj->Get(n);
+      }
+    }
+    env = env->outer;
+  }
+  if (do_throw) {
+    return ThrowReferenceError(c);
+  } else {
+    // IsUnresolvableReference(V) is true.
+    // GetValue(V) throws a ReferenceError.
+    return any_ref::undefined();
+  }
+}
+
+any_ref GetIdentifierThisValue(Context* c, Environment* env, Environment* resolved_env) {
+  // 11.2.3 Function Calls
+  if (env->is<DeclarativeEnvironment>()) {
+    return c->global_obj();
+  } else {
+    assert(resolved_env->is<ObjectEnvironment>());
+    ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(resolved_env);
+    if (obj_env->provide_this) {
+      return obj_env->bindings_obj;
+    } else {
+      return any_ref::undefined();
+    }
+  }
+}
+
+bool PutValueWithEnvironment(Context* c, Environment* env, u16string n, any_ref v, bool strict) {
+  if (env->is<DeclarativeEnvironment>()) {
+    DeclarativeEnvironment* decl_env = static_cast<DeclarativeEnvironment*>(env);
+    bool found;
+    return decl_env->SetMutableBindingIfFound(c, n, v, strict, found);
+  } else {
+    assert(env->is<ObjectEnvironment>());
+    ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(env);
+    return obj_env->SetMutableBinding(c, n, v, strict);
+  }
+}
+
+void DefineVariable(Context* c, Environment* env, u16string n, any_ref v) {
+  assert(!!env);
+  if (env->is<DeclarativeEnvironment>()) {
+    DeclarativeEnvironment* decl_env = static_cast<DeclarativeEnvironment*>(env);
+    decl_env->CreateBinding(n, v, false, false);
+  } else {
+    assert(env->is<ObjectEnvironment>());
+    ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(env);
+    obj_env->CreateMutableBinding(c, n, v, false);
+  }
+}
+
+Object* NewFunctionObject(Context* c, Script* script, Environment* scope, FunctionNode* node) {
+  // 13.2 Creating Function Objects
+  Object* o = Object::Alloc(c->function_proto());
+  Function* fn = Function::Alloc();
+  fn->script = script;
+  fn->code = node;
+  fn->context = c;
+  fn->scope = scope;
+  fn->strict = false;
+  o->host_data = fn;
+
+  // prototype
+  Object* proto = Object::Alloc(c->object_proto());
+  o->Put(c, "prototype", proto, false);
+
+  // constructor
+  proto->Put(c, "constructor", o, false);
+
+  return o;
+}
+
 Script* Script::Alloc(u16string name, Program* program, u16string source) {
-  Script* script = gc_malloc_cast<Script>();
+  Script* script = reinterpret_cast<Script*>(alloc_heap_data(Script::class_tag, sizeof (Script)));
   if (!script) return nullptr;
   script->tag_ = Script::class_tag;
   script->name = name;
   script->program_ = program;
   script->source = source;
   script->string_table_.init();
+  script->bytecode_ = nullptr;
   GC_REGISTER_FINALIZER(script, [](GC_PTR obj, GC_PTR client_data) {
       Script* script = reinterpret_cast<Script*>(obj);
       // std::cout << "delete program: " << script->name << std::endl;
       delete script->program_;
+      delete script->bytecode_;
     }, 0, NULL, NULL);
   return script;
 }
 
 DeclarativeEnvironment* DeclarativeEnvironment::Alloc(Environment* outer) {
-  DeclarativeEnvironment* env = gc_malloc_cast<DeclarativeEnvironment>();
+  DeclarativeEnvironment* env = reinterpret_cast<DeclarativeEnvironment*>(alloc_heap_data(DeclarativeEnvironment::class_tag, sizeof (DeclarativeEnvironment)));
   if (!env) return nullptr;
   env->tag_ = DeclarativeEnvironment::class_tag;
   env->bindings_.init();
   env->outer = outer;
+  env->slots_ = nullptr;
+  env->num_slots_ = 0;
+  return env;
+}
+
+DeclarativeEnvironment* DeclarativeEnvironment::Alloc(Environment* outer, size_t num_slots, Script* script, const int* slot_names) {
+  // The slots follow the environment in the same allocation.
+  void* p = alloc_heap_data(DeclarativeEnvironment::class_tag, sizeof (DeclarativeEnvironment) + num_slots * sizeof (any_ref));
+  if (!p) return nullptr;
+  DeclarativeEnvironment* env = reinterpret_cast<DeclarativeEnvironment*>(p);
+  env->tag_ = DeclarativeEnvironment::class_tag;
+  env->bindings_.init();
+  env->outer = outer;
+  env->slots_ = reinterpret_cast<any_ref*>(env + 1);
+  env->num_slots_ = num_slots;
+  env->script_ = script;
+  env->slot_names_ = slot_names;
   return env;
 }
 
 ObjectEnvironment* ObjectEnvironment::Alloc(Environment* outer) {
-  ObjectEnvironment* env = gc_malloc_cast<ObjectEnvironment>();
+  ObjectEnvironment* env = reinterpret_cast<ObjectEnvironment*>(alloc_heap_data(ObjectEnvironment::class_tag, sizeof (ObjectEnvironment)));
   if (!env) return nullptr;
   env->tag_ = ObjectEnvironment::class_tag;
   env->outer = outer;
@@ -702,7 +1612,7 @@ bool ObjectEnvironment::CreateMutableBinding(Context* c, u16string n, any_ref v,
 extern const char* startup_source;
 
 Context* Context::Alloc(bool ext) {
-  Context* c = reinterpret_cast<Context*>(GC_MALLOC(sizeof (Context)));
+  Context* c = reinterpret_cast<Context*>(alloc_heap_data(Context::class_tag, sizeof (Context)));
   c->tag_ = Context::class_tag;
   c->InitStandardBuiltInObjects();
   u16string s = startup_source;
@@ -717,22 +1627,32 @@ Context* Context::Alloc(bool ext) {
 
 any_ref Context::EvalString(u16string source, u16string name) {
   Parser parser;
-  std::u16string u16name(name.data(), name.length());
-  Parser::Result<Program> result = parser.ParseProgram(source.data(), source.length(), u16name.c_str());
+  std::u16string u16name(name.begin(), name.end());
+  // The lexer reads two-byte units, so a one-byte source is widened for
+  // as long as the parse.
+  std::u16string buf;
+  Parser::Result<Program> result = parser.ParseProgram(source.data(buf), source.length(), u16name.c_str());
   if (!result.IsSuccess()) {
     return ThrowSyntaxError(this);
   }
   auto string_map = result.string_map();
   Script* script = Script::Alloc(name, result.ReleaseNode(), source);
   auto& string_table = script->string_table();
-  string_table.resize(string_map.size());
+  // Index 0 is reserved for the empty string.
+  string_table.resize(string_map.size() + 1);
+  string_table[0] = const_cast<u16string_data*>(intern(u16string_data::alloc()).get__());
   for (auto it = string_map.begin(); it != string_map.end(); ++it) {
     const std::u16string& s = (*it).first;
     int i = (*it).second;
-    string_table[i] = u16string_data::alloc(s.data(), s.length());
+    u16string atom = intern(u16string(s.data(), s.length()));
+    string_table[i] = const_cast<u16string_data*>(atom.get__());
     // std::cout << i << " -> " << any_ref(string_table[i]) << std::endl;
   }
 
+  if (evaluator_type_ == kEvaluatorBytecode) {
+    script->set_bytecode(BytecodeCompiler::Compile(script));
+    return BytecodeEvaluator::EvalScript(this, script);
+  }
   return AstEvaluator::EvalScript(this, script);
 }
 
@@ -764,12 +1684,11 @@ Object* NewArrayObject(Context* c, uint32_t n, const any_ref* e) {
     desc->flags = Property::kWritable | Property::kEnumerable;
     desc->value_or_get = static_cast<double>(n);
   }
-  if (e) {
+  if (e && n > 0) {
+    arr->elements = gc_realloc_array_cast<any_ref>(nullptr, n);
+    arr->capacity = n;
     for (uint32_t i = 0; i < n; i++) {
-      u16string s = uint32_to_u16string(i);
-      Property* desc = o->NewOwnProperty(s);
-      desc->flags = Property::kWritable | Property::kEnumerable | Property::kConfigurable;
-      desc->value_or_get = e[i];
+      arr->elements[i] = e[i];
     }
   }
   return o;
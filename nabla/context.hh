@@ -16,8 +16,12 @@ namespace internal {
 
 class Context;
 class Script;
+class Bytecode;
+class CodeBlock;
 class Environment;
 class Object;
+class Array;
+class HeapSnapshot;
 
 struct Property {
  public:
@@ -36,7 +40,56 @@ struct Property {
  private:
 };
 
-typedef hash_map<u16string, Property> ObjectPropertyMap;
+// A shape maps the names of the own properties of an object to the
+// indices of their slots. Objects that get the same properties in the
+// same order share the shape through the add-property transitions.
+// An object with many properties, or whose property was deleted, has
+// its own dictionary shape instead.
+class Shape : public heap_data {
+ public:
+  static const tag class_tag = kTagShape;
+  static const uint32_t kMaxSharedProperties = 32;
+  // Returns the shape of an object without properties.
+  static Shape* Empty();
+  // Returns a new dictionary shape with the keys of shape that were not
+  // removed, in the same order.
+  static Shape* AllocDictionary(const Shape* shape);
+  static void InitLayout();
+
+  bool is_dictionary() const { return dictionary_; }
+  // Number of slots including the ones removed from dictionaries.
+  uint32_t size() const { return size_; }
+  uint32_t num_removed() const { return num_removed_; }
+  // Whether a key may be an array index.
+  bool has_index_keys() const { return has_index_keys_; }
+  // Name of the slot i, or nil when it was removed.
+  u16string key(uint32_t i) const { return keys_[i]; }
+  // Returns the index of the slot named n, or -1.
+  int Lookup(u16string n) const;
+  // Returns the shared shape with n added after the keys of this shape.
+  Shape* AddTransition(u16string n);
+  // Adds n to the dictionary and returns its index.
+  uint32_t AddKey(u16string n);
+  // Removes the slot i from the dictionary.
+  void RemoveKey(uint32_t i);
+
+ private:
+  friend class HeapSnapshot;
+
+  static Shape* Alloc(bool dictionary, uint32_t capacity);
+  static heap_layout layout_;
+
+  bool dictionary_;
+  uint32_t size_;
+  uint32_t capacity_;
+  uint32_t num_removed_;
+  bool has_index_keys_;
+  u16string* keys_;
+  // Shared shapes only.
+  map<u16string, Shape*, 1> transitions_;
+  // Dictionary shapes only.
+  hash_map<u16string, int>* table_;
+};
 
 class Object : public heap_data {
  public:
@@ -50,20 +103,25 @@ class Object : public heap_data {
  public:
   static const tag class_tag = kTagObject;
   static Object* Alloc(Object* prototype);
+  static void InitLayout();
 
   Object* proto() { return proto_; }
-  ObjectPropertyMap& own_props() { return own_props_; }
-  
-  Property* NewOwnProperty(u16string n) {
-    return &own_props_[n];
-  }
+  Shape* shape() { return shape_; }
+  // Own properties are the slots 0 to num_own_slots() - 1 whose names
+  // aren't nil.
+  uint32_t num_own_slots() const { return shape_->size(); }
+  u16string OwnSlotName(uint32_t i) const { return shape_->key(i); }
+  Property* OwnSlot(uint32_t i) { return &slots_[i]; }
+
+  Property* NewOwnProperty(u16string n);
   Property* GetOwnProperty(u16string n) {
-    auto it = own_props_.find(n);
-    if (it == own_props_.end()) return nullptr;
-    return &(*it).second;
+    int i = shape_->Lookup(n);
+    if (i < 0) return nullptr;
+    return &slots_[i];
   }
   Property* GetProperty(u16string n);
-  Property* GetProperty(uint32_t n);
+  bool HasOwnProperty(u16string n);
+  bool HasProperty(uint32_t n);
   any_ref Get(u16string n);
   any_ref Get(uint32_t n);
   any_ref Get(const Property* desc);
@@ -75,6 +133,9 @@ class Object : public heap_data {
   any_ref DefaultValue(Context* cx, PreferredType hint);
   bool DefineOwnArrayProperty(Context* c, u16string n, any_ref v, bool do_throw, Property* own_desc);
   void DefineOwnDataPropertyNoCheck(u16string n, any_ref v, int flags);
+  // Appends the names of the own enumerable properties, elements of
+  // arrays first.
+  void GetOwnEnumerableNames(any_vector& names);
   
   any_ref Call(size_t argc, const any_ref* argv);
   any_ref Construct(size_t argc, const any_ref* argv);
@@ -83,8 +144,22 @@ class Object : public heap_data {
   any_ref host_data;
 
  private:
+  void MakeDictionary();
+  // Returns the host data of an array that stores its elements in the
+  // elements vector, or nullptr.
+  Array* dense_array();
+  bool ReserveElements(Array* arr, uint32_t n);
+  void MakeSparseElements();
+  void SetArrayLength(Array* arr, uint32_t len);
+
+  friend class HeapSnapshot;
+
+  static heap_layout layout_;
+
   Object* proto_;
-  ObjectPropertyMap own_props_;
+  Shape* shape_;
+  Property* slots_;
+  uint32_t slots_capacity_;
   int flags;
 };
 
@@ -94,23 +169,39 @@ class Function : public heap_data {
  public:
   static const tag class_tag = kTagFunction;
   static Function* Alloc();
+  static void InitLayout();
 
  public:
   Script* script;
   Context* context;
   Environment* scope;
+  // Outside the GC heap, like code and block.
   NativeCodeProc native_code;
   FunctionNode* code;
+  CodeBlock* block;
   bool strict;
+
+ private:
+  static heap_layout layout_;
 };
 
 class Array : public heap_data {
  public:
   static const tag class_tag = kTagArray;
   static Array* Alloc();
+  static void InitLayout();
 
  public:
   uint32_t length;
+  // Elements below capacity, nil for holes. Arrays that would have
+  // too many holes are made sparse and keep all their elements in
+  // properties named by the indices instead.
+  any_ref* elements;
+  uint32_t capacity;
+  bool sparse;
+
+ private:
+  static heap_layout layout_;
 };
 
 class Date : public heap_data {
@@ -127,13 +218,20 @@ class Script : heap_data {
   static const tag class_tag = kTagScript;
   static Script* Alloc(u16string name, Program* program, u16string source);
   Program *program() { return program_; }
+  // The file name or the name given to eval code.
+  u16string source_name() const { return name; }
   vector<u16string_data*>& string_table() { return string_table_; }
+  Bytecode* bytecode() { return bytecode_; }
+  void set_bytecode(Bytecode* bytecode) { bytecode_ = bytecode; }
 
  private:
+  friend class HeapSnapshot;
+
   u16string name;
   Program *program_;
   u16string source;
   vector<u16string_data*> string_table_;
+  Bytecode* bytecode_;
 };
 
 class Binding {
@@ -152,17 +250,32 @@ class DeclarativeEnvironment : public Environment {
  public:
   static const tag class_tag = kTagDeclarativeEnvironment;
   static DeclarativeEnvironment* Alloc(Environment* outer);
+  // Allocates an environment with num_slots bindings stored by index.
+  // slot_names are indices into the string table of script, so that
+  // the slots can still be found by name.
+  static DeclarativeEnvironment* Alloc(Environment* outer, size_t num_slots, Script* script, const int* slot_names);
+  any_ref* slots() { return slots_; }
+  // Returns the initialized slot named n, or nullptr.
+  any_ref* FindSlot(u16string n) {
+    for (size_t i = 0; i < num_slots_; i++) {
+      if (!!slots_[i] && n == u16string(script_->string_table()[slot_names_[i]])) return &slots_[i];
+    }
+    return nullptr;
+  }
   Binding* GetBinding(u16string n) {
     auto it = bindings_.find(n);
     if (it == bindings_.end()) return nullptr;
     return &(*it).second;
   }
   any_ref GetBindingValue(u16string n) {
+    any_ref* slot = FindSlot(n);
+    if (slot) return *slot;
     Binding* b = GetBinding(n);
     return b ? b->value : nullptr;
   }
   bool SetMutableBindingIfFound(Context* c, u16string n, any_ref v, bool strict, bool& found);
   void CreateBinding(u16string n, any_ref v, bool immutable, bool deletable) {
+    if (FindSlot(n)) return;
     if (!GetBinding(n)) {
       bindings_[n].immutable = immutable;
       bindings_[n].deletable = deletable;
@@ -170,6 +283,8 @@ class DeclarativeEnvironment : public Environment {
     }
   }
   bool DeleteBinding(u16string n) {
+    // Slots are var, function and parameter bindings, which can't be deleted.
+    if (FindSlot(n)) return false;
     auto it = bindings_.find(n);
     if (it == bindings_.end()) return true;
     Binding* b = &(*it).second;
@@ -179,7 +294,13 @@ class DeclarativeEnvironment : public Environment {
   }
   
  private:
+  friend class HeapSnapshot;
+
   map<u16string, Binding> bindings_;
+  any_ref* slots_;
+  size_t num_slots_;
+  Script* script_;
+  const int* slot_names_;
 };
 
 class ObjectEnvironment : public Environment {
@@ -212,9 +333,16 @@ class ObjectEnvironment : public Environment {
 };
 
 class Context : public heap_data {
+ public:
+  enum EvaluatorType {
+    kEvaluatorBytecode, kEvaluatorAst
+  };
+
  public:
   static const tag class_tag = kTagContext;
   static Context* Alloc(bool ext);
+  static void SetEvaluatorType(EvaluatorType type) { evaluator_type_ = type; }
+  static EvaluatorType evaluator_type() { return evaluator_type_; }
 
   any_ref EvalString(u16string source, u16string name);
 
@@ -232,6 +360,8 @@ class Context : public heap_data {
   Object* error_proto() const { return error_proto_; }
 
 private:
+  static EvaluatorType evaluator_type_;
+
   void InitStandardBuiltInObjects();
   void InitExtendedBuiltInObjects();
 
@@ -273,6 +403,10 @@ class Thread {
   any_ref exception_val;
 };
 
+// Registers the layouts of the objects above with the collector. Called
+// once after init().
+void InitLayouts();
+
 any_ref ToPrimitive(Context* c, any_ref v, Object::PreferredType hint = Object::kPreferredNone);
 bool ToNumber(Context* c, any_ref v, double& d);
 template <typename intT>
@@ -303,19 +437,64 @@ Object* CreateNativeFunction(Context* c, NativeCodeProc proc);
 Object* NewStringObject(Context* c, u16string s);
 Object* NewArrayObject(Context* c, uint32_t n = 0, const any_ref* e = nullptr);
 Object* NewRegExpObject(Context* c, u16string pattern_str, u16string flags_str);
+any_ref ApplyUnaryOperator(Context* c, SyntaxNode::UnaryOperator op, any_ref val);
+any_ref ApplyBinaryOperator(Context* c, SyntaxNode::BinaryOperator op, any_ref lval, any_ref rval);
+any_ref ApplyAssignmentOperator(Context* c, SyntaxNode::AssignmentOperator op, any_ref lval, any_ref rval);
+any_ref ApplyUpdateOperator(SyntaxNode::UpdateOperator op, any_ref val);
+
+// Overflow-checked int32 arithmetic for the SMI fast paths. Each returns
+// false when the exact result is not representable as an SMI, including -0.
+inline bool SmiAdd(int l, int r, int& res) {
+#if defined(__GNUC__)
+  return !__builtin_add_overflow(l, r, &res);
+#else
+  int64_t v = static_cast<int64_t>(l) + r;
+  res = static_cast<int>(v);
+  return v == res;
+#endif
+}
 
-inline bool Object::Delete(Context* c, u16string n, bool do_throw) {
-  auto it = own_props_.find(n);
-  if (it == own_props_.end()) return true;
-  if (!((*it).second.flags & Property::kConfigurable)) {
-    if (do_throw) return ThrowTypeError(c);
-    return true;
-  }
-  own_props_.erase(it);
-  return true;
+inline bool SmiSubtract(int l, int r, int& res) {
+#if defined(__GNUC__)
+  return !__builtin_sub_overflow(l, r, &res);
+#else
+  int64_t v = static_cast<int64_t>(l) - r;
+  res = static_cast<int>(v);
+  return v == res;
+#endif
+}
+
+inline bool SmiMultiply(int l, int r, int& res) {
+#if defined(__GNUC__)
+  if (__builtin_mul_overflow(l, r, &res)) return false;
+#else
+  int64_t v = static_cast<int64_t>(l) * r;
+  res = static_cast<int>(v);
+  if (v != res) return false;
+#endif
+  return res != 0 || (l | r) >= 0;
+}
+bool PutIdentifierValue(Context* c, Environment* env, u16string n, any_ref v, bool strict);
+bool DeleteIdentifier(Environment* env, u16string n);
+any_ref GetIdentifierValue(Context* c, Environment* env, u16string n, bool do_throw, Environment*& resolved_env);
+any_ref GetIdentifierThisValue(Context* c, Environment* env, Environment* resolved_env);
+bool PutValueWithEnvironment(Context* c, Environment* env, u16string n, any_ref v, bool strict);
+void DefineVariable(Context* c, Environment* env, u16string n, any_ref v);
+Object* NewFunctionObject(Context* c, Script* script, Environment* scope, FunctionNode* node);
+
+inline Array* Object::dense_array() {
+  if (!host_data.is<Array>()) return nullptr;
+  Array* arr = host_data.as<Array>();
+  return arr->sparse ? nullptr : arr;
 }
 
 inline bool DeclarativeEnvironment::SetMutableBindingIfFound(Context* c, u16string n, any_ref v, bool strict, bool& found) {
+  any_ref* slot = FindSlot(n);
+  if (slot) {
+    *slot = v;
+    found = true;
+    return true;
+  }
   Binding* b = GetBinding(n);
   if (b) {
     if (b->immutable) {
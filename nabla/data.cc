@@ -7,34 +7,437 @@
 #endif
 #include "data.hh"
 
+#include <chrono>
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <gc/gc.h>
+#include <gc/gc_inline.h>
+#include <gc/gc_mark.h>
+#include <gc/gc_typed.h>
+#include <random>
+#include <vector>
 
 #include "debug.hh"
 
 namespace nabla {
 namespace internal {
 
+static void init_layouts();
+
+namespace {
+
+// Allocations that wait for the collector, because it collected or did a
+// step of incremental marking before returning, are the pauses the
+// mutator sees. Calls that may enter the collector are timed, and those
+// taking at least kMinPauseMicros are counted.
+size_t pause_buckets[kNumPauseBuckets];
+uint64_t total_pause_micros = 0;
+uint64_t max_pause_micros = 0;
+
+uint64_t now_micros() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void record_pause(uint64_t start) {
+  uint64_t d = now_micros() - start;
+  if (d < kMinPauseMicros) return;
+  total_pause_micros += d;
+  if (d > max_pause_micros) max_pause_micros = d;
+  size_t i = 0;
+  while (i + 1 < kNumPauseBuckets && d >= kMinPauseMicros << (i + 1)) i++;
+  pause_buckets[i]++;
+}
+
+void* timed_malloc(size_t n) {
+  uint64_t start = now_micros();
+  void* p = GC_MALLOC(n);
+  record_pause(start);
+  return p;
+}
+
+void* timed_malloc_atomic(size_t n) {
+  uint64_t start = now_micros();
+  void* p = GC_MALLOC_ATOMIC(n);
+  record_pause(start);
+  return p;
+}
+
+void* timed_realloc(void* p, size_t n) {
+  uint64_t start = now_micros();
+  p = GC_REALLOC(p, n);
+  record_pause(start);
+  return p;
+}
+
+void* timed_generic_malloc(size_t n, int kind) {
+  uint64_t start = now_micros();
+  void* p = GC_generic_malloc(n, kind);
+  record_pause(start);
+  return p;
+}
+
+void timed_malloc_many(size_t n, int kind, void** result) {
+  uint64_t start = now_micros();
+  GC_generic_malloc_many(n, kind, result);
+  record_pause(start);
+}
+
+}  // namespace
+
+#ifdef NABLA_GC_GUARD
+
+// Guard mode puts a header in front of every block allocated through
+// gc_malloc and a canary after it, and checks them all at the start of each
+// collection. An overrun is reported there, close to where it happened,
+// instead of silently corrupting the next block.
+
+namespace {
+
+struct guard_header {
+  size_t size;
+  uint32_t magic;
+  // Index of the entry in the guard table that refers to this block.
+  uint32_t entry;
+};
+
+const uint32_t kGuardMagic = 0x4e61624c;
+const size_t kGuardSize = 16;
+const uint8_t kGuardByte = 0xfd;
+const size_t kGuardOverhead = sizeof (guard_header) + kGuardSize;
+
+// The blocks to check. The table is outside the GC heap, and each entry is a
+// disappearing link to its block, which the collector clears when the block
+// is freed. Entries are allocated in chunks that never move.
+const size_t kGuardChunkSize = 4096;
+std::vector<GC_hidden_pointer*> guard_chunks;
+size_t guard_cursor = 0;
+
+GC_hidden_pointer* guard_entry(size_t i) {
+  return &guard_chunks[i / kGuardChunkSize][i % kGuardChunkSize];
+}
+
+bool guard_intact(const guard_header* h) {
+  if (h->magic != kGuardMagic) return false;
+  const uint8_t* guard = reinterpret_cast<const uint8_t*>(h + 1) + h->size;
+  for (size_t i = 0; i < kGuardSize; i++) {
+    if (guard[i] != kGuardByte) return false;
+  }
+  return true;
+}
+
+void guard_register(guard_header* h) {
+  // Reuse the next entry cleared by the collector, or add a chunk.
+  size_t n = guard_chunks.size() * kGuardChunkSize;
+  size_t found = n;
+  for (size_t k = 0; k < n; k++) {
+    size_t i = (guard_cursor + k) % n;
+    if (!*guard_entry(i)) {
+      found = i;
+      break;
+    }
+  }
+  if (found == n) {
+    guard_chunks.push_back(static_cast<GC_hidden_pointer*>(calloc(kGuardChunkSize, sizeof (GC_hidden_pointer))));
+  }
+  GC_hidden_pointer* link = guard_entry(found);
+  *link = GC_HIDE_POINTER(h);
+  GC_GENERAL_REGISTER_DISAPPEARING_LINK(reinterpret_cast<void**>(link), h);
+  h->entry = static_cast<uint32_t>(found);
+  guard_cursor = found + 1;
+}
+
+void guard_unregister(guard_header* h) {
+  GC_hidden_pointer* link = guard_entry(h->entry);
+  GC_unregister_disappearing_link(reinterpret_cast<void**>(link));
+  *link = 0;
+}
+
+void* guard_init(void* p, size_t n) {
+  if (!p) return nullptr;
+  guard_header* h = static_cast<guard_header*>(p);
+  h->size = n;
+  h->magic = kGuardMagic;
+  memset(reinterpret_cast<uint8_t*>(h + 1) + n, kGuardByte, kGuardSize);
+  guard_register(h);
+  return h + 1;
+}
+
+void guard_check() {
+  void* p = find_overrun();
+  if (!p) return;
+  const guard_header* h = static_cast<const guard_header*>(p) - 1;
+  fprintf(stderr, "nabla: heap block %p of %zu bytes was overrun\n", p, h->size);
+  abort();
+}
+
+}  // namespace
+
+void* find_overrun() {
+  size_t n = guard_chunks.size() * kGuardChunkSize;
+  for (size_t i = 0; i < n; i++) {
+    GC_hidden_pointer v = *guard_entry(i);
+    if (!v) continue;
+    guard_header* h = static_cast<guard_header*>(GC_REVEAL_POINTER(v));
+    if (!guard_intact(h)) return h + 1;
+  }
+  return nullptr;
+}
+
+void* gc_malloc(size_t n) {
+  return guard_init(timed_malloc(n + kGuardOverhead), n);
+}
+
+void* gc_realloc(void* p, size_t n) {
+  if (!p) return gc_malloc(n);
+  guard_header* h = static_cast<guard_header*>(p) - 1;
+  if (!guard_intact(h)) guard_check();
+  guard_unregister(h);
+  return guard_init(timed_realloc(h, n + kGuardOverhead), n);
+}
+
+void* gc_malloc_atomic(size_t n) {
+  return guard_init(timed_malloc_atomic(n + kGuardOverhead), n);
+}
+
+void init(bool incremental) {
+  GC_INIT();
+  if (incremental) GC_enable_incremental();
+  // Pointers to blocks point just past the header.
+  GC_register_displacement(sizeof (guard_header));
+  GC_set_start_callback(guard_check);
+  init_layouts();
+}
+
+size_t get_guard_bytes() {
+  size_t n = guard_chunks.size() * kGuardChunkSize;
+  size_t live = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (*guard_entry(i)) live++;
+  }
+  return live * kGuardOverhead;
+}
+
+#else
+
 void* gc_malloc(size_t n) {
-  return GC_MALLOC(n + 100);
+  return timed_malloc(n);
 }
 
 void* gc_realloc(void* p, size_t n) {
-  return GC_REALLOC(p, n + 100);
+  return timed_realloc(p, n);
 }
 
 void* gc_malloc_atomic(size_t n) {
-  return GC_MALLOC_ATOMIC(n + 100);
+  return timed_malloc_atomic(n);
 }
 
-void init() {
+void init(bool incremental) {
   GC_INIT();
-  heap_data::value_table_[heap_data::undefined_index_].tag_ = heap_data::kTagUndefined;
-  heap_data::value_table_[heap_data::nullvalue_index_].tag_ = heap_data::kTagNull;
-  heap_data::value_table_[heap_data::true_index_].tag_ = heap_data::kTagBool;
-  heap_data::value_table_[heap_data::false_index_].tag_ = heap_data::kTagBool;
+  if (incremental) GC_enable_incremental();
+  init_layouts();
+}
+
+void* find_overrun() {
+  return nullptr;
+}
+
+size_t get_guard_bytes() {
+  return 0;
+}
+
+#endif  // NABLA_GC_GUARD
+
+namespace {
+
+// Size class c holds blocks of (c + 1) * kGranule bytes. The engine runs on
+// one thread, so the caches are plain statics, which the collector scans as
+// roots.
+const size_t kGranule = 16;
+const size_t kNumSizeClasses = kMaxCachedSize / kGranule;
+
+// Scanned blocks are chained through their first word, which keeps the
+// cached ones reachable. Atomic blocks are not scanned, so a chain through
+// them would not, and they are kept in an array instead. A batch is at most
+// one heap block of the collector, 4096 bytes by default.
+void* free_lists[kNumSizeClasses];
+const size_t kAtomicCacheSize = 4096 / kGranule;
+void* atomic_cache[kNumSizeClasses][kAtomicCacheSize];
+size_t atomic_cache_count[kNumSizeClasses];
+
+struct alloc_stat {
+  size_t count;
+  size_t bytes;
+};
+
+alloc_stat alloc_stats[heap_data::kNumTags];
+
+// Heap objects have kinds of their own, apart from the blocks of
+// containers, so that the live ones can be told apart in the heap: one for
+// scanned objects without a layout, one for atomic objects and one for
+// each layout.
+unsigned heap_kind;
+unsigned heap_atomic_kind;
+const size_t kMaxLayouts = 16;
+heap_layout* layouts[kMaxLayouts];
+size_t num_layouts = 0;
+size_t cached_allocs = 0;
+size_t cache_refills = 0;
+
+size_t size_class(size_t n) {
+  assert(n > 0 && n <= kMaxCachedSize);
+  return (n - 1) / kGranule;
+}
+
+// The collector adds a byte to each request so that a pointer just past a
+// block still refers to it. Nothing here keeps such pointers, so one byte
+// less is asked for to get blocks of exactly the class size.
+size_t batch_request_size(size_t c) {
+  return (c + 1) * kGranule - 1;
+}
+
+// Bytes to allocate before the next sample. Sampled bytes are a Poisson
+// process, so that every byte has the same chance of being picked whatever
+// the pattern of the allocations. The count stays far above any request
+// while sampling is off.
+int64_t bytes_until_sample = INT64_MAX;
+alloc_sampler sampler = nullptr;
+double sample_interval;
+std::mt19937_64 sample_rng;
+
+int64_t next_sample_distance() {
+  std::exponential_distribution<double> distance(1 / sample_interval);
+  return static_cast<int64_t>(distance(sample_rng)) + 1;
+}
+
+void sample_alloc(heap_data::tag t, size_t n) {
+  bytes_until_sample = next_sample_distance();
+  // An allocation of n bytes is picked with probability 1 - e^(-n/interval).
+  double weight = 1 / -std::expm1(-static_cast<double>(n) / sample_interval);
+  sampler(t, n, weight);
+}
+
+void count_alloc(heap_data::tag t, size_t n) {
+  alloc_stats[t].count++;
+  alloc_stats[t].bytes += n;
+  bytes_until_sample -= static_cast<int64_t>(n);
+  if (bytes_until_sample < 0) sample_alloc(t, n);
+}
+
+bool refill_atomic_cache(size_t c) {
+  void* batch = nullptr;
+  timed_malloc_many(batch_request_size(c), heap_atomic_kind, &batch);
+  if (!batch) return false;
+  cache_refills++;
+  // Blocks that don't fit are left to the collector.
+  size_t count = 0;
+  while (batch && count < kAtomicCacheSize) {
+    void* next = GC_NEXT(batch);
+    atomic_cache[c][count++] = batch;
+    batch = next;
+  }
+  atomic_cache_count[c] = count;
+  return true;
+}
+
+}  // namespace
+
+void* alloc_heap_data(heap_data::tag t, size_t n) {
+  count_alloc(t, n);
+  if (n > kMaxCachedSize) return timed_generic_malloc(n, heap_kind);
+  size_t c = size_class(n);
+  void* p = free_lists[c];
+  if (!p) {
+    timed_malloc_many(batch_request_size(c), heap_kind, &p);
+    if (!p) return nullptr;
+    cache_refills++;
+  }
+  cached_allocs++;
+  // The rest of the block was cleared by the collector.
+  free_lists[c] = GC_NEXT(p);
+  GC_NEXT(p) = nullptr;
+  return p;
+}
+
+void* alloc_heap_data_atomic(heap_data::tag t, size_t n) {
+  count_alloc(t, n);
+  if (n > kMaxCachedSize) return timed_generic_malloc(n, heap_atomic_kind);
+  size_t c = size_class(n);
+  if (atomic_cache_count[c] == 0 && !refill_atomic_cache(c)) return nullptr;
+  cached_allocs++;
+  void*& slot = atomic_cache[c][--atomic_cache_count[c]];
+  void* p = slot;
+  // Don't keep the block alive after it's handed out.
+  slot = nullptr;
+  return p;
+}
+
+void heap_layout::commit() {
+  size_t words = (size_ + sizeof (GC_word) - 1) / sizeof (GC_word);
+  GC_word bitmap[(kMaxCachedSize / sizeof (GC_word) + GC_WORDSZ - 1) / GC_WORDSZ] = { 0 };
+  for (size_t i = 0; i < words; i++) {
+    if (is_pointer(i)) GC_set_bit(bitmap, i);
+  }
+  GC_descr descr = GC_make_descriptor(bitmap, words);
+  // The descriptor is the same for every block of the kind; new blocks are
+  // cleared.
+  kind_ = GC_new_kind(GC_new_free_list(), descr, 0, 1);
+  assert(num_layouts < kMaxLayouts);
+  layouts[num_layouts++] = this;
+}
+
+void* alloc_heap_data(heap_data::tag t, heap_layout& layout) {
+  if (!layout.kind_) return alloc_heap_data(t, layout.size_);
+  count_alloc(t, layout.size_);
+  void* p = layout.free_list_;
+  if (!p) {
+    timed_malloc_many(batch_request_size(size_class(layout.size_)), layout.kind_, &p);
+    if (!p) return nullptr;
+    cache_refills++;
+  }
+  cached_allocs++;
+  layout.free_list_ = GC_NEXT(p);
+  GC_NEXT(p) = nullptr;
+  return p;
+}
+
+const char* tag_name(heap_data::tag t) {
+  static const char* const names[heap_data::kNumTags] = {
+    "String",
+    "Number",
+    "Object",
+    "Context",
+    "Script",
+    "Function",
+    "Array",
+    "Date",
+    "RegExp",
+    "DeclarativeEnvironment",
+    "ObjectEnvironment",
+    "Shape"
+  };
+  return names[t];
+}
+
+void get_alloc_stats(size_t* counts, size_t* bytes, size_t& cached, size_t& refills) {
+  for (int i = 0; i < heap_data::kNumTags; i++) {
+    counts[i] = alloc_stats[i].count;
+    bytes[i] = alloc_stats[i].bytes;
+  }
+  cached = cached_allocs;
+  refills = cache_refills;
+}
+
+void set_alloc_sampler(alloc_sampler f, size_t interval) {
+  sampler = f;
+  if (!f) {
+    bytes_until_sample = INT64_MAX;
+    return;
+  }
+  sample_interval = static_cast<double>(interval);
+  bytes_until_sample = next_sample_distance();
 }
 
 void getmeminfo(size_t& heap_size, size_t& free_bytes) {
@@ -43,41 +446,79 @@ void getmeminfo(size_t& heap_size, size_t& free_bytes) {
 }
 
 void gc() {
+  uint64_t start = now_micros();
   GC_gcollect();
+  record_pause(start);
 }
 
-template<>
-string<char16_t>::string(const char* s) : string(s, strlen(s)) {
+void get_pause_histogram(size_t* buckets) {
+  for (size_t i = 0; i < kNumPauseBuckets; i++) buckets[i] = pause_buckets[i];
 }
 
-any_ref::any_ref(bool b) {
-  data_ = reinterpret_cast<intptr_t>(bool_data::alloc(b));
+void get_pause_times(uint64_t& total_micros, uint64_t& max_micros) {
+  total_micros = total_pause_micros;
+  max_micros = max_pause_micros;
 }
 
-any_ref::any_ref(const char* s) : any_ref(s, strlen(s)) {
-}
+namespace {
 
-heap_data heap_data::value_table_[];
+struct live_stats {
+  size_t* counts;
+  size_t* bytes;
+};
 
-undefined_data* undefined_data::alloc()
-{
-  return reinterpret_cast<undefined_data*>(&heap_data::value_table_[heap_data::undefined_index_]);
+bool is_heap_kind(int kind) {
+  if (kind == static_cast<int>(heap_kind) || kind == static_cast<int>(heap_atomic_kind)) return true;
+  for (size_t i = 0; i < num_layouts; i++) {
+    if (kind == static_cast<int>(layouts[i]->kind())) return true;
+  }
+  return false;
+}
+
+void count_live_object(void* obj, size_t size, void* client_data) {
+  if (!is_heap_kind(GC_get_kind_and_size(obj, nullptr))) return;
+  heap_data::tag t = static_cast<const heap_data*>(obj)->get_tag();
+  if (t < 0 || t >= heap_data::kNumTags) return;
+  live_stats* stats = static_cast<live_stats*>(client_data);
+  stats->counts[t]++;
+  stats->bytes[t] += size;
 }
 
-null_data* null_data::alloc() {
-  return reinterpret_cast<null_data*>(&heap_data::value_table_[heap_data::nullvalue_index_]);
+void* enumerate_live_objects(void* client_data) {
+  GC_enumerate_reachable_objects_inner(count_live_object, client_data);
+  return nullptr;
 }
 
-bool_data* bool_data::alloc(bool b) {
-  if (b) {
-    return reinterpret_cast<bool_data*>(&heap_data::value_table_[heap_data::true_index_]);
-  } else {
-    return reinterpret_cast<bool_data*>(&heap_data::value_table_[heap_data::false_index_]);
+}  // namespace
+
+void get_live_objects(size_t* counts, size_t* bytes) {
+  for (int i = 0; i < heap_data::kNumTags; i++) {
+    counts[i] = 0;
+    bytes[i] = 0;
+  }
+  // The blocks waiting in the caches are reachable but hold no objects, so
+  // they are left to the collection.
+  for (size_t c = 0; c < kNumSizeClasses; c++) {
+    free_lists[c] = nullptr;
+    for (size_t i = 0; i < atomic_cache_count[c]; i++) atomic_cache[c][i] = nullptr;
+    atomic_cache_count[c] = 0;
   }
+  for (size_t i = 0; i < num_layouts; i++) layouts[i]->drop_cache();
+  gc();
+  // The objects marked by the collection are the live ones.
+  live_stats stats = { counts, bytes };
+  GC_call_with_alloc_lock(enumerate_live_objects, &stats);
+}
+
+template<>
+string<char16_t>::string(const char* s) : string(s, strlen(s)) {
+}
+
+any_ref::any_ref(const char* s) : any_ref(s, strlen(s)) {
 }
 
 double_data* double_data::alloc(double d) {
-  double_data* ret = reinterpret_cast<double_data*>(GC_MALLOC_ATOMIC(sizeof (double_data)));
+  double_data* ret = reinterpret_cast<double_data*>(alloc_heap_data_atomic(kTagDouble, sizeof (double_data)));
   if (!ret) return nullptr;
   ret->tag_ = kTagDouble;
   ret->data_ = d;
@@ -86,11 +527,172 @@ double_data* double_data::alloc(double d) {
 
 string_data_base* string_data_base::alloc_(size_t n, size_t charsize) {
   size_t size = sizeof(string_data_base) + n * charsize;
-  string_data_base* ret = reinterpret_cast<string_data_base*>(GC_MALLOC_ATOMIC(size));
+  string_data_base* ret = reinterpret_cast<string_data_base*>(alloc_heap_data_atomic(kTagU16String, size));
+  if (!ret) return nullptr;
+  ret->length_ = n;
+  ret->hash_ = 0;
+  ret->atom_ = false;
+  ret->kind_ = kFlat;
+  ret->one_byte_ = charsize == 1;
+  return ret;
+}
+
+static heap_layout rope_layout;
+static heap_layout slice_layout;
+
+static void init_layouts() {
+  // The same descriptors as the collector's own kinds for scanned and
+  // atomic blocks; scanned blocks are cleared.
+  heap_kind = GC_new_kind(GC_new_free_list(), GC_DS_LENGTH, 1, 1);
+  heap_atomic_kind = GC_new_kind(GC_new_free_list(), GC_DS_LENGTH, 0, 0);
+  u16string_data::describe_layouts(rope_layout, slice_layout);
+  rope_layout.commit();
+  slice_layout.commit();
+}
+
+string_data_base* string_data_base::alloc_indirect_(size_t n, size_t partsize, kind k, bool one_byte) {
+  // Unlike flat strings, ropes and slices point to other strings and must
+  // be scanned.
+  heap_layout& layout = k == kRope ? rope_layout : slice_layout;
+  assert(layout.size() == sizeof (string_data_base) + partsize);
+  string_data_base* ret = reinterpret_cast<string_data_base*>(alloc_heap_data(kTagU16String, layout));
   if (!ret) return nullptr;
   ret->length_ = n;
+  ret->hash_ = 0;
+  ret->atom_ = false;
+  ret->kind_ = k;
+  ret->one_byte_ = one_byte;
   return ret;
 }
 
+static u16string_data* char_strings[256];
+
+u16string char_string(char16_t c) {
+  if (c >= 256) return u16string(&c, 1);
+  if (!char_strings[c]) {
+    u16string s = intern(u16string(&c, 1));
+    char_strings[c] = const_cast<u16string_data*>(s.get__());
+  }
+  return char_strings[c];
+}
+
+// Shapes are shared by all contexts, so the atom table is process-wide too.
+// The table is weak, so that keys no longer used, such as generated ones,
+// don't stay alive for the life of the process. Like the guard table, it
+// is outside the GC heap: each atom is a disappearing link, which the
+// collector clears once nothing else refers to the atom. Links are
+// allocated in chunks that never move, and found through an open
+// addressing index of link numbers, which drops the cleared ones whenever
+// it is rebuilt to grow.
+namespace {
+
+const size_t kAtomChunkSize = 4096;
+const size_t kMinAtomIndexSize = 1024;
+
+struct atom_entry {
+  // Link number plus one, or 0 for an empty entry.
+  uint32_t link;
+  uint32_t hash;
+};
+
+std::vector<GC_hidden_pointer*> atom_chunks;
+uint32_t num_atom_links = 0;
+// Links cleared by the collector, to be reused.
+std::vector<uint32_t> free_atom_links;
+std::vector<atom_entry> atom_index;
+size_t atom_index_used = 0;
+
+GC_hidden_pointer* atom_link(uint32_t i) {
+  return &atom_chunks[i / kAtomChunkSize][i % kAtomChunkSize];
+}
+
+// Reads a link without locking the collector. The collector isn't built
+// for threads and only collects from allocations on this thread, so a
+// link can't be cleared between reading it and holding the atom, which
+// keeps it alive from then on.
+u16string_data* reveal_atom(uint32_t i) {
+  GC_hidden_pointer v = *atom_link(i);
+  return v ? static_cast<u16string_data*>(GC_REVEAL_POINTER(v)) : nullptr;
+}
+
+void insert_atom_entry(atom_entry e) {
+  size_t mask = atom_index.size() - 1;
+  size_t i = e.hash & mask;
+  while (atom_index[i].link) i = (i + 1) & mask;
+  atom_index[i] = e;
+  atom_index_used++;
+}
+
+// Rebuilds the index with room for one more atom, freeing the links of
+// the collected ones.
+void grow_atom_index() {
+  size_t live = 0;
+  for (size_t i = 0; i < atom_index.size(); i++) {
+    if (atom_index[i].link && *atom_link(atom_index[i].link - 1)) live++;
+  }
+  size_t size = kMinAtomIndexSize;
+  while ((live + 1) * 4 > size) size *= 2;
+  std::vector<atom_entry> old(size, atom_entry());
+  old.swap(atom_index);
+  atom_index_used = 0;
+  for (size_t i = 0; i < old.size(); i++) {
+    if (!old[i].link) continue;
+    if (*atom_link(old[i].link - 1)) {
+      insert_atom_entry(old[i]);
+    } else {
+      free_atom_links.push_back(old[i].link - 1);
+    }
+  }
+}
+
+uint32_t alloc_atom_link() {
+  if (!free_atom_links.empty()) {
+    uint32_t i = free_atom_links.back();
+    free_atom_links.pop_back();
+    return i;
+  }
+  if (num_atom_links == atom_chunks.size() * kAtomChunkSize) {
+    void* chunk = calloc(kAtomChunkSize, sizeof (GC_hidden_pointer));
+    if (!chunk) return UINT32_MAX;
+    atom_chunks.push_back(static_cast<GC_hidden_pointer*>(chunk));
+  }
+  return num_atom_links++;
+}
+
+}  // namespace
+
+u16string find_atom(u16string s) {
+  if (s.is_atom()) return s;
+  if (atom_index.empty()) return nullptr;
+  uint32_t h = s.hash();
+  size_t mask = atom_index.size() - 1;
+  for (size_t i = h & mask; atom_index[i].link; i = (i + 1) & mask) {
+    const atom_entry& e = atom_index[i];
+    if (e.hash != h) continue;
+    u16string_data* atom = reveal_atom(e.link - 1);
+    if (atom && atom->equals(s.get__())) return atom;
+  }
+  return nullptr;
+}
+
+u16string intern(u16string s) {
+  u16string atom = find_atom(s);
+  if (!!atom) return atom;
+  // An atom lives as long as it is used, so it mustn't keep the halves of
+  // a rope or the parent of a slice alive.
+  s = s.get__()->flattened();
+  if (!s) return nullptr;
+  if ((atom_index_used + 1) * 2 > atom_index.size()) grow_atom_index();
+  uint32_t link = alloc_atom_link();
+  if (link == UINT32_MAX) return nullptr;
+  u16string_data* data = const_cast<u16string_data*>(s.get__());
+  *atom_link(link) = GC_HIDE_POINTER(data);
+  GC_GENERAL_REGISTER_DISAPPEARING_LINK(reinterpret_cast<void**>(atom_link(link)), GC_base(data));
+  data->atom_ = true;
+  atom_entry e = { link + 1, s.hash() };
+  insert_atom_entry(e);
+  return s;
+}
+
 }  // namespace internal
 }  // namespace nabla
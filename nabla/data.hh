@@ -8,31 +8,49 @@
 #define NABLA_DATA_HH_
 
 #include "coll.hh"
+#include "strops.hh"
 
 #include <cassert>
 #include <cinttypes>
 #include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string>
 
 namespace nabla {
 namespace internal {
 
-void init();
+// With incremental, the collector marks a little at a time during
+// allocation instead of stopping the world for the whole heap, and collects
+// young objects more often than old ones. It finds the pages written since
+// the last step through its own dirty bits, so no write barrier is needed.
+void init(bool incremental);
 void getmeminfo(size_t& heap_size, size_t& free_bytes);
 void gc();
+// Counts of the pauses seen by allocations and gc(). Bucket i holds the
+// pauses of kMinPauseMicros << i microseconds up to twice that, and the last
+// one longer pauses too.
+const uint64_t kMinPauseMicros = 50;
+const size_t kNumPauseBuckets = 16;
+void get_pause_histogram(size_t* buckets);
+// Total and longest time of the pauses above.
+void get_pause_times(uint64_t& total_micros, uint64_t& max_micros);
+// With NABLA_GC_GUARD, returns the first block allocated by gc_malloc whose
+// canary was overwritten, and otherwise nullptr.
+void* find_overrun();
+// Bytes spent on the headers and canaries of the live blocks in guard mode.
+size_t get_guard_bytes();
 
 class heap_data;
-class bool_data;
 template<typename charT> class string_data;
 typedef string_data<char16_t> u16string_data;
+template<typename charT> class string;
 class Object;
 
 class heap_data {
  public:
   enum tag {
-    kTagUndefined = 0,
-    kTagNull,
-    kTagBool,
-    kTagU16String,
+    kTagU16String = 0,
     kTagDouble,
     kTagObject,
     kTagContext,
@@ -42,23 +60,16 @@ class heap_data {
     kTagDate,
     kTagRegExp,
     kTagDeclarativeEnvironment,
-    kTagObjectEnvironment
+    kTagObjectEnvironment,
+    kTagShape
   };
-
- protected:
-  static const int undefined_index_ = 0;
-  static const int nullvalue_index_ = 1;
-  static const int true_index_ = 2;
-  static const int false_index_ = 3;
-  static heap_data value_table_[4];
+  static const int kNumTags = kTagShape + 1;
 
  public:
-  bool is_undefined() const { return tag_ == kTagUndefined; }
-  bool is_null() const { return tag_ == kTagNull; }
-  bool is_bool() const { return tag_ == kTagBool; }
   bool is_u16string() const { return tag_ == kTagU16String; }
   bool is_double() const { return tag_ == kTagDouble; }
   bool is_object() const { return tag_ == kTagObject; }
+  tag get_tag() const { return tag_; }
 
   template <typename objectT>
   bool is() const { return tag_ == objectT::class_tag; }
@@ -71,103 +82,336 @@ class heap_data {
 
  protected:
   tag tag_;
-
- private:
-  friend void init();
 };
 
-class undefined_data : public heap_data {
+// Blocks of heap objects of up to kMaxCachedSize bytes come from caches kept
+// per size class and refilled in batches from the collector, which saves
+// taking the collector's lock and looking up the size on each allocation.
+// Every allocation is counted under its tag. Blocks are cleared unless they
+// are atomic, and always start at the object, so finalizers can be
+// registered on them; guard mode doesn't apply to them.
+const size_t kMaxCachedSize = 256;
+void* alloc_heap_data(heap_data::tag t, size_t n);
+// The block is not scanned by the collector.
+void* alloc_heap_data_atomic(heap_data::tag t, size_t n);
+
+// The words of a fixed-size heap object that may point into the GC heap.
+// Objects allocated with a layout are scanned precisely: their lengths,
+// hashes and flags, and pointers to memory the collector doesn't manage,
+// are neither followed nor able to keep anything alive. Each layout becomes
+// a kind of block in the collector with its own cache of blocks, so
+// layouts must be statics, which the collector scans.
+class heap_layout {
  public:
-  static const tag class_tag = kTagUndefined;
-  static undefined_data* alloc();
-};
+  // Starts the layout of objects of size bytes. The first word, which
+  // holds the tag, is always scanned because it links the cached blocks.
+  void init(size_t size) {
+    assert(size <= kMaxCachedSize);
+    size_ = size;
+    pointers_ = 1;
+    kind_ = 0;
+    free_list_ = nullptr;
+  }
+  // Marks the words of the field f of the object at o as possible
+  // pointers. o is only used for the offset and needn't be constructed.
+  template <typename objectT, typename fieldT>
+  void add(const objectT* o, const fieldT* f) {
+    size_t offset = reinterpret_cast<const char*>(f) - reinterpret_cast<const char*>(o);
+    assert(offset % sizeof (void*) == 0 && offset + sizeof (fieldT) <= size_);
+    for (size_t i = 0; i < (sizeof (fieldT) + sizeof (void*) - 1) / sizeof (void*); i++) {
+      pointers_ |= static_cast<uint64_t>(1) << (offset / sizeof (void*) + i);
+    }
+  }
+  // Registers the layout with the collector. Until then objects allocated
+  // with it are scanned conservatively.
+  void commit();
+  size_t size() const { return size_; }
+  bool is_pointer(size_t word) const { return (pointers_ >> word) & 1; }
+  // The collector's kind for the blocks, or 0 before commit().
+  unsigned kind() const { return kind_; }
+  // Leaves the cached blocks to the collector.
+  void drop_cache() { free_list_ = nullptr; }
 
-class null_data : public heap_data {
- public:
-  static const tag class_tag = kTagNull;
-  static null_data* alloc();
-};
+ private:
+  friend void* alloc_heap_data(heap_data::tag t, heap_layout& layout);
 
-class bool_data : public heap_data {
- public:
-  static const tag class_tag = kTagBool;
-  static bool_data* alloc(bool b);
-  bool data() { return this == &heap_data::value_table_[heap_data::true_index_]; }
+  size_t size_;
+  uint64_t pointers_;
+  unsigned kind_;
+  void* free_list_;
 };
 
+void* alloc_heap_data(heap_data::tag t, heap_layout& layout);
+
+const char* tag_name(heap_data::tag t);
+// The number and total size of the objects allocated with each tag since
+// init(), and how many of them the size-class caches served.
+void get_alloc_stats(size_t* counts, size_t* bytes, size_t& cached, size_t& refills);
+// The number and total size of the live objects with each tag. Runs a full
+// collection to find them.
+void get_live_objects(size_t* counts, size_t* bytes);
+
+// Called for allocations picked about once every interval bytes, with the
+// number of allocations of that size each one stands for. It must not
+// allocate in the GC heap.
+typedef void (*alloc_sampler)(heap_data::tag t, size_t n, double weight);
+// Starts calling sampler, or stops sampling if it is nullptr.
+void set_alloc_sampler(alloc_sampler sampler, size_t interval);
+
 class string_data_base : public heap_data {
+ public:
+  enum kind {
+    // Characters follow the header.
+    kFlat,
+    // Two halves follow the header; see string_data::rope_parts.
+    kRope,
+    // A range of a flat string follows the header; see
+    // string_data::slice_parts.
+    kSlice
+  };
+
+  // Atoms are the unique strings registered by intern(). Two different
+  // atoms never have the same characters.
+  bool is_atom() const { return atom_; }
+  bool is_rope() const { return kind_ == kRope; }
+  bool is_slice() const { return kind_ == kSlice; }
+  // One-byte strings store each code unit, all of which are at most 0xff,
+  // in a single byte. Ropes and slices have the width of their characters.
+  bool is_one_byte() const { return one_byte_; }
+
  protected:
   size_t length_;
+  mutable uint32_t hash_;
+  bool atom_;
+  uint8_t kind_;
+  bool one_byte_;
+
+  friend string<char16_t> intern(string<char16_t> s);
 
   static string_data_base* alloc_(size_t n, size_t charsize);
+  static string_data_base* alloc_indirect_(size_t n, size_t partsize, kind k, bool one_byte);
 };
 
 template <typename charT>
 class string_data : public string_data_base {
  public:
   static const tag class_tag = kTagU16String;
+  // Flat one-byte strings are laid out as string_data<char> and read through
+  // the same handle type as two-byte strings.
+  typedef string_data<char> one_byte_type;
+
+  // Describes ropes, which point to their halves, and slices, which point
+  // to their parent. Flat strings have no pointers and are atomic.
+  static void describe_layouts(heap_layout& rope, heap_layout& slice) {
+    alignas(string_data) char buf[sizeof (string_data) + sizeof (rope_parts) + sizeof (slice_parts)];
+    const string_data* s = reinterpret_cast<const string_data*>(buf);
+    rope.init(sizeof (string_data) + sizeof (rope_parts));
+    rope.add(s, &s->parts()->first);
+    rope.add(s, &s->parts()->second);
+    slice.init(sizeof (string_data) + sizeof (slice_parts));
+    slice.add(s, &s->slice()->parent);
+  }
 
  public:
+  // Allocates a flat string of n units of charT to be filled in with data().
   static string_data* alloc(size_t n) {
-    string_data* ret = reinterpret_cast<string_data*>(alloc_(n, sizeof (charT)));
-    ret->tag_ = kTagU16String;
-    return ret;
+    return alloc_flat(n, sizeof (charT) == 1);
   }
 
+  // Allocates a flat copy of s, one byte per code unit when they all fit.
   template <typename charS>
   static string_data* alloc(const charS* s, size_t n) {
-    string_data* ret = alloc(n);
-    ret->set(0, s, n);
+    bool one_byte = true;
+    for (size_t i = 0; i < n && one_byte; i++) {
+      one_byte = static_cast<charT>(s[i]) <= 0xff;
+    }
+    string_data* ret = alloc_flat(n, one_byte);
+    if (!ret) return nullptr;
+    if (one_byte) {
+      uint8_t* d = ret->one_byte_chars();
+      for (size_t i = 0; i < n; i++) d[i] = static_cast<uint8_t>(static_cast<charT>(s[i]));
+    } else {
+      charT* d = ret->chars();
+      for (size_t i = 0; i < n; i++) d[i] = static_cast<charT>(s[i]);
+    }
     return ret;
   }
 
   static string_data* alloc() {
-    string_data* ret = alloc(0);
+    string_data* ret = alloc_flat(0, true);
     return ret;
   }
 
+  // Results shorter than kMinRopeLength are copied into a flat string.
+  // Longer ones become ropes, which are flattened the first time their
+  // characters are needed or once they are deeper than kMaxRopeDepth.
+  static const size_t kMinRopeLength = 13;
+  static const uint32_t kMaxRopeDepth = 1024;
+
   string_data* concat(const string_data* s) const {
     size_t n1 = length_;
     size_t n2 = s->length_;
-    string_data* ret = alloc(n1 + n2);
-    ret->set(0, data(), n1);
-    ret->set(n1, s->data(), n2);
+    bool one_byte = one_byte_ && s->one_byte_;
+    if (n1 + n2 < kMinRopeLength) {
+      string_data* ret = alloc_flat(n1 + n2, one_byte);
+      if (!ret) return nullptr;
+      if (one_byte) {
+        copy_to(0, n1, ret->one_byte_chars());
+        s->copy_to(0, n2, ret->one_byte_chars() + n1);
+      } else {
+        copy_to(0, n1, ret->chars());
+        s->copy_to(0, n2, ret->chars() + n1);
+      }
+      return ret;
+    }
+    string_data* ret = reinterpret_cast<string_data*>(alloc_indirect_(n1 + n2, sizeof (rope_parts), kRope, one_byte));
+    if (!ret) return nullptr;
+    ret->tag_ = kTagU16String;
+    rope_parts* r = ret->parts();
+    r->first = this;
+    r->second = s;
+    uint32_t d1 = depth();
+    uint32_t d2 = s->depth();
+    r->depth = (d1 > d2 ? d1 : d2) + 1;
+    if (r->depth > kMaxRopeDepth) ret->flatten();
     return ret;
   }
 
-  template <typename charS>
-  bool equals(const string_data<charS>* other) const {
+  // Results of kMinSliceLength or more characters share the characters of
+  // this string, unless they are less than 1/kMaxSliceRatio of it and would
+  // keep much more alive than they use.
+  static const size_t kMinSliceLength = 13;
+  static const size_t kMaxSliceRatio = 16;
+
+  const string_data* substring(size_t start, size_t n) const {
+    assert(start + n <= length_);
+    if (start == 0 && n == length_) return this;
+    size_t offset;
+    const string_data* base = flat(offset);
+    if (n < kMinSliceLength || n * kMaxSliceRatio < base->length_) {
+      string_data* ret = alloc_flat(n, one_byte_);
+      if (!ret) return nullptr;
+      if (one_byte_) {
+        copy_to(start, n, ret->one_byte_chars());
+      } else {
+        copy_to(start, n, ret->chars());
+      }
+      return ret;
+    }
+    string_data* ret = reinterpret_cast<string_data*>(alloc_indirect_(n, sizeof (slice_parts), kSlice, one_byte_));
+    if (!ret) return nullptr;
+    ret->tag_ = kTagU16String;
+    ret->slice()->parent = base;
+    ret->slice()->offset = offset + start;
+    return ret;
+  }
+
+  bool equals(const string_data* other) const {
     if (this == other) return true;
+    if (atom_ && other->atom_) return false;
     size_t len = length_;
     if (len != other->length_) return false;
-    const charS *s = other->data();
-    const charT *t = data();
-    while (len--) {
-      if (*s++ != *t++) return false;
+    size_t o1, o2;
+    const string_data* a = flat(o1);
+    const string_data* b = other->flat(o2);
+    if (a->one_byte_ == b->one_byte_) {
+      size_t n = a->one_byte_ ? len : len * sizeof (charT);
+      return memcmp(a->units(o1), b->units(o2), n) == 0;
     }
-    return true;
+    return mismatch_units(a, o1, b, o2, len) == len;
   }
 
-  template <typename charS>
-  int compare(const string_data<charS>* other) const {
+  int compare(const string_data* other) const {
     if (this == other) return 0;
     size_t len = length_ < other->length_ ? length_ : other->length_;
-    const charS *s = other->data();
-    const charT *t = data();
-    while (len--) {
-      int diff = (*s++) - (*t++);
-      if (diff != 0) return diff;
-    }
+    size_t o1, o2;
+    const string_data* a = flat(o1);
+    const string_data* b = other->flat(o2);
+    size_t i = mismatch_units(a, o1, b, o2, len);
+    if (i < len) return other->at(i) - at(i);
     return length_ - other->length_;
   }
 
-  uint32_t hash() const {
-    uint32_t hash = 0;
-    const charT *p = data();
-    for (size_t i = 0; i < length_; i++) {
-      hash = (hash << 6) + hash + p[i];
+  // Returns the index of the first occurrence of s at or after from, or -1.
+  ptrdiff_t index_of(const string_data* s, size_t from) const {
+    if (from > length_) return -1;
+    size_t o1, o2;
+    const string_data* a = flat(o1);
+    const string_data* b = s->flat(o2);
+    size_t m = s->length_;
+    size_t r;
+    if (a->one_byte_) {
+      const uint8_t* haystack = a->one_byte_chars() + o1 + from;
+      if (b->one_byte_) {
+        r = strops::find(haystack, length_ - from, b->one_byte_chars() + o2, m);
+      } else {
+        r = strops::find(haystack, length_ - from, b->chars() + o2, m);
+      }
+    } else {
+      const charT* haystack = a->chars() + o1 + from;
+      if (b->one_byte_) {
+        r = strops::find(haystack, length_ - from, b->one_byte_chars() + o2, m);
+      } else {
+        r = strops::find(haystack, length_ - from, b->chars() + o2, m);
+      }
     }
-    return hash;
+    return r == strops::npos ? -1 : static_cast<ptrdiff_t>(r + from);
+  }
+
+  // Returns the index of the last occurrence of s that starts at or before
+  // from, or -1.
+  ptrdiff_t last_index_of(const string_data* s, size_t from) const {
+    size_t o1, o2;
+    const string_data* a = flat(o1);
+    const string_data* b = s->flat(o2);
+    size_t m = s->length_;
+    size_t r;
+    if (a->one_byte_) {
+      const uint8_t* haystack = a->one_byte_chars() + o1;
+      if (b->one_byte_) {
+        r = strops::rfind(haystack, length_, b->one_byte_chars() + o2, m, from);
+      } else {
+        r = strops::rfind(haystack, length_, b->chars() + o2, m, from);
+      }
+    } else {
+      const charT* haystack = a->chars() + o1;
+      if (b->one_byte_) {
+        r = strops::rfind(haystack, length_, b->one_byte_chars() + o2, m, from);
+      } else {
+        r = strops::rfind(haystack, length_, b->chars() + o2, m, from);
+      }
+    }
+    return r == strops::npos ? -1 : static_cast<ptrdiff_t>(r);
+  }
+
+  // Returns a flat string with the characters of this one: itself, the
+  // flat copy a rope keeps once flattened, or a copy of the range of a
+  // slice, so that holding the result doesn't keep the parent alive.
+  const string_data* flattened() const {
+    if (kind_ == kFlat) return this;
+    if (kind_ == kRope) {
+      flatten();
+      return parts()->first;
+    }
+    string_data* ret = alloc_flat(length_, one_byte_);
+    if (!ret) return nullptr;
+    if (one_byte_) {
+      copy_to(0, length_, ret->one_byte_chars());
+    } else {
+      copy_to(0, length_, ret->chars());
+    }
+    return ret;
+  }
+
+  // Maps ASCII letters to lower or upper case. Other characters are kept.
+  string_data* to_lower() const { return convert_case(false); }
+  string_data* to_upper() const { return convert_case(true); }
+
+  // Strings are immutable, so the hash is computed once and kept in the
+  // header. 0 means it hasn't been computed yet.
+  uint32_t hash() const {
+    if (!hash_) hash_ = compute_hash();
+    return hash_;
   }
 
 
@@ -180,17 +424,239 @@ class string_data : public string_data_base {
     while (n--) *d++ = *s++;
   }
 
+  // Only valid on two-byte flat strings that are still being filled in.
   charT* data() {
-    uint8_t* p = reinterpret_cast<uint8_t*>(this) + sizeof *this;
-    return reinterpret_cast<charT*>(p);
+    assert(kind_ == kFlat && (!one_byte_ || sizeof (charT) == 1));
+    return chars();
   }
 
-  const charT* data() const {
-    const uint8_t* p = reinterpret_cast<const uint8_t*>(this) + sizeof *this;
-    return reinterpret_cast<const charT*>(p);
+  // Returns the code units as charT, for code that needs them in one
+  // buffer. A one-byte string is widened into buf, so the result is only
+  // valid as long as buf is unchanged. Code that only reads characters
+  // should use at() or one_byte_data() instead.
+  const charT* data(std::basic_string<charT>& buf) const {
+    size_t offset;
+    const string_data* f = flat(offset);
+    if (!f->one_byte_ || sizeof (charT) == 1) return f->chars() + offset;
+    buf.resize(length_);
+    copy_to(0, length_, &buf[0]);
+    return buf.data();
+  }
+
+  // Only valid when is_one_byte().
+  const uint8_t* one_byte_data() const {
+    assert(one_byte_);
+    size_t offset;
+    const string_data* f = flat(offset);
+    return f->one_byte_chars() + offset;
+  }
+
+  charT at(size_t i) const {
+    size_t offset;
+    const string_data* f = flat(offset);
+    if (f->one_byte_) return f->one_byte_chars()[offset + i];
+    return f->chars()[offset + i];
+  }
+
+  // Copies n code units starting at start to dst, which may be narrower
+  // than charT if the copied units fit.
+  template <typename charD>
+  void copy_to(size_t start, size_t n, charD* dst) const {
+    size_t offset;
+    const string_data* f = flat(offset);
+    offset += start;
+    if (f->one_byte_) {
+      const uint8_t* src = f->one_byte_chars() + offset;
+      for (size_t i = 0; i < n; i++) dst[i] = src[i];
+    } else {
+      const charT* src = f->chars() + offset;
+      for (size_t i = 0; i < n; i++) dst[i] = static_cast<charD>(src[i]);
+    }
   }
 
   size_t length() const { return length_; }
+
+  // Returns the strings this one points to without flattening it: the
+  // halves of a rope, second being nullptr once it was flattened, or the
+  // parent of a slice. Both are nullptr for flat strings.
+  void get_parts(const string_data*& first, const string_data*& second) const {
+    first = second = nullptr;
+    if (kind_ == kRope) {
+      first = parts()->first;
+      second = parts()->second;
+    } else if (kind_ == kSlice) {
+      first = slice()->parent;
+    }
+  }
+
+ private:
+  // A rope node has no characters of its own. Flattening replaces first with
+  // a flat copy of the whole string and clears second, so that the halves can
+  // be collected.
+  struct rope_parts {
+    const string_data* first;
+    const string_data* second;
+    uint32_t depth;
+  };
+
+  // The parent of a slice is always flat.
+  struct slice_parts {
+    const string_data* parent;
+    size_t offset;
+  };
+
+  static string_data* alloc_flat(size_t n, bool one_byte) {
+    string_data* ret = reinterpret_cast<string_data*>(alloc_(n, one_byte ? 1 : sizeof (charT)));
+    if (!ret) return nullptr;
+    ret->tag_ = kTagU16String;
+    return ret;
+  }
+
+  // Returns the index of the first of n units that differ between a and b,
+  // starting at o1 and o2. Both must be flat.
+  static size_t mismatch_units(const string_data* a, size_t o1, const string_data* b, size_t o2, size_t n) {
+    if (a->one_byte_) {
+      if (b->one_byte_) return strops::mismatch(a->one_byte_chars() + o1, b->one_byte_chars() + o2, n);
+      return strops::mismatch(a->one_byte_chars() + o1, b->chars() + o2, n);
+    } else {
+      if (b->one_byte_) return strops::mismatch(b->one_byte_chars() + o2, a->chars() + o1, n);
+      return strops::mismatch(a->chars() + o1, b->chars() + o2, n);
+    }
+  }
+
+  string_data* convert_case(bool upper) const {
+    size_t offset;
+    const string_data* f = flat(offset);
+    string_data* ret = alloc_flat(length_, one_byte_);
+    if (!ret) return nullptr;
+    if (one_byte_) {
+      const uint8_t* src = f->one_byte_chars() + offset;
+      if (upper) {
+        strops::to_upper(src, ret->one_byte_chars(), length_);
+      } else {
+        strops::to_lower(src, ret->one_byte_chars(), length_);
+      }
+    } else {
+      const charT* src = f->chars() + offset;
+      if (upper) {
+        strops::to_upper(src, ret->chars(), length_);
+      } else {
+        strops::to_lower(src, ret->chars(), length_);
+      }
+    }
+    return ret;
+  }
+
+  const void* units(size_t offset) const {
+    if (one_byte_) return one_byte_chars() + offset;
+    return chars() + offset;
+  }
+
+  slice_parts* slice() const {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(this) + sizeof *this;
+    return reinterpret_cast<slice_parts*>(const_cast<uint8_t*>(p));
+  }
+
+  rope_parts* parts() const {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(this) + sizeof *this;
+    return reinterpret_cast<rope_parts*>(const_cast<uint8_t*>(p));
+  }
+
+  charT* chars() const {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(this) + sizeof *this;
+    return reinterpret_cast<charT*>(const_cast<uint8_t*>(p));
+  }
+
+  uint8_t* one_byte_chars() const {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(this) + sizeof *this;
+    return const_cast<uint8_t*>(p);
+  }
+
+  // Returns the flat string holding the characters and sets offset to the
+  // index of the first one in it.
+  const string_data* flat(size_t& offset) const {
+    offset = 0;
+    if (kind_ == kRope) {
+      flatten();
+      return parts()->first;
+    } else if (kind_ == kSlice) {
+      offset = slice()->offset;
+      return slice()->parent;
+    }
+    return this;
+  }
+
+  uint32_t depth() const {
+    if (kind_ != kRope) return 0;
+    const rope_parts* r = parts();
+    return r->second ? r->depth : 0;
+  }
+
+  void flatten() const {
+    rope_parts* r = parts();
+    if (!r->second) return;
+    string_data* flat = alloc_flat(length_, one_byte_);
+    if (one_byte_) {
+      flatten_into(flat->one_byte_chars());
+    } else {
+      flatten_into(flat->chars());
+    }
+    r->first = flat;
+    r->second = nullptr;
+  }
+
+  template <typename charD>
+  void flatten_into(charD* dst) const {
+    // Copy the leaves from right to left. A pending entry is only pushed for
+    // the left half of a rope whose right half is being walked, so the stack
+    // never holds more than the depth of the rope plus one.
+    const string_data* stack[kMaxRopeDepth + 2];
+    size_t sp = 0;
+    size_t end = length_;
+    stack[sp++] = this;
+    while (sp > 0) {
+      const string_data* node = stack[--sp];
+      if (node->kind_ == kRope && node->parts()->second) {
+        const rope_parts* np = node->parts();
+        stack[sp++] = np->first;
+        stack[sp++] = np->second;
+        continue;
+      }
+      size_t n = node->length_;
+      end -= n;
+      node->copy_to(0, n, dst + end);
+    }
+    assert(end == 0);
+  }
+
+  template <typename charU>
+  static uint32_t hash_units(const charU* p, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+      h = (h ^ static_cast<uint32_t>(p[i])) * 16777619u;
+    }
+    return h;
+  }
+
+  // FNV-1a over the code units followed by the MurmurHash3 finalizer, which
+  // spreads the bits of similar keys into the low bits used by hash tables.
+  // Both widths hash the same characters to the same value.
+  uint32_t compute_hash() const {
+    size_t offset;
+    const string_data* f = flat(offset);
+    uint32_t h;
+    if (f->one_byte_) {
+      h = hash_units(f->one_byte_chars() + offset, length_);
+    } else {
+      h = hash_units(f->chars() + offset, length_);
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h ? h : 1;
+  }
 };
 
 class double_data : public heap_data {
@@ -217,46 +683,140 @@ class string {
   string(const char* s);
   string(std::nullptr_t) : ptr_(nullptr) {}
 
-  const charT* data() const { return ptr_->data(); }
-  const charT* begin() const { return ptr_->data(); }
-  const charT* end() const { return ptr_->data() + ptr_->length(); }
+  // Reads code units by index, so that iterating doesn't widen one-byte
+  // strings.
+  class const_iterator {
+   public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef charT value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const charT* pointer;
+    typedef charT reference;
+
+    const_iterator(const string_data<charT>* s, size_t i) : s_(s), i_(i) {}
+    charT operator * () const { return s_->at(i_); }
+    charT operator [] (difference_type n) const { return s_->at(i_ + n); }
+    const_iterator& operator ++ () { ++i_; return *this; }
+    const_iterator operator ++ (int) { const_iterator t = *this; ++i_; return t; }
+    const_iterator& operator -- () { --i_; return *this; }
+    const_iterator operator -- (int) { const_iterator t = *this; --i_; return t; }
+    const_iterator& operator += (difference_type n) { i_ += n; return *this; }
+    const_iterator& operator -= (difference_type n) { i_ -= n; return *this; }
+    const_iterator operator + (difference_type n) const { return const_iterator(s_, i_ + n); }
+    const_iterator operator - (difference_type n) const { return const_iterator(s_, i_ - n); }
+    difference_type operator - (const const_iterator& o) const { return i_ - o.i_; }
+    bool operator == (const const_iterator& o) const { return i_ == o.i_; }
+    bool operator != (const const_iterator& o) const { return i_ != o.i_; }
+    bool operator < (const const_iterator& o) const { return i_ < o.i_; }
+
+   private:
+    const string_data<charT>* s_;
+    size_t i_;
+  };
+
+  const charT* data(std::basic_string<charT>& buf) const { return ptr_->data(buf); }
+  const_iterator begin() const { return const_iterator(ptr_, 0); }
+  const_iterator end() const { return const_iterator(ptr_, ptr_->length()); }
   size_t length() const { return ptr_->length(); }
   const value_type* get__() const { return ptr_; }
-  const charT& operator [] (size_t n) const { return ptr_->data()[n]; }
+  charT operator [] (size_t n) const { return ptr_->at(n); }
   bool operator == (const string& other) const { return ptr_->equals(other.ptr_); }
   bool operator != (const string& other) const { return !(*this == other); }
   string operator + (const string& other) const { return ptr_->concat(other.ptr_); }
   bool is_nil() const { return ptr_ == nullptr; }
   bool operator ! () const { return is_nil(); }
   uint32_t hash() const { return ptr_->hash(); }
+  bool is_atom() const { return ptr_->is_atom(); }
+  string substring(size_t start, size_t n) const { return ptr_->substring(start, n); }
+  ptrdiff_t index_of(const string& s, size_t from = 0) const { return ptr_->index_of(s.ptr_, from); }
+  ptrdiff_t last_index_of(const string& s, size_t from) const { return ptr_->last_index_of(s.ptr_, from); }
+  string to_lower() const { return ptr_->to_lower(); }
+  string to_upper() const { return ptr_->to_upper(); }
  private:
   const value_type* ptr_;
 };
 
 typedef string<char16_t> u16string;
 
+// Returns the atom with the characters of s, registering s itself as the
+// atom if there is none yet, or a flat copy of it if s is a rope or a
+// slice. Property keys are atoms so that they can be compared by pointer.
+// The table of atoms is weak, so atoms nothing refers to are collected.
+u16string intern(u16string s);
+// Returns the atom with the characters of s, or nil if there is none.
+u16string find_atom(u16string s);
+// Returns the string of the single character c. Strings of the first 256
+// characters are cached and never allocated again.
+u16string char_string(char16_t c);
+
+#if defined(NABLA_NAN_BOXING)
+
+// NaN-boxed layout. Every value is a 64-bit word and the top 16 bits select
+// the kind:
+//
+//   0x0000 | 48-bit pointer    heap_data* (nil is 0)
+//   0x0001 .. 0xfff1           double, stored as its bits + 2^48
+//   0xffff | 32-bit integer    SMI
+//
+// undefined, null and booleans use the same immediate words as the default
+// layout below; they have the top 16 bits clear but are never aligned.
+// All NaNs are canonicalised first so that no double lands in the SMI range.
+
+#if __SIZEOF_POINTER__ != 8
+#error "NABLA_NAN_BOXING requires 64-bit pointers"
+#endif
+
+#else
+
+// Default layout. SMIs have the low bit set, heap pointers have the low two
+// bits clear and doubles are boxed in double_data.
+
 #if __SIZEOF_POINTER__ > 32
 #define JS_SMI_SHIFT 32
 #else
 #define JS_SMI_SHIFT 1
 #endif
 
+#endif
+
+// undefined, null, false and true are immediate words with the low two bits
+// set to 10, so testing for them never touches memory.
+
 class any_ref {
  public:
   any_ref() { data_ = 0; }
   any_ref(std::nullptr_t) : any_ref() {}
-  any_ref(bool b);
+  any_ref(bool b) { data_ = b ? kTrueValue : kFalseValue; }
+#if defined(NABLA_NAN_BOXING)
+  any_ref(int n) { data_ = static_cast<intptr_t>(kNumberTag | static_cast<uint32_t>(n)); }
+#else
   any_ref(int n) { data_ = (static_cast<intptr_t>(n) << JS_SMI_SHIFT) | 1; }
+#endif
   any_ref(heap_data* o) { data_ = reinterpret_cast<intptr_t>(o); }
   any_ref(const u16string s) : any_ref((u16string_data*)s.get__()) {}
   template <typename charS>
   any_ref(const charS* s, size_t n) : any_ref(u16string_data::alloc(s, n)) {}
+#if defined(NABLA_NAN_BOXING)
+  any_ref(double d) {
+    uint64_t bits = kCanonicalNaN;
+    if (d == d) memcpy(&bits, &d, sizeof bits);
+    data_ = static_cast<intptr_t>(bits + kDoubleOffset);
+  }
+#else
   any_ref(double d) : any_ref(double_data::alloc(d)) {}
+#endif
   any_ref(const char* s);
 
+  static any_ref undefined() { return immediate(kUndefinedValue); }
+  static any_ref null() { return immediate(kNullValue); }
+
   int smi() const {
     assert(is_smi());
+#if defined(NABLA_NAN_BOXING)
+    return static_cast<int32_t>(static_cast<uint32_t>(data_));
+#else
     return static_cast<int>(data_ >> JS_SMI_SHIFT);
+#endif
   }
 
   heap_data* get() const {
@@ -265,8 +825,13 @@ class any_ref {
   }
 
   bool is_nil() const { return is_heap_data() && !get(); }
+#if defined(NABLA_NAN_BOXING)
+  bool is_smi() const { return (static_cast<uint64_t>(data_) & kNumberTag) == kNumberTag; }
+  bool is_heap_data() const { return (static_cast<uint64_t>(data_) & (kNumberTag | kImmediateMask)) == 0; }
+#else
   bool is_smi() const { return (data_ & 1) != 0; }
-  bool is_heap_data() const { return !is_smi(); }
+  bool is_heap_data() const { return (data_ & kImmediateMask) == 0; }
+#endif
 
   template <typename objectT>
   bool is() const { return !is_nil() && is_heap_data() && get()->is<objectT>(); }
@@ -275,30 +840,60 @@ class any_ref {
   template <typename objectT>
   objectT* as() const { assert(!is_nil()); return get()->as<objectT>(); }
   
-  bool is_undefined() const { return is_heap_data() && get()->is_undefined(); }
-  bool is_null() const { return is_heap_data() && get()->is_null(); }
-  bool is_u16string() const { return is_heap_data() && get()->is_u16string(); }
-  bool is_bool() const { return is_heap_data() && get()->is_bool(); }
+  bool is_undefined() const { return data_ == kUndefinedValue; }
+  bool is_null() const { return data_ == kNullValue; }
+  bool is_u16string() const { return is_heap_data() && !is_nil() && get()->is_u16string(); }
+  bool is_bool() const { return (data_ | (kTrueValue ^ kFalseValue)) == kTrueValue; }
+#if defined(NABLA_NAN_BOXING)
+  bool is_double() const { return (static_cast<uint64_t>(data_) & kNumberTag) != 0 && !is_smi(); }
+#else
   bool is_double() const { return is_heap_data() && get()->is_double(); }
+#endif
   u16string as_u16string() const {
     assert(is_u16string());
     return static_cast<u16string_data*>(get());
   }
-  double as_bool() const {
+  bool as_bool() const {
     assert(is_bool());
-    return static_cast<bool_data*>(get())->data();
+    return data_ == kTrueValue;
   }
   double as_double() const {
     assert(is_double());
+#if defined(NABLA_NAN_BOXING)
+    uint64_t bits = static_cast<uint64_t>(data_) - kDoubleOffset;
+    double d;
+    memcpy(&d, &bits, sizeof d);
+    return d;
+#else
     return static_cast<double_data*>(get())->data();
+#endif
   }
   bool operator ! () const { return is_nil(); }
 
  private:
+  static const intptr_t kImmediateMask = 3;
+  static const intptr_t kUndefinedValue = 0x02;
+  static const intptr_t kNullValue = 0x06;
+  static const intptr_t kFalseValue = 0x0a;
+  static const intptr_t kTrueValue = 0x0e;
+#if defined(NABLA_NAN_BOXING)
+  static const uint64_t kNumberTag = 0xffff000000000000ULL;
+  static const uint64_t kDoubleOffset = 0x0001000000000000ULL;
+  static const uint64_t kCanonicalNaN = 0x7ff8000000000000ULL;
+#endif
+
+  static any_ref immediate(intptr_t v) {
+    any_ref ret;
+    ret.data_ = v;
+    return ret;
+  }
+
   intptr_t data_;
 };
 
 typedef vector<any_ref> any_vector;
+// Argument lists, including this, for calls with up to 7 arguments.
+typedef vector<any_ref, 8> arg_vector;
 typedef map<u16string_data*, any_ref> any_map;
 
 }  // namespace internal
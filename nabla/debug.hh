@@ -35,9 +35,9 @@ inline std::ostream& operator << (std::ostream& os, const any_ref v) {
     } else if (v.is_null()) {
       return os << "null";
     } else if (v.is_bool()) {
-      return os << v.as<bool_data>();
+      return os << (v.as_bool() ? "true" : "false");
     } else if (v.is_double()) {
-      return os << v.as<double_data>()->data();
+      return os << v.as_double();
     } else if (v.is_u16string()) {
       u16string s = v.as<u16string_data>();
       return os << std::string(s.begin(), s.end());
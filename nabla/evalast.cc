@@ -16,20 +16,23 @@
 namespace nabla {
 namespace internal {
 
-AstEvaluator::AstEvaluator(Context *context, Script* script, any_ref this_val, bool strict)
+AstEvaluator::AstEvaluator(Context *context, Script* script, FunctionNode* function, any_ref this_val, bool strict)
     : context_(context), script_(script), cur_env_(nullptr), strict_(strict) {
   this_val_ = this_val;
-  cv_.value = undefined_data::alloc();
+  cv_.value = any_ref::undefined();
   cv_.type = CompletionSpecification::kNormal;
+  frame_.Push(script, function);
 }
 
 any_ref AstEvaluator::EvalScript(Context *context, Script* script) {
-  AstEvaluator evaluator(context, script, context->global_obj(), false);
+  AstEvaluator evaluator(context, script, nullptr, context->global_obj(), false);
   return evaluator.EvalProgram(evaluator.script_->program());
 }
 
 void AstEvaluator::EvalStatementWithLabel(Statement* stmt, const LabelList* label_list) {
   assert(stmt);
+  const SyntaxNode* saved_node = frame_.node;
+  frame_.node = stmt;
   switch (stmt->type) {
     case SyntaxNode::kEmptyStatement:
       EvalStatement_(static_cast<EmptyStatement*>(stmt));
@@ -92,19 +95,11 @@ void AstEvaluator::EvalStatementWithLabel(Statement* stmt, const LabelList* labe
       assert(false);
       break;
   }
+  frame_.node = saved_node;
 }
 
 void AstEvaluator::DefineVariable(u16string n, any_ref v) {
-  Environment* env = cur_env_;
-  assert(!!env);
-  if (cur_env_->is<DeclarativeEnvironment>()) {
-    DeclarativeEnvironment* decl_env = static_cast<DeclarativeEnvironment*>(cur_env_);
-    decl_env->CreateBinding(n, v, false, false);
-  } else {
-    assert(env->is<ObjectEnvironment>());
-    ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(env);
-    obj_env->CreateMutableBinding(context_, n, v, false);
-  }
+  nabla::internal::DefineVariable(context_, cur_env_, n, v);
 }
 
 // Programs
@@ -126,24 +121,7 @@ any_ref AstEvaluator::EvalProgram(Program* expr) {
 // Functions
 
 Object* AstEvaluator::EvalFunctionNode(FunctionNode* expr) {
-  // 13.2 Creating Function Objects
-  Object* o = Object::Alloc(context_->function_proto());
-  Function* fn = Function::Alloc();
-  fn->script = script_;
-  fn->code = expr;
-  fn->context = context_;
-  fn->scope = cur_env_;
-  fn->strict = false;
-  o->host_data = fn;
-
-  // prototype
-  Object* proto = Object::Alloc(context_->object_proto());
-  o->Put(context_, "prototype", proto, false);
-
-  // constructor
-  proto->Put(context_, "constructor", o, false);
-
-  return o;
+  return NewFunctionObject(context_, script_, cur_env_, expr);
 }
 
 // Statements
@@ -272,7 +250,7 @@ void AstEvaluator::EvalStatement_(ReturnStatement* expr) {
     if (!rval) return;
     SetCurValue(rval);
   } else {
-    SetCurValue(undefined_data::alloc());
+    SetCurValue(any_ref::undefined());
   }
   cv_.type = CompletionSpecification::kReturn;
 }
@@ -285,16 +263,25 @@ void AstEvaluator::EvalStatement_(ThrowStatement* expr) {
 }
 
 void AstEvaluator::EvalStatement_(TryStatement* expr) {
+  // 12.14 The try Statement
   EvalStatement(expr->block);
-  if (cv_.type == CompletionSpecification::kThrow) {
+  CatchClause* handler = expr->handler;
+  if (cv_.type == CompletionSpecification::kThrow && handler) {
     cv_.type = CompletionSpecification::kNormal;
-    CatchClause* handler = expr->handler;
-    if (handler) EvalCatchClause(handler);
+    EvalCatchClause(handler);
   }
   if (expr->finalizer) {
-    CompletionSpecification::Type old_type = cv_.type;
+    // The completion of the block or of the catch clause, including the
+    // exception being thrown, is set aside while the finally block runs,
+    // and stands unless the finally block completes abruptly itself.
+    CompletionSpecification saved = cv_;
+    any_ref exception = saved.type == CompletionSpecification::kThrow ? Catch() : nullptr;
+    cv_.type = CompletionSpecification::kNormal;
     EvalStatement(expr->finalizer);
-    cv_.type = old_type;
+    if (cv_.type == CompletionSpecification::kNormal) {
+      cv_ = saved;
+      if (!!exception) Throw(exception);
+    }
   }
 }
 
@@ -305,13 +292,15 @@ void AstEvaluator::EvalStatementWithLabel_(WhileStatement* expr, const LabelList
     if (!ToBoolean(tval)) break;
     EvalStatement(expr->body);
     if (!BreakOrContinueIfLabelMatch(label_list)) return;
+    StackFrame::Poll();
   }
 }
 
 void AstEvaluator::EvalStatementWithLabel_(DoWhileStatement* expr, const LabelList* label_list) {
   while (true) {
     EvalStatement(expr->body);
-    if (!BreakOrContinueIfLabelMatch(label_list)) return;    
+    if (!BreakOrContinueIfLabelMatch(label_list)) return;
+    StackFrame::Poll();
     any_ref tval = EvalExpressionAndGetCompletion(expr->test);
     if (!tval) return;
     if (!ToBoolean(tval)) break;
@@ -340,6 +329,7 @@ void AstEvaluator::EvalStatementWithLabel_(ForStatement* expr, const LabelList*
     }
     EvalStatement(expr->body);
     if (!BreakOrContinueIfLabelMatch(label_list)) return;
+    StackFrame::Poll();
     if (expr->update) {
       any_ref v = EvalExpressionAndGetCompletion(expr->update);
       if (!v) return;
@@ -354,14 +344,9 @@ void AstEvaluator::EvalStatementWithLabel_(ForInStatement* expr, const LabelList
   if (v.is_null() || v.is_undefined()) return;
   Object* o = ToObject(context_, v);
   if (!o) return;
-  vector<u16string> names;
+  any_vector names;
   names.init();
-  for (auto it = o->own_props().begin(); it != o->own_props().end(); ++it) {
-    Property* desc = &(*it).second;
-    if (desc->flags & Property::kEnumerable) {
-      names.push_back((*it).first);
-    }
-  }
+  o->GetOwnEnumerableNames(names);
 
   for (auto it = names.begin(); it != names.end(); ++it) {
     any_ref val = *it;
@@ -393,6 +378,7 @@ void AstEvaluator::EvalStatementWithLabel_(ForInStatement* expr, const LabelList
 
     EvalStatement(expr->body);
     if (!BreakOrContinueIfLabelMatch(label_list)) return;
+    StackFrame::Poll();
   }
 }
 
@@ -416,7 +402,9 @@ bool AstEvaluator::EvalVariableDeclarator(VariableDeclarator* decl) {
     u16string n = EvalIdentifierToName(decl->id);
     any_ref val = EvalExpressionToValue(decl->init);
     if (!val) return false;
-    if (!PutValueWithEnvironment(cur_env_, n, val)) return false;
+    // 12.2 The variable is resolved like any identifier, so that
+    // initializers inside catch blocks reach the function's variable.
+    if (!ResolveIdentifierAndPutValue(n, val)) return false;
   }
   return true;
 }
@@ -457,15 +445,15 @@ any_ref AstEvaluator::EvalExpressionToValue_(ObjectExpression* expr) {
     if (!v) return nullptr;
     switch (pa->kind) {
       case SyntaxNode::kPropertySet: {
-        Property& desc = o->own_props()[n];
-        desc.set = v;
-        desc.flags = Property::kAccessor | Property::kEnumerable | Property::kConfigurable;
+        Property* desc = o->NewOwnProperty(n);
+        desc->set = v;
+        desc->flags = Property::kAccessor | Property::kEnumerable | Property::kConfigurable;
         break;
       }
       case SyntaxNode::kPropertyGet: {
-        Property& desc = o->own_props()[n];
-        desc.value_or_get = v;
-        desc.flags = Property::kAccessor | Property::kEnumerable | Property::kConfigurable;
+        Property* desc = o->NewOwnProperty(n);
+        desc->value_or_get = v;
+        desc->flags = Property::kAccessor | Property::kEnumerable | Property::kConfigurable;
         break;
       }
       case SyntaxNode::kPropertyInit:
@@ -537,165 +525,7 @@ any_ref AstEvaluator::EvalExpressionToValue_(UnaryExpression* expr) {
 
   any_ref val = EvalExpressionToValue(expr->argument);
   if (!val) return nullptr;
-  switch (expr->_operator) {
-    case SyntaxNode::kUnaryVoid:
-      val = undefined_data::alloc();
-      break;
-    case SyntaxNode::kUnaryPositive: {
-      double d;
-      if (!ToNumber(context_, val, d)) return nullptr;
-      val = d;
-      break;
-    }
-    case SyntaxNode::kUnaryNegative: {
-      double d;
-      if (!ToNumber(context_, val, d)) return nullptr;
-      val = -d;
-      break;
-    }
-    case SyntaxNode::kUnaryBitwiseNot: {
-      double d;
-      if (!ToNumber(context_, val, d)) return nullptr;
-      val = ~static_cast<int32_t>(d);
-      break;
-    }
-    case SyntaxNode::kUnaryLogicalNot:
-      val = !ToBoolean(val);
-      break;
-    default:
-      assert(false);
-  }
-  return val;
-}
-
-inline static any_ref ApplyBinaryOperator(SyntaxNode::BinaryOperator optype, int l, int r) {
-  any_ref val;
-  switch (optype) {
-    case SyntaxNode::kBinaryAddition:
-      val = l + r;
-      break;
-    case SyntaxNode::kBinarySubtraction:
-      val = l - r;
-      break;
-    case SyntaxNode::kBinaryMultiplication:
-      val = l * r;
-      break;
-    case SyntaxNode::kBinaryRemainder:
-      val = l % r;
-      break;
-    case SyntaxNode::kBinaryDivision:
-      val = l / r;
-      break;
-    case SyntaxNode::kBinaryLeftShift:
-      val = l << r;
-      break;
-    case SyntaxNode::kBinarySignedRightShift:
-      val = l >> r;
-      break;
-    case SyntaxNode::kBinaryUnsignedRightShift:
-      val = l >> r;
-      break;
-    case SyntaxNode::kBinaryLessThan:
-      val = l < r;
-      break;
-    case SyntaxNode::kBinaryGreaterThan:
-      val = l > r;
-      break;
-    case SyntaxNode::kBinaryLessThanOrEqual:
-      val = l <= r;
-      break;
-    case SyntaxNode::kBinaryGreaterThanOrEqual:
-      val = l >= r;
-      break;
-    case SyntaxNode::kBinaryEquals:
-    case SyntaxNode::kBinaryStrictEquals:
-      val = l == r;
-      break;
-    case SyntaxNode::kBinaryDoesNotEqual:
-    case SyntaxNode::kBinaryStrictDoesNotEqual:
-      val = l != r;
-      break;
-    case SyntaxNode::kBinaryBitwiseAnd:
-      val = l & r;
-      break;
-    case SyntaxNode::kBinaryBitwiseXor:
-      val = l ^ r;
-      break;
-    case SyntaxNode::kBinaryBitwiseOr:
-      val = l | r;
-      break;
-    default:
-      assert(false);
-      val = 0;
-      break;
-  }
-  return val;
-}
-
-inline static any_ref ApplyBinaryOperator(SyntaxNode::BinaryOperator optype, double l, double r) {
-  any_ref val;
-  switch (optype) {
-    case SyntaxNode::kBinaryAddition:
-      val = double_data::alloc(l + r);
-      break;
-    case SyntaxNode::kBinarySubtraction:
-      val = double_data::alloc(l - r);
-      break;
-    case SyntaxNode::kBinaryMultiplication:
-      val = double_data::alloc(l * r);
-      break;
-    case SyntaxNode::kBinaryDivision:
-      val = double_data::alloc(l / r);
-      break;
-    case SyntaxNode::kBinaryRemainder:
-      val = double_data::alloc(static_cast<int>(l) % static_cast<int>(r));
-      break;
-    case SyntaxNode::kBinaryLeftShift:
-      val = double_data::alloc(static_cast<int>(l) << static_cast<int>(r));
-      break;
-    case SyntaxNode::kBinarySignedRightShift:
-      val = double_data::alloc(static_cast<int>(l) >> static_cast<int>(r));
-      break;
-    case SyntaxNode::kBinaryUnsignedRightShift:
-      val = double_data::alloc(static_cast<int>(l) >> static_cast<int>(r));
-      break;
-    case SyntaxNode::kBinaryLessThan:
-      val = l < r;
-      break;
-    case SyntaxNode::kBinaryGreaterThan:
-      val = l > r;
-      break;
-    case SyntaxNode::kBinaryLessThanOrEqual:
-      val = l <= r;
-      break;
-    case SyntaxNode::kBinaryGreaterThanOrEqual:
-      val = l >= r;
-      break;
-    case SyntaxNode::kBinaryEquals:
-    case SyntaxNode::kBinaryStrictEquals:
-      val = l == r;
-      break;
-    case SyntaxNode::kBinaryDoesNotEqual:
-    case SyntaxNode::kBinaryStrictDoesNotEqual:
-      val = l != r;
-      break;
-    case SyntaxNode::kBinaryBitwiseAnd:
-      val = double_data::alloc(static_cast<int>(l) & static_cast<int>(r));
-      break;
-    case SyntaxNode::kBinaryBitwiseXor:
-      val = double_data::alloc(static_cast<int>(l) ^ static_cast<int>(r));
-      break;
-    case SyntaxNode::kBinaryBitwiseOr:
-      val = double_data::alloc(static_cast<int>(l) | static_cast<int>(r));
-      break;
-    case SyntaxNode::kBinaryInstanceOf:
-    case SyntaxNode::kBinaryIn:
-    default:
-      assert(false);
-      val = 0;
-      break;
-  }
-  return val;
+  return ApplyUnaryOperator(context_, expr->_operator, val);
 }
 
 any_ref AstEvaluator::EvalExpressionToValue_(BinaryExpression* expr) {
@@ -704,134 +534,7 @@ any_ref AstEvaluator::EvalExpressionToValue_(BinaryExpression* expr) {
   any_ref rval = EvalExpressionToValue(expr->right);
   if (!rval) return nullptr;
 
-  if (expr->_operator == SyntaxNode::kBinaryStrictEquals) {
-    return IsStrictSameValue(lval, rval);
-  } else if (expr->_operator == SyntaxNode::kBinaryStrictDoesNotEqual) {
-    return !IsStrictSameValue(lval, rval);
-  } else if (expr->_operator == SyntaxNode::kBinaryEquals) {
-    bool bval;
-    if (!IsAbstractSameValue(context_, lval, rval, bval)) return nullptr;
-    return bval;
-  } else if (expr->_operator == SyntaxNode::kBinaryDoesNotEqual) {
-    bool bval;
-    if (!IsAbstractSameValue(context_, lval, rval, bval)) return nullptr;
-    return !bval;
-  } else if (expr->_operator == SyntaxNode::kBinaryInstanceOf) {
-    Object* lobj = ToObject(context_, lval);
-    Object* robj = ToObject(context_, rval);
-    any_ref robj_proto_val = robj->Get("prototype");
-    Object* robj_proto = robj_proto_val.as<Object>();
-    Object* proto = lobj->proto();
-    while (proto) {
-      if (proto == robj_proto) {
-        return true;
-      }
-      proto = proto->proto();
-    }
-    return false;
-  } else if (expr->_operator == SyntaxNode::kBinaryIn) {
-    u16string n = ToString(context_, lval);
-    Object* o = ToObject(context_, rval);
-    bool bval = (o->own_props().find(n) != o->own_props().end());
-    return bval;
-  } else {
-    any_ref val;
-    lval = ToPrimitive(context_, lval);
-    if (!lval) return nullptr;
-    rval = ToPrimitive(context_, rval);
-    if (!rval) return nullptr;
-
-    if (expr->_operator == SyntaxNode::kBinaryAddition) {
-      if (lval.is_u16string() || rval.is_u16string()) {
-        u16string lstr = ToString(context_, lval);
-        if (!lstr) return nullptr;
-        u16string rstr = ToString(context_, rval);
-        if (!rstr) return nullptr;
-        return lstr + rstr;
-      }
-    }
-
-    if (lval.is_smi() && rval.is_smi()) {
-      val = ApplyBinaryOperator(expr->_operator, lval.smi(), rval.smi());
-    } else if (lval.is_double() && rval.is_double()) {
-      double lnum = lval.as_double();
-      double rnum = rval.as_double();
-      val = ApplyBinaryOperator(expr->_operator, lnum, rnum);
-    } else {
-      double lnum, rnum;
-      if (!ToNumber(context_, lval, lnum) || !ToNumber(context_, rval, rnum)) return nullptr;
-      val = ApplyBinaryOperator(expr->_operator, lnum, rnum);
-    }
-    return val;
-  }
-}
-
-static any_ref ApplyAssignmentOperator(Context* c, SyntaxNode::AssignmentOperator op, any_ref lval, any_ref rval) {
-  SyntaxNode::BinaryOperator bin_op;
-  switch (op) {
-    case SyntaxNode::kAssignmentMultiplication:
-      bin_op = SyntaxNode::kBinaryMultiplication;
-      break;
-    case SyntaxNode::kAssignmentDivision:
-      bin_op = SyntaxNode::kBinaryDivision;
-      break;
-    case SyntaxNode::kAssignmentRemainder:
-      bin_op = SyntaxNode::kBinaryRemainder;
-      break;
-    case SyntaxNode::kAssignmentAddition:
-      bin_op = SyntaxNode::kBinaryAddition;
-      break;
-    case SyntaxNode::kAssignmentSubtraction:
-      bin_op = SyntaxNode::kBinarySubtraction;
-      break;
-    case SyntaxNode::kAssignmentLeftShift:
-      bin_op = SyntaxNode::kBinaryLeftShift;
-      break;
-    case SyntaxNode::kAssignmentSignedRightShift:
-      bin_op = SyntaxNode::kBinarySignedRightShift;
-      break;
-    case SyntaxNode::kAssignmentUnsignedRightShift:
-      bin_op = SyntaxNode::kBinaryUnsignedRightShift;
-      break;
-    case SyntaxNode::kAssignmentBitwiseAnd:
-      bin_op = SyntaxNode::kBinaryBitwiseAnd;
-      break;
-    case SyntaxNode::kAssignmentBitwiseXor:
-      bin_op = SyntaxNode::kBinaryBitwiseXor;
-      break;
-    case SyntaxNode::kAssignmentBitwiseOr:
-      bin_op = SyntaxNode::kBinaryBitwiseOr;
-      break;
-    case SyntaxNode::kAssignmentNone:
-    default:
-      assert(false);
-      return nullptr;
-  }
-  any_ref val;
-
-  if (bin_op == SyntaxNode::kBinaryAddition) {
-    if (lval.is_u16string() || rval.is_u16string()) {
-      u16string lstr = ToString(c, lval);
-      if (!lstr) return nullptr;
-      u16string rstr = ToString(c, rval);
-      if (!rstr) return nullptr;
-      return lstr + rstr;
-    }
-  }
-
-  if (lval.is_smi() && rval.is_smi()) {
-    return ApplyBinaryOperator(bin_op, lval.smi(), rval.smi());
-  } else if (lval.is_double() && rval.is_double()) {
-    double lnum = lval.as_double();
-    double rnum = rval.as_double();
-    return ApplyBinaryOperator(bin_op, lnum, rnum);
-  } else {
-    double lnum, rnum;
-    if (!ToNumber(c, lval, lnum) || !ToNumber(c, rval, rnum)) {
-      return nullptr;
-    }
-    return ApplyBinaryOperator(bin_op, lnum, rnum);
-  }
+  return ApplyBinaryOperator(context_, expr->_operator, lval, rval);
 }
 
 any_ref AstEvaluator::EvalExpressionToValue_(AssignmentExpression* expr) {
@@ -882,38 +585,6 @@ any_ref AstEvaluator::EvalExpressionToValue_(AssignmentExpression* expr) {
   }
 }
 
-static any_ref ApplyUpdateOperator(SyntaxNode::UpdateOperator op, any_ref val) {
-  if (val.is_smi()) {
-    switch (op) {
-      case SyntaxNode::kUpdateIncrement:
-        val = val.smi() + 1;
-        break;
-      case SyntaxNode::kUpdateDecrement:
-        val = val.smi() - 1;
-        break;
-      default:
-        assert(false);
-        val = 0;
-        break;
-    }
-  } else {
-    double num = val.as_double();
-    switch (op) {
-      case SyntaxNode::kUpdateIncrement:
-        val = double_data::alloc(num + 1);
-        break;
-      case SyntaxNode::kUpdateDecrement:
-        val = double_data::alloc(num - 1);
-        break;
-      default:
-        assert(false);
-        val = 0;
-        break;
-    }
-  }
-  return val;
-}
-
 any_ref AstEvaluator::EvalExpressionToValue_(UpdateExpression* expr) {
   if (expr->argument->type == SyntaxNode::kIdentifier) {
     Identifier* ident = static_cast<Identifier*>(expr->argument);
@@ -979,7 +650,7 @@ any_ref AstEvaluator::EvalExpressionToValue_(NewExpression* expr) {
   }
 
   // 11.2.4 Argument Lists
-  any_vector args;
+  arg_vector args;
   args.init();
   args.push_back(nullptr);
   for (auto it = expr->arguments.begin(); it != expr->arguments.end(); ++it) {
@@ -1002,17 +673,7 @@ any_ref AstEvaluator::EvalExpressionToValue_(CallExpression* expr) {
     Environment* env;
     func_val = ResolveIdentifierAndGetValueAndEnvironment(n, true, env);
     if (!func_val) return nullptr;
-    if (cur_env_->is<DeclarativeEnvironment>()) {
-      this_val = context_->global_obj();
-    } else {
-      assert(env->is<ObjectEnvironment>());
-      ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(env);
-      if (obj_env->provide_this) {
-        this_val = obj_env->bindings_obj;
-      } else {
-        this_val = undefined_data::alloc();
-      }
-    }
+    this_val = GetIdentifierThisValue(context_, cur_env_, env);
   } else if (expr->callee->type == SyntaxNode::kMemberExpression) {
     MemberExpression *member = static_cast<MemberExpression*>(expr->callee);
     PropertyReference ref;
@@ -1025,7 +686,7 @@ any_ref AstEvaluator::EvalExpressionToValue_(CallExpression* expr) {
   } else {
     func_val = EvalExpressionToValue(expr->callee);
     if (!func_val) return nullptr;
-    this_val = undefined_data::alloc();
+    this_val = any_ref::undefined();
   }
   
   if (!func_val.is<Object>()) return ThrowTypeError(context_);
@@ -1033,7 +694,7 @@ any_ref AstEvaluator::EvalExpressionToValue_(CallExpression* expr) {
   if (!IsCallable(func_obj)) return ThrowTypeError(context_);
 
   // 11.2.4 Argument Lists
-  any_vector args;
+  arg_vector args;
   args.init();
   args.push_back(this_val);
   for (auto it = expr->arguments.begin(); it != expr->arguments.end(); ++it) {
@@ -1066,12 +727,17 @@ void AstEvaluator::EvalSwitchCase(SwitchCase* expr) {
 }
 
 void AstEvaluator::EvalCatchClause(CatchClause* expr) {
+  // 12.14 The try Statement
   any_ref rval = Catch();
   assert(!!rval);
   cv_.value = rval;
   u16string id = EvalIdentifierToName(expr->param);
-  DefineVariable(id, rval);
+  DeclarativeEnvironment* catch_env = DeclarativeEnvironment::Alloc(cur_env_);
+  catch_env->CreateBinding(id, rval, false, false);
+  Environment* old_env = cur_env_;
+  cur_env_ = catch_env;
   EvalStatement(expr->body);
+  cur_env_ = old_env;
 }
 
 // Literals
@@ -1080,92 +746,19 @@ void AstEvaluator::EvalCatchClause(CatchClause* expr) {
  * @returns false for exception.
  */
 bool AstEvaluator::ResolveIdentifierAndPutValue(u16string n, any_ref v) {
-  // 10.3.1 Identifier Resolution
-  // 10.2.2.1 GetIdentifierReference (lex, name, strict)
-  Environment* env = cur_env_;
-  while (env) {
-    if (env->is<DeclarativeEnvironment>()) {
-      DeclarativeEnvironment* decl_env = static_cast<DeclarativeEnvironment*>(env);
-      bool found;
-      if (!decl_env->SetMutableBindingIfFound(context_, n, v, strict_, found)) return false;
-      if (found) return true;
-    } else {
-      assert(env->is<ObjectEnvironment>());
-      ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(env);
-      bool found;
-      if (!obj_env->SetMutableBindingIfFound(context_, n, v, strict_, found)) return false;
-      if (found) return true;
-    }
-    env = env->outer;
-  }
-  // Do PutValue()
-  if (strict_) {
-    return ThrowReferenceError(context_);
-  } else {
-    Object* obj = context_->global_obj();
-    return obj->Put(context_, n, v, false);
-  }
+  return PutIdentifierValue(context_, cur_env_, n, v, strict_);
 }
 
 bool AstEvaluator::DeleteIdentifier(u16string n) {
-  Environment* env = cur_env_;
-  if (env->is<DeclarativeEnvironment>()) {
-    DeclarativeEnvironment* decl_env = static_cast<DeclarativeEnvironment*>(env);
-    return decl_env->DeleteBinding(n);
-  } else {
-    assert(env->is<ObjectEnvironment>());
-    ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(env);
-    return obj_env->DeleteBinding(n);
-  }
+  return nabla::internal::DeleteIdentifier(cur_env_, n);
 }
 
 any_ref AstEvaluator::ResolveIdentifierAndGetValueAndEnvironment(u16string n, bool do_throw, Environment*& resolved_env) {
-  // 10.3.1 Identifier Resolution
-  // 10.2.2.1 GetIdentifierReference (lex, name, strict)
-  Environment* env = cur_env_;
-  while (env) {
-    if (env->is<DeclarativeEnvironment>()) {
-      DeclarativeEnvironment* decl_env = static_cast<DeclarativeEnvironment*>(env);
-      Binding* b = decl_env->GetBinding(n);
-      if (!!b) {
-        // HasBinding() is true.
-        resolved_env = env;
-        // Do GetBindingValue().
-        return b->value;
-      }
-    } else {
-      assert(env->is<ObjectEnvironment>());
-      ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(env);
-      Object* bindings_obj = obj_env->bindings_obj;
-      Property* prop = bindings_obj->GetProperty(n);
-      if (!!prop) {
-        // HasBinding() is true.
-        resolved_env = env;
-        // Do GetBindingValue().
-        return bindings_obj->Get(n);
-      }
-    }
-    env = env->outer;
-  }
-  if (do_throw) {
-    return ThrowReferenceError(context_);
-  } else {
-    // IsUnresolvableReference(V) is true.
-    // GetValue(V) throws a ReferenceError.
-    return undefined_data::alloc();
-  }
+  return GetIdentifierValue(context_, cur_env_, n, do_throw, resolved_env);
 }
 
 bool AstEvaluator::PutValueWithEnvironment(Environment* env, u16string n, any_ref v) {
-  if (env->is<DeclarativeEnvironment>()) {
-    DeclarativeEnvironment* decl_env = static_cast<DeclarativeEnvironment*>(env);
-    bool found;
-    return decl_env->SetMutableBindingIfFound(context_, n, v, strict_, found);
-  } else {
-    assert(env->is<ObjectEnvironment>());
-    ObjectEnvironment* obj_env = static_cast<ObjectEnvironment*>(env);
-    return obj_env->SetMutableBinding(context_, n, v, strict_);
-  }
+  return nabla::internal::PutValueWithEnvironment(context_, env, n, v, strict_);
 }
 
 bool AstEvaluator::EvalMemberExpressionToReference(MemberExpression* expr, PropertyReference& ref) {
@@ -1197,7 +790,7 @@ any_ref AstEvaluator::EvalExpressionToValue_(Identifier* expr) {
 }
 
 any_ref AstEvaluator::EvalExpressionToValue_(NullLiteral* expr) {
-  return null_data::alloc();
+  return any_ref::null();
 }
 
 any_ref AstEvaluator::EvalExpressionToValue_(BooleanLiteral* expr) {
@@ -1205,12 +798,12 @@ any_ref AstEvaluator::EvalExpressionToValue_(BooleanLiteral* expr) {
 }
 
 any_ref AstEvaluator::EvalExpressionToValue_(NumberLiteral* expr) {
-  int n = static_cast<int>(expr->value);
-  if (any_ref(n).smi() == expr->value) {
-    return n;
-  } else {
-    return expr->value;
+  double d = expr->value;
+  if (d >= INT32_MIN && d <= INT32_MAX) {
+    int n = static_cast<int>(d);
+    if (any_ref(n).smi() == d) return n;
   }
+  return d;
 }
 
 any_ref AstEvaluator::EvalExpressionToValue_(StringLiteral* expr) {
@@ -1232,6 +825,8 @@ any_ref AstEvaluator::EvalExpressionToValue_(RegExpLiteral* expr) {
 
 any_ref AstEvaluator::EvalExpressionToValue(Expression* expr) {
   assert(expr);
+  const SyntaxNode* saved_node = frame_.node;
+  frame_.node = expr;
   any_ref v;
   switch (expr->type) {
     case SyntaxNode::kThisExpression:
@@ -1298,6 +893,7 @@ any_ref AstEvaluator::EvalExpressionToValue(Expression* expr) {
       assert(false);
       break;
   }
+  frame_.node = saved_node;
 
   return v;
 }
@@ -1317,7 +913,7 @@ any_ref AstEvaluator::EvalExpressionAndGetCompletion(Expression* expr) {
 }
 
 any_ref AstEvaluator::CallFunction(Context* context, Script* script, Environment* scope, FunctionNode* expr, bool strict, any_ref this_val, size_t argc, const any_ref* argv) {
-  AstEvaluator evaluator(context, script, this_val, strict);
+  AstEvaluator evaluator(context, script, expr, this_val, strict);
   return evaluator.CallFunction_(scope, expr, argc, argv);
 }
 
@@ -1464,7 +1060,7 @@ void AstEvaluator::InitVariableBindings(VariableDeclaration* stmt) {
   for (auto it = stmt->declarations.begin(); it != stmt->declarations.end(); ++it) {
     VariableDeclarator* decl = *it;
     u16string n = EvalIdentifierToName(decl->id);
-    DefineVariable(n, undefined_data::alloc());
+    DefineVariable(n, any_ref::undefined());
   }
 }
 
@@ -1521,7 +1117,7 @@ any_ref AstEvaluator::CallFunction_(Environment* scope, FunctionNode* expr, size
   }
   for (; it != end; ++it) {
     u16string n = EvalIdentifierToName(*it);
-    env->CreateBinding(n, undefined_data::alloc(), false, false);
+    env->CreateBinding(n, any_ref::undefined(), false, false);
   }
 
   arguments_obj->Put(context_, "length", (int)argc, false);
@@ -1534,7 +1130,7 @@ any_ref AstEvaluator::CallFunction_(Environment* scope, FunctionNode* expr, size
   EvalStatement(expr->body);
 
   if (cv_.type == CompletionSpecification::kNormal) {
-    return undefined_data::alloc();
+    return any_ref::undefined();
   } else if (cv_.type == CompletionSpecification::kReturn) {
     return GetCurValue();
   } else if (cv_.type == CompletionSpecification::kThrow) {
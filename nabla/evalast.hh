@@ -10,6 +10,7 @@
 #include "ast.hh"
 #include "context.hh"
 #include "data.hh"
+#include "profile.hh"
 
 namespace nabla {
 namespace internal {
@@ -40,8 +41,9 @@ class AstEvaluator {
   static any_ref CallFunction(Context* context, Script* script, Environment* scope, FunctionNode* expr, bool strict, any_ref this_val, size_t argc, const any_ref* argv);
 
  protected:
-  AstEvaluator(Context *context, Script* script, any_ref this_val, bool strict);
-  virtual ~AstEvaluator() {}
+  // function is nullptr for the program.
+  AstEvaluator(Context *context, Script* script, FunctionNode* function, any_ref this_val, bool strict);
+  virtual ~AstEvaluator() { frame_.Pop(); }
   any_ref EvalScript();
   any_ref CallFunction_(Environment* scope, FunctionNode* expr, size_t argc, const any_ref* argv);
 
@@ -137,6 +139,7 @@ class AstEvaluator {
   CompletionSpecification cv_;
   bool strict_;
   any_ref this_val_;
+  StackFrame frame_;
 };
 
 }  // namespace internal
@@ -0,0 +1,824 @@
+/* Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+ * Copyright (C) 2014 Katsuya Iida. All rights reserved.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "evalbc.hh"
+
+#include <alloca.h>
+#include <cassert>
+
+#include "debug.hh"
+
+// GCC and Clang can jump through a table of label addresses, which
+// gives each instruction its own indirect branch.
+#if defined(__GNUC__) && !defined(NABLA_NO_THREADED_DISPATCH)
+#define NABLA_THREADED_DISPATCH 1
+#endif
+
+namespace nabla {
+namespace internal {
+
+BytecodeEvaluator::BytecodeEvaluator(Context* context, Script* script, CodeBlock* block, Environment* env, any_ref this_val, bool strict)
+    : context_(context), script_(script), block_(block), cur_env_(env), strict_(strict) {
+  this_val_ = this_val;
+  frame_.Push(script, block->function);
+  frame_.block = block;
+}
+
+any_ref BytecodeEvaluator::EvalScript(Context* context, Script* script) {
+  ObjectEnvironment* env = ObjectEnvironment::Alloc(nullptr);
+  env->bindings_obj = context->global_obj();
+  BytecodeEvaluator evaluator(context, script, script->bytecode()->program(), env, context->global_obj(), false);
+  evaluator.InitBindings();
+  return evaluator.Run();
+}
+
+any_ref BytecodeEvaluator::CallFunction(Function* fn, any_ref this_val, size_t argc, const any_ref* argv) {
+  Context* c = fn->context;
+  CodeBlock* block = fn->block;
+
+  // 10.4.3 Entering Function Code
+  DeclarativeEnvironment* env = DeclarativeEnvironment::Alloc(fn->scope, block->slot_names.size(), fn->script, block->slot_names.data());
+  BytecodeEvaluator evaluator(c, fn->script, block, env, this_val, fn->strict);
+
+  // 10.5 Declaration Binding Instantiation
+  any_ref* slots = env->slots();
+  size_t num_params = block->params.size();
+  for (size_t i = 0; i < num_params; i++) {
+    slots[block->params[i]] = i < argc ? argv[i] : any_ref::undefined();
+  }
+
+  if (block->needs_arguments && block->arguments_slot >= 0) {
+    Object* arguments_obj = Object::Alloc(c->object_proto());
+    for (size_t i = 0; i < argc; i++) {
+      arguments_obj->Put(c, i, argv[i], false);
+    }
+    arguments_obj->Put(c, "length", (int)argc, false);
+    slots[block->arguments_slot] = arguments_obj;
+  }
+
+  evaluator.InitBindings();
+  return evaluator.Run();
+}
+
+void BytecodeEvaluator::InitBindings() {
+  // 10.5 Declaration Binding Instantiation
+  Bytecode* bytecode = script_->bytecode();
+  if (!block_->function) {
+    for (auto it = block_->function_bindings.begin(); it != block_->function_bindings.end(); ++it) {
+      CodeBlock* block = bytecode->blocks[(*it).block];
+      Object* o = NewFunctionObject(context_, script_, cur_env_, block->function);
+      o->host_data.as<Function>()->block = block;
+      DefineVariable(context_, cur_env_, GetString((*it).name), o);
+    }
+    for (auto it = block_->variable_bindings.begin(); it != block_->variable_bindings.end(); ++it) {
+      DefineVariable(context_, cur_env_, GetString(*it), any_ref::undefined());
+    }
+    return;
+  }
+
+  any_ref* slots = static_cast<DeclarativeEnvironment*>(cur_env_)->slots();
+  for (auto it = block_->function_bindings.begin(); it != block_->function_bindings.end(); ++it) {
+    CodeBlock* block = bytecode->blocks[(*it).block];
+    Object* o = NewFunctionObject(context_, script_, cur_env_, block->function);
+    o->host_data.as<Function>()->block = block;
+    slots[(*it).slot] = o;
+  }
+  for (auto it = block_->variable_bindings.begin(); it != block_->variable_bindings.end(); ++it) {
+    // Parameters and functions keep their values.
+    if (!slots[*it]) slots[*it] = any_ref::undefined();
+  }
+}
+
+// Inline caches
+
+static size_t cache_hits = 0;
+static size_t cache_misses = 0;
+static size_t cache_megamorphic = 0;
+
+void BytecodeEvaluator::GetCacheStats(size_t& hits, size_t& misses, size_t& megamorphic) {
+  hits = cache_hits;
+  misses = cache_misses;
+  megamorphic = cache_megamorphic;
+}
+
+// Returns the property found through the entries of cache, or nullptr
+// when none of them is for o.
+static Property* ProbeCache(PropertyCache* cache, Object* o) {
+  Shape* shape = o->shape();
+  for (int i = 0; i < cache->size; i++) {
+    const PropertyCache::Entry& e = cache->entries[i];
+    if (e.shape != shape) continue;
+    Object* holder = o;
+    if (e.depth > 0) {
+      holder = o->proto();
+      if (e.depth > 1) {
+        if (!holder || holder->shape() != e.proto_shape) continue;
+        holder = holder->proto();
+      }
+      if (holder != e.holder || holder->shape() != e.holder_shape) continue;
+    }
+    cache_hits++;
+    return holder->OwnSlot(e.index);
+  }
+  return nullptr;
+}
+
+static void AddCacheEntry(PropertyCache* cache, const PropertyCache::Entry& e) {
+  if (cache->size == PropertyCache::kMegamorphic) return;
+  if (cache->size == PropertyCache::kMaxEntries) {
+    cache->size = PropertyCache::kMegamorphic;
+    cache_megamorphic++;
+    return;
+  }
+  cache->entries[cache->size++] = e;
+}
+
+// 8.12.2 [[GetProperty]] (P)
+// Looks up n on the prototype chain of o and adds an entry to cache
+// for where it was found.
+static Property* LookupAndUpdateCache(PropertyCache* cache, Object* o, u16string n) {
+  cache_misses++;
+  PropertyCache::Entry e;
+  e.shape = o->shape();
+  e.proto_shape = nullptr;
+  e.holder = nullptr;
+  e.holder_shape = nullptr;
+  e.depth = 0;
+  // Only shared shapes are cached. They tell that an object doesn't
+  // have n, and they are never collected while entries point to them.
+  bool cacheable = !o->shape()->is_dictionary();
+  Object* holder = o;
+  int index;
+  while ((index = holder->shape()->Lookup(n)) < 0) {
+    if (holder->shape()->is_dictionary()) cacheable = false;
+    if (e.depth == 1) e.proto_shape = holder->shape();
+    holder = holder->proto();
+    if (!holder) return nullptr;
+    e.depth++;
+  }
+  if (holder->shape()->is_dictionary()) cacheable = false;
+  if (cacheable && e.depth <= PropertyCache::kMaxDepth) {
+    if (e.depth > 0) {
+      e.holder = holder;
+      e.holder_shape = holder->shape();
+    }
+    e.index = index;
+    AddCacheEntry(cache, e);
+  }
+  return holder->OwnSlot(index);
+}
+
+// Adds an entry for the own writable data property n of o after it
+// was stored.
+static void UpdateStoreCache(PropertyCache* cache, Object* o, u16string n) {
+  if (o->shape()->is_dictionary()) return;
+  int index = o->shape()->Lookup(n);
+  if (index < 0 || !(o->OwnSlot(index)->flags & Property::kWritable)) return;
+  for (int i = 0; i < cache->size; i++) {
+    const PropertyCache::Entry& e = cache->entries[i];
+    if (e.shape == o->shape() && e.index == static_cast<uint32_t>(index)) return;
+  }
+  PropertyCache::Entry e;
+  e.shape = o->shape();
+  e.proto_shape = nullptr;
+  e.holder = nullptr;
+  e.holder_shape = nullptr;
+  e.depth = 0;
+  e.index = index;
+  AddCacheEntry(cache, e);
+}
+
+Property* BytecodeEvaluator::GetCachedProperty(PropertyCache* cache, Object* o) {
+  Property* desc = ProbeCache(cache, o);
+  if (desc) return desc;
+  return LookupAndUpdateCache(cache, o, GetString(cache->name));
+}
+
+bool BytecodeEvaluator::PutCachedProperty(PropertyCache* cache, Object* o, any_ref v) {
+  u16string n = GetString(cache->name);
+  // Arrays update their length on [[Put]].
+  bool cacheable = !o->host_data.is<Array>();
+  if (cacheable) {
+    Property* desc = ProbeCache(cache, o);
+    if (desc && (desc->flags & Property::kWritable)) {
+      desc->value_or_get = v;
+      return true;
+    }
+    cache_misses++;
+  }
+  if (!o->Put(context_, n, v, strict_)) return false;
+  if (cacheable) UpdateStoreCache(cache, o, n);
+  return true;
+}
+
+any_ref BytecodeEvaluator::Run() {
+  Context* c = context_;
+  const Instruction* code = block_->code.data();
+  const Instruction* pc = code;
+  int num_registers = block_->num_registers;
+  any_ref* regs = static_cast<any_ref*>(alloca(num_registers * sizeof (any_ref)));
+  for (int i = 0; i < num_registers; i++) regs[i] = nullptr;
+  // Slots of the function environment. They stay the locals inside
+  // with statements and catch blocks, which enter environments of
+  // their own.
+  any_ref* locals = block_->function ? static_cast<DeclarativeEnvironment*>(cur_env_)->slots() : nullptr;
+
+#ifdef NABLA_THREADED_DISPATCH
+  static void* const dispatch_table[] = {
+#define NABLA_OPCODE_LABEL(name) &&op_##name,
+    NABLA_OPCODE_LIST(NABLA_OPCODE_LABEL)
+#undef NABLA_OPCODE_LABEL
+  };
+#define FAST_OPCODE(name) op_##name:
+#define DISPATCH() goto *dispatch_table[pc->op]
+#define NEXT() goto *dispatch_table[(++pc)->op]
+#else
+#define FAST_OPCODE(name) case kOp##name:
+#define DISPATCH() continue
+#define NEXT() { ++pc; continue; }
+#endif
+// The frame gets pc before anything that may allocate or call out of the
+// loop, so that the profilers can map it back to the source. Instructions
+// that never do use FAST_OPCODE and skip the store.
+#define SYNC_PC() (frame_.pc = pc)
+#define OPCODE(name) FAST_OPCODE(name) SYNC_PC();
+// Backward jumps are where loops poll for the CPU profiler's samples. Not
+// a do-while, so that DISPATCH() continues the dispatch loop.
+#define JUMP(target)                                                    \
+  {                                                                     \
+    const Instruction* t = code + (target);                             \
+    if (t <= pc) StackFrame::Poll();                                    \
+    pc = t;                                                             \
+    DISPATCH();                                                         \
+  }
+#define THROW() goto throw_exception
+#define CHECK(v) do { if (!(v)) THROW(); } while (0)
+#define BINARY_OPCODE(name, op)                                         \
+  OPCODE(name) {                                                        \
+    any_ref v = ApplyBinaryOperator(c, SyntaxNode::op, regs[pc->b], regs[pc->c]); \
+    CHECK(v);                                                           \
+    regs[pc->a] = v;                                                    \
+    NEXT();                                                             \
+  }
+// Operands that are both SMIs skip ApplyBinaryOperator entirely. The
+// checked forms fall back to it when the result leaves the int32 range.
+#define SMI_BINARY_OPCODE(name, op, smi_op)                             \
+  FAST_OPCODE(name) {                                                   \
+    any_ref l = regs[pc->b];                                            \
+    any_ref r = regs[pc->c];                                            \
+    if (l.is_smi() && r.is_smi()) {                                     \
+      regs[pc->a] = l.smi() smi_op r.smi();                             \
+      NEXT();                                                           \
+    }                                                                   \
+    SYNC_PC();                                                          \
+    any_ref v = ApplyBinaryOperator(c, SyntaxNode::op, l, r);           \
+    CHECK(v);                                                           \
+    regs[pc->a] = v;                                                    \
+    NEXT();                                                             \
+  }
+#define CHECKED_BINARY_OPCODE(name, op, checked_op)                     \
+  FAST_OPCODE(name) {                                                   \
+    any_ref l = regs[pc->b];                                            \
+    any_ref r = regs[pc->c];                                            \
+    int res;                                                            \
+    if (l.is_smi() && r.is_smi() && checked_op(l.smi(), r.smi(), res)) { \
+      regs[pc->a] = res;                                                \
+      NEXT();                                                           \
+    }                                                                   \
+    SYNC_PC();                                                          \
+    any_ref v = ApplyBinaryOperator(c, SyntaxNode::op, l, r);           \
+    CHECK(v);                                                           \
+    regs[pc->a] = v;                                                    \
+    NEXT();                                                             \
+  }
+#define UNARY_OPCODE(name, op)                                          \
+  OPCODE(name) {                                                        \
+    any_ref v = ApplyUnaryOperator(c, SyntaxNode::op, regs[pc->b]);     \
+    CHECK(v);                                                           \
+    regs[pc->a] = v;                                                    \
+    NEXT();                                                             \
+  }
+#define UPDATE_OPCODE(name, op)                                         \
+  OPCODE(name) {                                                        \
+    any_ref v = ApplyUpdateOperator(SyntaxNode::op, regs[pc->b]);       \
+    CHECK(v);                                                           \
+    regs[pc->a] = v;                                                    \
+    NEXT();                                                             \
+  }
+
+  for (;;) {
+#ifdef NABLA_THREADED_DISPATCH
+    DISPATCH();
+    {
+#else
+    switch (pc->op) {
+#endif
+      FAST_OPCODE(Nop) {
+        NEXT();
+      }
+
+      FAST_OPCODE(LoadUndefined) {
+        regs[pc->a] = any_ref::undefined();
+        NEXT();
+      }
+
+      FAST_OPCODE(LoadNull) {
+        regs[pc->a] = any_ref::null();
+        NEXT();
+      }
+
+      FAST_OPCODE(LoadBool) {
+        regs[pc->a] = pc->b != 0;
+        NEXT();
+      }
+
+      FAST_OPCODE(LoadInt) {
+        regs[pc->a] = pc->b;
+        NEXT();
+      }
+
+      OPCODE(LoadNumber) {
+        regs[pc->a] = block_->numbers[pc->b];
+        NEXT();
+      }
+
+      FAST_OPCODE(LoadString) {
+        regs[pc->a] = GetString(pc->b);
+        NEXT();
+      }
+
+      OPCODE(LoadRegExp) {
+        RegExpLiteral* expr = block_->regexps[pc->b];
+        u16string pattern_str = u16string(expr->pattern.data(), expr->pattern.length());
+        u16string flags_str = u16string(expr->flags.data(), expr->flags.length());
+        Object* o = NewRegExpObject(c, pattern_str, flags_str);
+        CHECK(o);
+        regs[pc->a] = o;
+        NEXT();
+      }
+
+      FAST_OPCODE(LoadThis) {
+        // 11.1.1 The this Keyword
+        regs[pc->a] = this_val_;
+        NEXT();
+      }
+
+      FAST_OPCODE(Move) {
+        regs[pc->a] = regs[pc->b];
+        NEXT();
+      }
+
+      FAST_OPCODE(LoadLocal) {
+        regs[pc->a] = locals[pc->b];
+        NEXT();
+      }
+
+      FAST_OPCODE(StoreLocal) {
+        locals[pc->a] = regs[pc->b];
+        NEXT();
+      }
+
+      FAST_OPCODE(LoadScoped) {
+        Environment* env = cur_env_;
+        for (int i = pc->b; i > 0; i--) env = env->outer;
+        regs[pc->a] = static_cast<DeclarativeEnvironment*>(env)->slots()[pc->c];
+        NEXT();
+      }
+
+      FAST_OPCODE(StoreScoped) {
+        Environment* env = cur_env_;
+        for (int i = pc->a; i > 0; i--) env = env->outer;
+        static_cast<DeclarativeEnvironment*>(env)->slots()[pc->b] = regs[pc->c];
+        NEXT();
+      }
+
+      OPCODE(LoadGlobal) {
+        Object* global = c->global_obj();
+        Property* prop = GetCachedProperty(&block_->caches[pc->b], global);
+        if (!prop) {
+          ThrowReferenceError(c);
+          THROW();
+        }
+        any_ref v = global->Get(prop);
+        CHECK(v);
+        regs[pc->a] = v;
+        NEXT();
+      }
+
+      OPCODE(LoadGlobalAndThis) {
+        Object* global = c->global_obj();
+        Property* prop = GetCachedProperty(&block_->caches[pc->b], global);
+        if (!prop) {
+          ThrowReferenceError(c);
+          THROW();
+        }
+        any_ref v = global->Get(prop);
+        CHECK(v);
+        regs[pc->a] = v;
+        // The global environment doesn't provide this.
+        regs[pc->a + 1] = any_ref::undefined();
+        NEXT();
+      }
+
+      OPCODE(TypeOfGlobal) {
+        // 11.4.3 The typeof Operator
+        Object* global = c->global_obj();
+        Property* prop = GetCachedProperty(&block_->caches[pc->b], global);
+        if (!prop) {
+          regs[pc->a] = TypeOf(any_ref::undefined());
+          NEXT();
+        }
+        any_ref v = global->Get(prop);
+        CHECK(v);
+        regs[pc->a] = TypeOf(v);
+        NEXT();
+      }
+
+      OPCODE(StoreGlobal) {
+        PropertyCache* cache = &block_->caches[pc->a];
+        Object* global = c->global_obj();
+        if (strict_ && !global->GetProperty(GetString(cache->name))) {
+          ThrowReferenceError(c);
+          THROW();
+        }
+        CHECK(PutCachedProperty(cache, global, regs[pc->b]));
+        NEXT();
+      }
+
+      OPCODE(LoadName) {
+        // 11.1.2 Identifier Reference
+        Environment* env;
+        any_ref v = GetIdentifierValue(c, cur_env_, GetString(pc->b), true, env);
+        CHECK(v);
+        regs[pc->a] = v;
+        NEXT();
+      }
+
+      OPCODE(LoadNameAndThis) {
+        Environment* env;
+        any_ref v = GetIdentifierValue(c, cur_env_, GetString(pc->b), true, env);
+        CHECK(v);
+        regs[pc->a] = v;
+        regs[pc->a + 1] = GetIdentifierThisValue(c, cur_env_, env);
+        NEXT();
+      }
+
+      OPCODE(TypeOfName) {
+        // 11.4.3 The typeof Operator
+        Environment* env;
+        any_ref v = GetIdentifierValue(c, cur_env_, GetString(pc->b), false, env);
+        CHECK(v);
+        regs[pc->a] = TypeOf(v);
+        NEXT();
+      }
+
+      OPCODE(StoreName) {
+        CHECK(PutIdentifierValue(c, cur_env_, GetString(pc->a), regs[pc->b], strict_));
+        NEXT();
+      }
+
+      OPCODE(DeleteName) {
+        // 11.4.1 The delete Operator
+        regs[pc->a] = DeleteIdentifier(cur_env_, GetString(pc->b));
+        NEXT();
+      }
+
+      OPCODE(GetProp) {
+        // 11.2.1 Property Accessors
+        CHECK(CheckObjectCoercible(c, regs[pc->b]));
+        Object* o = ToObject(c, regs[pc->b]);
+        CHECK(o);
+        Property* prop = GetCachedProperty(&block_->caches[pc->c], o);
+        any_ref v = prop ? o->Get(prop) : any_ref::undefined();
+        CHECK(v);
+        regs[pc->a] = v;
+        NEXT();
+      }
+
+      OPCODE(GetElem) {
+        any_ref k = regs[pc->c];
+        // Indices don't need to be made into names.
+        bool is_index = k.is_smi() && k.smi() >= 0;
+        u16string n;
+        if (!is_index) {
+          n = ToString(c, k);
+          CHECK(n);
+        }
+        CHECK(CheckObjectCoercible(c, regs[pc->b]));
+        Object* o = ToObject(c, regs[pc->b]);
+        CHECK(o);
+        any_ref v = is_index ? o->Get(static_cast<uint32_t>(k.smi())) : o->Get(n);
+        CHECK(v);
+        regs[pc->a] = v;
+        NEXT();
+      }
+
+      OPCODE(PutProp) {
+        CHECK(CheckObjectCoercible(c, regs[pc->a]));
+        Object* o = ToObject(c, regs[pc->a]);
+        CHECK(o);
+        CHECK(PutCachedProperty(&block_->caches[pc->b], o, regs[pc->c]));
+        NEXT();
+      }
+
+      OPCODE(PutElem) {
+        any_ref k = regs[pc->b];
+        bool is_index = k.is_smi() && k.smi() >= 0;
+        u16string n;
+        if (!is_index) {
+          n = ToString(c, k);
+          CHECK(n);
+        }
+        CHECK(CheckObjectCoercible(c, regs[pc->a]));
+        Object* o = ToObject(c, regs[pc->a]);
+        CHECK(o);
+        if (is_index) {
+          CHECK(o->Put(c, static_cast<uint32_t>(k.smi()), regs[pc->c], strict_));
+        } else {
+          CHECK(o->Put(c, n, regs[pc->c], strict_));
+        }
+        NEXT();
+      }
+
+      OPCODE(DeleteElem) {
+        // 11.4.1 The delete Operator
+        any_ref k = regs[pc->c];
+        bool is_index = k.is_smi() && k.smi() >= 0;
+        u16string n;
+        if (!is_index) {
+          n = ToString(c, k);
+          CHECK(n);
+        }
+        CHECK(CheckObjectCoercible(c, regs[pc->b]));
+        Object* o = ToObject(c, regs[pc->b]);
+        CHECK(o);
+        if (is_index) {
+          CHECK(o->Delete(c, static_cast<uint32_t>(k.smi()), strict_));
+        } else {
+          CHECK(o->Delete(c, n, strict_));
+        }
+        regs[pc->a] = true;
+        NEXT();
+      }
+
+      CHECKED_BINARY_OPCODE(Multiply, kBinaryMultiplication, SmiMultiply)
+      BINARY_OPCODE(Divide, kBinaryDivision)
+      BINARY_OPCODE(Remainder, kBinaryRemainder)
+      CHECKED_BINARY_OPCODE(Add, kBinaryAddition, SmiAdd)
+      CHECKED_BINARY_OPCODE(Subtract, kBinarySubtraction, SmiSubtract)
+      BINARY_OPCODE(LeftShift, kBinaryLeftShift)
+      BINARY_OPCODE(SignedRightShift, kBinarySignedRightShift)
+      BINARY_OPCODE(UnsignedRightShift, kBinaryUnsignedRightShift)
+      SMI_BINARY_OPCODE(LessThan, kBinaryLessThan, <)
+      SMI_BINARY_OPCODE(GreaterThan, kBinaryGreaterThan, >)
+      SMI_BINARY_OPCODE(LessThanOrEqual, kBinaryLessThanOrEqual, <=)
+      SMI_BINARY_OPCODE(GreaterThanOrEqual, kBinaryGreaterThanOrEqual, >=)
+      BINARY_OPCODE(InstanceOf, kBinaryInstanceOf)
+      BINARY_OPCODE(In, kBinaryIn)
+      SMI_BINARY_OPCODE(Equals, kBinaryEquals, ==)
+      SMI_BINARY_OPCODE(DoesNotEqual, kBinaryDoesNotEqual, !=)
+      SMI_BINARY_OPCODE(StrictEquals, kBinaryStrictEquals, ==)
+      SMI_BINARY_OPCODE(StrictDoesNotEqual, kBinaryStrictDoesNotEqual, !=)
+      SMI_BINARY_OPCODE(BitwiseAnd, kBinaryBitwiseAnd, &)
+      SMI_BINARY_OPCODE(BitwiseXor, kBinaryBitwiseXor, ^)
+      SMI_BINARY_OPCODE(BitwiseOr, kBinaryBitwiseOr, |)
+
+      UNARY_OPCODE(Positive, kUnaryPositive)
+      UNARY_OPCODE(Negative, kUnaryNegative)
+      UNARY_OPCODE(BitwiseNot, kUnaryBitwiseNot)
+      UNARY_OPCODE(LogicalNot, kUnaryLogicalNot)
+
+      OPCODE(TypeOf) {
+        regs[pc->a] = TypeOf(regs[pc->b]);
+        NEXT();
+      }
+
+      UPDATE_OPCODE(Increment, kUpdateIncrement)
+      UPDATE_OPCODE(Decrement, kUpdateDecrement)
+
+      FAST_OPCODE(Jump) {
+        JUMP(pc->a);
+      }
+
+      FAST_OPCODE(JumpIfTrue) {
+        if (ToBoolean(regs[pc->a])) JUMP(pc->b);
+        NEXT();
+      }
+
+      FAST_OPCODE(JumpIfFalse) {
+        if (!ToBoolean(regs[pc->a])) JUMP(pc->b);
+        NEXT();
+      }
+
+      OPCODE(NewObject) {
+        // 11.1.5 Object Initialiser
+        regs[pc->a] = Object::Alloc(c->object_proto());
+        NEXT();
+      }
+
+      OPCODE(NewArray) {
+        // 11.1.4 Array Initialiser
+        regs[pc->a] = NewArrayObject(c);
+        NEXT();
+      }
+
+      OPCODE(InitProp) {
+        Object* o = regs[pc->a].as<Object>();
+        CHECK(o->Put(c, GetString(pc->b), regs[pc->c], false));
+        NEXT();
+      }
+
+      OPCODE(InitGetter) {
+        Object* o = regs[pc->a].as<Object>();
+        Property* desc = o->NewOwnProperty(GetString(pc->b));
+        desc->value_or_get = regs[pc->c];
+        desc->flags = Property::kAccessor | Property::kEnumerable | Property::kConfigurable;
+        NEXT();
+      }
+
+      OPCODE(InitSetter) {
+        Object* o = regs[pc->a].as<Object>();
+        Property* desc = o->NewOwnProperty(GetString(pc->b));
+        desc->set = regs[pc->c];
+        desc->flags = Property::kAccessor | Property::kEnumerable | Property::kConfigurable;
+        NEXT();
+      }
+
+      OPCODE(InitElem) {
+        Object* o = regs[pc->a].as<Object>();
+        CHECK(o->Put(c, static_cast<uint32_t>(pc->b), regs[pc->c], false));
+        NEXT();
+      }
+
+      OPCODE(Closure) {
+        // 13 Function Definition
+        CodeBlock* block = script_->bytecode()->blocks[pc->b];
+        Object* o = NewFunctionObject(c, script_, cur_env_, block->function);
+        o->host_data.as<Function>()->block = block;
+        regs[pc->a] = o;
+        NEXT();
+      }
+
+      OPCODE(Call) {
+        // 11.2.3 Function Calls
+        any_ref func_val = regs[pc->b];
+        if (!func_val.is<Object>()) {
+          ThrowTypeError(c);
+          THROW();
+        }
+        Object* func_obj = func_val.as<Object>();
+        if (!IsCallable(func_obj)) {
+          ThrowTypeError(c);
+          THROW();
+        }
+        any_ref v = func_obj->Call(pc->c, &regs[pc->b + 1]);
+        CHECK(v);
+        regs[pc->a] = v;
+        NEXT();
+      }
+
+      OPCODE(New) {
+        // 11.2.2 The new Operator
+        any_ref func_val = regs[pc->b];
+        if (!func_val.is<Object>()) {
+          ThrowTypeError(c);
+          THROW();
+        }
+        Object* func_obj = func_val.as<Object>();
+        if (!IsCallable(func_obj)) {
+          ThrowTypeError(c);
+          THROW();
+        }
+        regs[pc->b + 1] = nullptr;
+        any_ref v = func_obj->Construct(pc->c, &regs[pc->b + 1]);
+        CHECK(v);
+        regs[pc->a] = v;
+        NEXT();
+      }
+
+      OPCODE(Return) {
+        return regs[pc->a];
+      }
+
+      OPCODE(Throw) {
+        // 12.13 The throw Statement
+        Throw(regs[pc->a]);
+        THROW();
+      }
+
+      OPCODE(ThrowReferenceError) {
+        ThrowReferenceError(c);
+        THROW();
+      }
+
+      OPCODE(ThrowSyntaxError) {
+        ThrowSyntaxError(c);
+        THROW();
+      }
+
+      OPCODE(Catch) {
+        regs[pc->a] = Catch();
+        NEXT();
+      }
+
+      OPCODE(GetEnv) {
+        regs[pc->a] = cur_env_;
+        NEXT();
+      }
+
+      OPCODE(SetEnv) {
+        cur_env_ = static_cast<Environment*>(regs[pc->a].get());
+        NEXT();
+      }
+
+      OPCODE(EnterWith) {
+        // 12.10 The with Statement
+        Object* o = ToObject(c, regs[pc->a]);
+        CHECK(o);
+        ObjectEnvironment* obj_env = ObjectEnvironment::Alloc(cur_env_);
+        obj_env->bindings_obj = o;
+        obj_env->provide_this = true;
+        cur_env_ = obj_env;
+        NEXT();
+      }
+
+      OPCODE(EnterCatch) {
+        // 12.14 The try Statement
+        DeclarativeEnvironment* env = DeclarativeEnvironment::Alloc(cur_env_, 1, script_, &block_->catch_names[pc->b]);
+        env->slots()[0] = regs[pc->a];
+        cur_env_ = env;
+        NEXT();
+      }
+
+      OPCODE(ForInPrepare) {
+        // 12.6.4 The for-in Statement
+        any_ref v = regs[pc->b];
+        any_vector names;
+        names.init();
+        if (!v.is_null() && !v.is_undefined()) {
+          Object* o = ToObject(c, v);
+          CHECK(o);
+          o->GetOwnEnumerableNames(names);
+        }
+        regs[pc->a] = NewArrayObject(c, names.size(), names.data());
+        regs[pc->a + 1] = 0;
+        NEXT();
+      }
+
+      OPCODE(ForInNext) {
+        Object* names = regs[pc->b].as<Object>();
+        int i = regs[pc->b + 1].smi();
+        if (static_cast<uint32_t>(i) >= names->host_data.as<Array>()->length) {
+          pc = code + pc->c;
+          DISPATCH();
+        }
+        regs[pc->a] = names->Get(static_cast<uint32_t>(i));
+        regs[pc->b + 1] = i + 1;
+        NEXT();
+      }
+
+#ifndef NABLA_THREADED_DISPATCH
+      default:
+        assert(false);
+        return nullptr;
+#endif
+    }
+
+  throw_exception:
+    // 12.14 The try Statement
+    {
+      int offset = static_cast<int>(pc - code);
+      auto& handlers = block_->handlers;
+      size_t i = handlers.size();
+      while (i-- > 0) {
+        const ExceptionHandler& h = handlers[i];
+        if (h.start <= offset && offset < h.end) break;
+      }
+      if (i == static_cast<size_t>(-1)) return nullptr;
+      const ExceptionHandler& h = handlers[i];
+      cur_env_ = static_cast<Environment*>(regs[h.env].get());
+      pc = code + h.target;
+    }
+  }
+
+#undef UPDATE_OPCODE
+#undef UNARY_OPCODE
+#undef CHECKED_BINARY_OPCODE
+#undef SMI_BINARY_OPCODE
+#undef BINARY_OPCODE
+#undef CHECK
+#undef THROW
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+#undef OPCODE
+#undef SYNC_PC
+#undef FAST_OPCODE
+}
+
+}  // namespace internal
+}  // namespace nabla
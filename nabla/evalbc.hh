@@ -0,0 +1,50 @@
+/* Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+ * Copyright (C) 2014 Katsuya Iida. All rights reserved.
+ */
+
+#pragma once
+
+#ifndef NABLA_EVALBC_HH_
+#define NABLA_EVALBC_HH_
+
+#include "bytecode.hh"
+#include "context.hh"
+#include "data.hh"
+#include "profile.hh"
+
+namespace nabla {
+namespace internal {
+
+class BytecodeEvaluator {
+ public:
+  static any_ref EvalScript(Context* context, Script* script);
+  static any_ref CallFunction(Function* fn, any_ref this_val, size_t argc, const any_ref* argv);
+  // Counts of the lookups through the inline caches of all the scripts.
+  static void GetCacheStats(size_t& hits, size_t& misses, size_t& megamorphic);
+
+ private:
+  BytecodeEvaluator(Context* context, Script* script, CodeBlock* block, Environment* env, any_ref this_val, bool strict);
+  ~BytecodeEvaluator() { frame_.Pop(); }
+
+  void InitBindings();
+  any_ref Run();
+  Property* GetCachedProperty(PropertyCache* cache, Object* o);
+  bool PutCachedProperty(PropertyCache* cache, Object* o, any_ref v);
+
+  u16string GetString(int index) const {
+    return script_->string_table()[index];
+  }
+
+  Context* context_;
+  Script* script_;
+  CodeBlock* block_;
+  Environment* cur_env_;
+  any_ref this_val_;
+  bool strict_;
+  StackFrame frame_;
+};
+
+}  // namespace internal
+}  // namespace nabla
+
+#endif  // NABLA_EVALBC_HH_
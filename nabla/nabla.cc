@@ -11,6 +11,7 @@
 #include <readline/readline.h>
 #include <readline/history.h>
 #endif
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #ifndef NO_GETOPT_LONG
@@ -22,6 +23,7 @@
 #include <vector>
 
 extern void run_test();
+extern void run_self_test();
 
 static const char* prompt_string = PACKAGE "> ";
 static const char* startup_message =
@@ -32,6 +34,20 @@ static const char* usage_message =
   "Usage: " PACKAGE " [OPTION]... [FILE]...\n"
   "Evaluate JavaScript code, interactively or from a script.\n"
   "\n"
+  "      --ast      evaluate with the AST walker instead of bytecode\n"
+  "      --ic-stats print inline cache counts on exit\n"
+  "      --meminfo  print heap usage on exit\n"
+  "      --gc-stats print collector statistics and live objects on exit\n"
+  "      --incremental-gc\n"
+  "                 collect in small steps to keep pauses short\n"
+  "      --heap-snapshot=FILE\n"
+  "                 write the reachable objects to FILE on exit\n"
+  "      --alloc-profile=FILE\n"
+  "                 write where the scripts allocate to FILE on exit\n"
+  "      --cpu-profile=FILE\n"
+  "                 write where the scripts spend CPU time to FILE on exit\n"
+  "      --self-test\n"
+  "                 run the tests that change process-wide state and exit\n"
   "  -h, --help     display this help and exit\n"
   "  -v, --version  display version information and exit\n"
   "\n"
@@ -47,7 +63,21 @@ static const char* version_message =
   "There is NO WARRANTY, to the extent permitted by law.\n"
   ;
 
-static void show_meminfo()
+static void show_allocinfo(double seconds)
+{
+  nabla::allocinfo info;
+  nabla::getallocinfo(&info);
+  std::cerr << "Allocations: cached: " << info.cached << ", refills: " << info.refills << std::endl;
+  for (size_t i = 0; i < info.num_kinds; i++) {
+    const nabla::allocstat& k = info.kinds[i];
+    if (!k.count) continue;
+    std::cerr << "  " << k.name << ": " << k.count << " (" << k.bytes << " bytes";
+    if (seconds > 0) std::cerr << ", " << static_cast<size_t>(k.count / seconds) << "/s";
+    std::cerr << ")" << std::endl;
+  }
+}
+
+static void show_meminfo(double seconds)
 {
   nabla::meminfo info;
   nabla::getmeminfo(&info);
@@ -55,6 +85,43 @@ static void show_meminfo()
   nabla::gc();
   nabla::getmeminfo(&info);
   std::cerr << "After GC:  Heap size: " << info.heap_size << ", free bytes: " << info.free_bytes << std::endl;
+  if (info.guard_bytes) {
+    std::cerr << "Guard zones: " << info.guard_bytes << " bytes" << std::endl;
+  }
+  size_t num_pauses = 0;
+  for (size_t i = 0; i < nabla::meminfo::pause_buckets; i++) num_pauses += info.pauses[i];
+  std::cerr << "GC pauses:" << (num_pauses ? "" : " none") << std::endl;
+  for (size_t i = 0; i < nabla::meminfo::pause_buckets; i++) {
+    if (!info.pauses[i]) continue;
+    size_t low = static_cast<size_t>(nabla::meminfo::min_pause_us) << i;
+    if (i + 1 < nabla::meminfo::pause_buckets) {
+      std::cerr << "  " << low << "-" << low * 2 << "us: " << info.pauses[i] << std::endl;
+    } else {
+      std::cerr << "  >= " << low << "us: " << info.pauses[i] << std::endl;
+    }
+  }
+  show_allocinfo(seconds);
+}
+
+static void show_gcinfo()
+{
+  nabla::gcinfo info;
+  nabla::getgcinfo(&info);
+  std::cerr << "Collections: " << info.collections << ", pauses: " << info.pauses << ", total pause: " << info.total_pause_us << "us, max pause: " << info.max_pause_us << "us" << std::endl;
+  std::cerr << "Allocated: " << info.bytes_allocated << " bytes" << std::endl;
+  std::cerr << "Live objects:" << std::endl;
+  for (size_t i = 0; i < info.num_kinds; i++) {
+    const nabla::allocstat& k = info.live[i];
+    if (!k.count) continue;
+    std::cerr << "  " << k.name << ": " << k.count << " (" << k.bytes << " bytes)" << std::endl;
+  }
+}
+
+static void show_cacheinfo()
+{
+  nabla::cacheinfo info;
+  nabla::getcacheinfo(&info);
+  std::cerr << "Inline caches: hits: " << info.hits << ", misses: " << info.misses << ", megamorphic: " << info.megamorphic << std::endl;
 }
 
 static void usage()
@@ -133,13 +200,39 @@ void interactive(nabla::context& c) {
 int optind = 1;
 #endif
 
+// Values returned by getopt_long for the options that take an argument,
+// past those of the short options.
+enum {
+  kHeapSnapshotOption = 256,
+  kAllocProfileOption,
+  kCpuProfileOption
+};
+
 int main(int argc, char* argv[])
 {
   int interactive_flag = 0;
+  int ast_flag = 0;
+  int ic_stats_flag = 0;
+  int meminfo_flag = 0;
+  int incremental_gc_flag = 0;
+  int gc_stats_flag = 0;
+  int self_test_flag = 0;
+  const char* heap_snapshot_path = nullptr;
+  const char* alloc_profile_path = nullptr;
+  const char* cpu_profile_path = nullptr;
 
 #ifndef NO_GETOPT_LONG
   while (true) {
     static struct option long_options[] = {
+      { "ast",     no_argument, &ast_flag, 1 },
+      { "ic-stats", no_argument, &ic_stats_flag, 1 },
+      { "meminfo", no_argument, &meminfo_flag, 1 },
+      { "incremental-gc", no_argument, &incremental_gc_flag, 1 },
+      { "gc-stats", no_argument, &gc_stats_flag, 1 },
+      { "self-test", no_argument, &self_test_flag, 1 },
+      { "heap-snapshot", required_argument, 0, kHeapSnapshotOption },
+      { "alloc-profile", required_argument, 0, kAllocProfileOption },
+      { "cpu-profile", required_argument, 0, kCpuProfileOption },
       { "help",    no_argument, 0, 'h' },
       { "version", no_argument, 0, 'v' },
       { 0, 0, 0, 0 }
@@ -152,6 +245,15 @@ int main(int argc, char* argv[])
     switch (c) {
     case 0:
       break;
+    case kHeapSnapshotOption:
+      heap_snapshot_path = optarg;
+      break;
+    case kAllocProfileOption:
+      alloc_profile_path = optarg;
+      break;
+    case kCpuProfileOption:
+      cpu_profile_path = optarg;
+      break;
     case 'h':
       usage();
       break;
@@ -164,13 +266,23 @@ int main(int argc, char* argv[])
   }
 #endif
   
-  nabla::init();
+  nabla::init(incremental_gc_flag ? nabla::gc_incremental : nabla::gc_full);
+  if (ast_flag) nabla::set_evaluator(nabla::evaluator_ast);
   run_test();
-  if (false) show_meminfo();
+  if (self_test_flag) {
+    run_self_test();
+    exit(EXIT_SUCCESS);
+  }
+  if (alloc_profile_path) nabla::start_alloc_profile();
+  if (cpu_profile_path && !nabla::start_cpu_profile()) {
+    std::cerr << "CPU profiling is not supported on this platform" << std::endl;
+    exit(1);
+  }
   if (optind == argc) {
     interactive_flag = 1;
   }
 
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
   nabla::context c;
 
   while (optind < argc) {
@@ -185,5 +297,25 @@ int main(int argc, char* argv[])
     interactive(c);
   }
 
+  if (heap_snapshot_path && !c.write_heap_snapshot(heap_snapshot_path)) {
+    std::cerr << heap_snapshot_path << ": I/O error" << std::endl;
+    exit(1);
+  }
+  if (alloc_profile_path && !nabla::write_alloc_profile(alloc_profile_path)) {
+    std::cerr << alloc_profile_path << ": I/O error" << std::endl;
+    exit(1);
+  }
+  if (cpu_profile_path && !nabla::write_cpu_profile(cpu_profile_path)) {
+    std::cerr << cpu_profile_path << ": I/O error" << std::endl;
+    exit(1);
+  }
+
+  if (ic_stats_flag) show_cacheinfo();
+  if (gc_stats_flag) show_gcinfo();
+  if (meminfo_flag) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    show_meminfo(elapsed.count());
+  }
+
   return EXIT_SUCCESS;
 }
@@ -21,16 +21,58 @@ extern const int minor_version;
 extern const int micro_version;
 
 struct meminfo;
+struct allocinfo;
+struct gcinfo;
+struct cacheinfo;
 
-void init();
+enum evaluator_type {
+  evaluator_bytecode,
+  evaluator_ast
+};
+
+enum gc_mode {
+  // Each collection stops the program until the whole heap is marked.
+  gc_full,
+  // The collector marks in small steps during allocation and collects
+  // young objects more often, which shortens the pauses on large heaps at
+  // some cost in throughput.
+  gc_incremental
+};
+
+void init(gc_mode mode = gc_full);
 void gc();
 void getmeminfo(meminfo* info);
+void getallocinfo(allocinfo* info);
+// Runs a full collection to count the live objects. The collection and
+// its pause are not included in the statistics returned.
+void getgcinfo(gcinfo* info);
+void getcacheinfo(cacheinfo* info);
+// Records where the scripts allocate heap objects, sampling about one
+// allocation in every interval bytes.
+void start_alloc_profile(size_t interval = 32 * 1024);
+// Writes the samples to path as folded stacks for flame graphs: one line
+// per stack, from the outermost function to the kind of the object, with
+// the estimated bytes allocated there. Returns false if the file couldn't
+// be written.
+bool write_alloc_profile(const char* path);
+// Records where the scripts spend CPU time, sampling their stacks every
+// interval_us microseconds. Returns false if the platform can't.
+bool start_cpu_profile(int interval_us = 1000);
+// Writes the samples to path as folded stacks for flame graphs: one line
+// per stack, from the outermost function to the line being run, with the
+// number of samples taken there. Returns false if the file couldn't be
+// written.
+bool write_cpu_profile(const char* path);
+void set_evaluator(evaluator_type type);
 
 class context {
  public:
   context();
   ~context();
   bool eval(const std::u16string& source, const std::u16string& name, std::u16string& r);
+  // Writes the objects reachable from the context to path for
+  // tools/heapsnapshot.py. Returns false if the file couldn't be written.
+  bool write_heap_snapshot(const char* path);
 
  private:
   void* data_;
@@ -39,6 +81,52 @@ class context {
 struct meminfo {
   size_t heap_size;
   size_t free_bytes;
+  // Bytes spent on overrun detection in builds with NABLA_GC_GUARD.
+  size_t guard_bytes;
+  // Pauses seen by allocations and gc(). Bucket i counts the pauses of
+  // min_pause_us << i microseconds up to twice that; the last bucket also
+  // counts all longer ones.
+  static const size_t pause_buckets = 16;
+  static const unsigned min_pause_us = 50;
+  size_t pauses[pause_buckets];
+};
+
+// Allocations of one kind of heap object since init().
+struct allocstat {
+  const char* name;
+  size_t count;
+  size_t bytes;
+};
+
+struct allocinfo {
+  static const size_t max_kinds = 16;
+  size_t num_kinds;
+  allocstat kinds[max_kinds];
+  // Allocations served from the size-class caches, and the batches taken
+  // from the collector to refill them.
+  size_t cached;
+  size_t refills;
+};
+
+struct gcinfo {
+  size_t collections;
+  // Pauses seen by allocations and gc(); see meminfo::pauses.
+  size_t pauses;
+  uint64_t total_pause_us;
+  uint64_t max_pause_us;
+  // Bytes allocated since init(), including the blocks freed since.
+  size_t bytes_allocated;
+  // Live objects of each kind, with their total size.
+  size_t num_kinds;
+  allocstat live[allocinfo::max_kinds];
+};
+
+// Counts of the property lookups through the inline caches.
+struct cacheinfo {
+  size_t hits;
+  size_t misses;
+  // Caches that got more shapes than they can hold.
+  size_t megamorphic;
 };
 
 }  // namespace nabla
@@ -0,0 +1,269 @@
+/* Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+ * Copyright (C) 2014 Katsuya Iida. All rights reserved.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "profile.hh"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <gc/gc.h>
+#include <map>
+#include <string>
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+#include <vector>
+
+#include "bytecode.hh"
+
+namespace nabla {
+namespace internal {
+
+std::atomic<StackFrame*> StackFrame::current_(nullptr);
+volatile std::sig_atomic_t StackFrame::drain_requested_ = 0;
+
+Position StackFrame::position() const {
+  if (pc) return block->positions[pc - block->code.data()];
+  if (node) return node->loc.start;
+  Position none = { 0, 0 };
+  return none;
+}
+
+namespace {
+
+// Frames beyond this many from the innermost one are left out of the
+// recorded stacks, so that deep recursion doesn't make every sample long.
+const size_t kMaxFrames = 128;
+
+// Folded stack to the estimated bytes allocated there.
+std::map<std::string, double> alloc_sites;
+
+// Appends s as UTF-8. Ropes that weren't flattened yet are left out, since
+// reading them would allocate.
+void append_string(std::string& out, u16string s) {
+  if (!s) return;
+  const u16string_data* first;
+  const u16string_data* second;
+  s.get__()->get_parts(first, second);
+  if (s.get__()->is_rope() && second) return;
+  for (size_t i = 0; i < s.length(); i++) {
+    uint32_t u = s[i];
+    if (u >= 0xd800 && u < 0xdc00 && i + 1 < s.length() && s[i + 1] >= 0xdc00 && s[i + 1] < 0xe000) {
+      u = 0x10000 + ((u - 0xd800) << 10) + (s[++i] - 0xdc00);
+    }
+    if (u < 0x80) {
+      out += static_cast<char>(u);
+    } else if (u < 0x800) {
+      out += static_cast<char>(0xc0 | (u >> 6));
+      out += static_cast<char>(0x80 | (u & 0x3f));
+    } else if (u < 0x10000) {
+      out += static_cast<char>(0xe0 | (u >> 12));
+      out += static_cast<char>(0x80 | ((u >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (u & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | (u >> 18));
+      out += static_cast<char>(0x80 | ((u >> 12) & 0x3f));
+      out += static_cast<char>(0x80 | ((u >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (u & 0x3f));
+    }
+  }
+}
+
+// Appends "name file:line" for a frame running function, or the program
+// if it is nullptr, of script.
+void append_frame(std::string& out, Script* script, const FunctionNode* function, int line) {
+  if (!function) {
+    out += "(program)";
+  } else if (!function->id) {
+    out += "(anonymous)";
+  } else {
+    append_string(out, script->string_table()[function->id->name]);
+  }
+  out += ' ';
+  append_string(out, script->source_name());
+  char buf[16];
+  snprintf(buf, sizeof buf, ":%d", line);
+  out += buf;
+}
+
+// Returns the current stack as folded frames from the outermost one, each
+// followed by a semicolon.
+std::string folded_stack() {
+  std::vector<const StackFrame*> frames;
+  for (const StackFrame* f = StackFrame::current(); f && frames.size() < kMaxFrames; f = f->caller) {
+    frames.push_back(f);
+  }
+  std::string stack;
+  if (frames.size() == kMaxFrames) stack += "(truncated);";
+  for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+    append_frame(stack, (*it)->script, (*it)->function, (*it)->position().line);
+    stack += ';';
+  }
+  return stack;
+}
+
+void record_allocation(heap_data::tag t, size_t n, double weight) {
+  alloc_sites[folded_stack() + tag_name(t)] += weight * n;
+}
+
+// A frame of a sample taken by the CPU profiler. Each sample starts with
+// a record holding only the number of frames that follow it, from the
+// innermost one.
+struct SampledFrame {
+  Script* script;
+  FunctionNode* function;
+  int line;
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "the sample buffer needs lock-free indices");
+static_assert(ATOMIC_POINTER_LOCK_FREE == 2, "the signal handler needs a lock-free current frame");
+
+// Records in the ring buffer SIGPROF writes samples to. It is allocated
+// uncollectable, so that the scripts of samples not drained yet stay
+// alive with their AST.
+const uint32_t kSampleBufferSize = 1 << 15;
+SampledFrame* samples = nullptr;
+// Free running indices of the next record to write and to read. Only the
+// signal handler moves the head, and only DrainCpuSamples() the tail.
+std::atomic<uint32_t> sample_head(0);
+std::atomic<uint32_t> sample_tail(0);
+// Samples that didn't fit in the buffer.
+std::atomic<uint32_t> samples_dropped(0);
+
+// Folded stack to the number of samples taken there.
+std::map<std::string, uint64_t> cpu_stacks;
+
+#ifdef ITIMER_PROF
+bool cpu_profiling = false;
+struct sigaction old_sigprof;
+
+// Copies the current stack into the buffer. Runs in a signal handler, so
+// it only reads the frames and never allocates.
+void sample_cpu(int) {
+  uint32_t head = sample_head.load(std::memory_order_relaxed);
+  uint32_t tail = sample_tail.load(std::memory_order_acquire);
+  uint32_t n = 0;
+  for (const StackFrame* f = StackFrame::current(); f && n < kMaxFrames; f = f->caller) n++;
+  if (kSampleBufferSize - (head - tail) < n + 1) {
+    samples_dropped.fetch_add(1, std::memory_order_relaxed);
+    StackFrame::RequestDrain(true);
+    return;
+  }
+  SampledFrame& first = samples[head++ % kSampleBufferSize];
+  first.script = nullptr;
+  first.function = nullptr;
+  first.line = n;
+  const StackFrame* f = StackFrame::current();
+  for (uint32_t i = 0; i < n; i++, f = f->caller) {
+    SampledFrame& frame = samples[head++ % kSampleBufferSize];
+    frame.script = f->script;
+    frame.function = f->function;
+    frame.line = f->position().line;
+  }
+  sample_head.store(head, std::memory_order_release);
+  if (head - tail >= kSampleBufferSize / 2) StackFrame::RequestDrain(true);
+}
+#endif
+
+}  // namespace
+
+void StartAllocationProfile(size_t interval) {
+  alloc_sites.clear();
+  set_alloc_sampler(record_allocation, interval);
+}
+
+void StopAllocationProfile() {
+  set_alloc_sampler(nullptr, 0);
+}
+
+bool WriteAllocationProfile(FILE* out) {
+  for (auto it = alloc_sites.begin(); it != alloc_sites.end(); ++it) {
+    fprintf(out, "%s %.0f\n", it->first.c_str(), it->second);
+  }
+  fflush(out);
+  return !ferror(out);
+}
+
+void DrainCpuSamples() {
+  StackFrame::RequestDrain(false);
+  if (!samples) return;
+  uint32_t head = sample_head.load(std::memory_order_acquire);
+  uint32_t tail = sample_tail.load(std::memory_order_relaxed);
+  while (tail != head) {
+    uint32_t n = samples[tail++ % kSampleBufferSize].line;
+    std::string stack;
+    if (n == 0) stack = "(no script)";
+    if (n == kMaxFrames) stack += "(truncated);";
+    for (uint32_t i = n; i-- > 0;) {
+      SampledFrame& frame = samples[(tail + i) % kSampleBufferSize];
+      append_frame(stack, frame.script, frame.function, frame.line);
+      if (i > 0) stack += ';';
+      frame.script = nullptr;
+    }
+    cpu_stacks[stack]++;
+    tail += n;
+  }
+  sample_tail.store(tail, std::memory_order_release);
+}
+
+bool StartCpuProfile(int interval_us) {
+#ifdef ITIMER_PROF
+  StopCpuProfile();
+  cpu_stacks.clear();
+  samples_dropped.store(0);
+  if (!samples) {
+    samples = static_cast<SampledFrame*>(GC_MALLOC_UNCOLLECTABLE(sizeof (SampledFrame) * kSampleBufferSize));
+    if (!samples) return false;
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof action);
+  action.sa_handler = sample_cpu;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  if (sigaction(SIGPROF, &action, &old_sigprof) != 0) return false;
+  struct itimerval timer;
+  timer.it_interval.tv_sec = interval_us / 1000000;
+  timer.it_interval.tv_usec = interval_us % 1000000;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    sigaction(SIGPROF, &old_sigprof, nullptr);
+    return false;
+  }
+  cpu_profiling = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void StopCpuProfile() {
+#ifdef ITIMER_PROF
+  if (cpu_profiling) {
+    struct itimerval timer;
+    memset(&timer, 0, sizeof timer);
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &old_sigprof, nullptr);
+    cpu_profiling = false;
+  }
+#endif
+  DrainCpuSamples();
+}
+
+bool WriteCpuProfile(FILE* out) {
+  DrainCpuSamples();
+  for (auto it = cpu_stacks.begin(); it != cpu_stacks.end(); ++it) {
+    fprintf(out, "%s %llu\n", it->first.c_str(), static_cast<unsigned long long>(it->second));
+  }
+  uint32_t dropped = samples_dropped.load();
+  if (dropped > 0) fprintf(out, "(dropped) %u\n", dropped);
+  fflush(out);
+  return !ferror(out);
+}
+
+}  // namespace internal
+}  // namespace nabla
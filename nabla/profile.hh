@@ -0,0 +1,104 @@
+/* Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+ * Copyright (C) 2014 Katsuya Iida. All rights reserved.
+ */
+
+#pragma once
+
+#ifndef NABLA_PROFILE_HH_
+#define NABLA_PROFILE_HH_
+
+#include <atomic>
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
+
+#include "ast.hh"
+#include "context.hh"
+
+namespace nabla {
+namespace internal {
+
+class CodeBlock;
+struct Instruction;
+
+// Moves the stacks the CPU profiler sampled into its counts.
+void DrainCpuSamples();
+
+// An activation of the program or of a function, linked to the one that
+// called it. The evaluators keep the innermost one in current() so that
+// the profilers can tell where the script is. The CPU profiler reads the
+// frames from a signal handler, so current() is an atomic and signal
+// fences keep the compiler from filling in a frame after it becomes
+// current, or reusing it before it stops being current.
+struct StackFrame {
+  static StackFrame* current() { return current_.load(std::memory_order_relaxed); }
+
+  // Makes this frame the innermost one for the code of f, or of the
+  // program if f is nullptr. Frames are popped in the reverse order.
+  void Push(Script* s, FunctionNode* f) {
+    caller = current();
+    script = s;
+    function = f;
+    node = f ? static_cast<const SyntaxNode*>(f) : s->program();
+    block = nullptr;
+    pc = nullptr;
+    std::atomic_signal_fence(std::memory_order_release);
+    current_.store(this, std::memory_order_relaxed);
+  }
+  void Pop() {
+    current_.store(caller, std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_acq_rel);
+    Poll();
+  }
+  // Drains the samples if the CPU profiler asked for it, as the signal
+  // handler can't. Called when frames are popped and on the backward
+  // jumps of loops, so that loops without calls are drained too.
+  static void Poll() {
+    if (drain_requested_) DrainCpuSamples();
+  }
+  // Makes the next Poll() drain the samples. Safe in a signal handler.
+  static void RequestDrain(bool on) { drain_requested_ = on; }
+
+  // The start of the node being evaluated.
+  Position position() const;
+
+  StackFrame* caller;
+  Script* script;
+  // nullptr for the program.
+  FunctionNode* function;
+  // The node the AST evaluator is at.
+  const SyntaxNode* node;
+  // The instruction the bytecode evaluator is at, whose position is in
+  // block.
+  const CodeBlock* block;
+  const Instruction* pc;
+
+ private:
+  static std::atomic<StackFrame*> current_;
+  // Set by the CPU profiler when its buffer is half full.
+  static volatile std::sig_atomic_t drain_requested_;
+};
+
+// Starts recording the stacks of about one allocation of heap objects in
+// every interval bytes, dropping the stacks recorded before.
+void StartAllocationProfile(size_t interval);
+void StopAllocationProfile();
+// Writes the recorded stacks as folded stacks, one line per stack with the
+// estimated bytes allocated there. Frames are separated by semicolons,
+// from the outermost one to the kind of the allocated object. Returns
+// false if writing failed.
+bool WriteAllocationProfile(FILE* out);
+
+// Starts sampling the stack every interval_us microseconds of CPU time,
+// dropping the stacks sampled before. Returns false if the platform has
+// no profiling timer.
+bool StartCpuProfile(int interval_us);
+void StopCpuProfile();
+// Writes the sampled stacks as folded stacks, one line per stack with the
+// number of samples taken there. Returns false if writing failed.
+bool WriteCpuProfile(FILE* out);
+
+}  // namespace internal
+}  // namespace nabla
+
+#endif  // NABLA_PROFILE_HH_
@@ -0,0 +1,295 @@
+/* Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+ * Copyright (C) 2014 Katsuya Iida. All rights reserved.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "snapshot.hh"
+
+#include <cstdint>
+#include <cstdio>
+#include <gc/gc.h>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hh"
+#include "builtin.hh"
+#include "context.hh"
+
+namespace nabla {
+namespace internal {
+
+namespace {
+
+// Longest prefix of a string written as the name of its node.
+const size_t kMaxNameLength = 40;
+
+// Returns the bytes the collector reserved for the block at p.
+size_t block_size(const void* p) {
+  if (!p) return 0;
+  void* base = GC_base(const_cast<void*>(p));
+  return base ? GC_size(base) : 0;
+}
+
+}  // namespace
+
+class HeapSnapshot {
+ public:
+  explicit HeapSnapshot(FILE* out) : out_(out), next_id_(1) {}
+
+  bool Write(Context* c);
+
+ private:
+  // Returns the id of o, queueing o to be written when it is first seen.
+  uint32_t Id(heap_data* o);
+
+  void WriteNode(uint32_t id, const char* kind, size_t size, const char* name, const u16string_data* s = nullptr);
+  // Writes an edge labelled with label followed by name.
+  void WriteEdge(heap_data* to, const char* label, const u16string_data* name = nullptr);
+  void WriteEdge(any_ref to, const char* label, const u16string_data* name = nullptr);
+  void WriteQuoted(const char* a, const u16string_data* s);
+  void WriteUnit(char16_t u);
+
+  void WriteObject(uint32_t id, Object* o);
+  void WriteFunction(uint32_t id, Function* f);
+  void WriteArray(uint32_t id, Array* a);
+  void WriteScript(uint32_t id, Script* s);
+  void WriteDeclarativeEnvironment(uint32_t id, DeclarativeEnvironment* env);
+  void WriteShape(uint32_t id, Shape* shape);
+  void WriteString(uint32_t id, u16string_data* s);
+  void WriteContext(uint32_t id, Context* c);
+
+  // Returns the name of the function, or nullptr for anonymous and native
+  // functions.
+  static const u16string_data* FunctionName(Function* f);
+
+  FILE* out_;
+  uint32_t next_id_;
+  std::unordered_map<heap_data*, uint32_t> ids_;
+  // Objects seen but not written yet.
+  std::vector<heap_data*> pending_;
+};
+
+bool HeapSnapshot::Write(Context* c) {
+  fputs("nabla-heap-snapshot 1\n", out_);
+  WriteNode(0, "Root", 0, "(roots)");
+  WriteEdge(c, "(context)");
+  while (!pending_.empty()) {
+    heap_data* o = pending_.back();
+    pending_.pop_back();
+    uint32_t id = ids_[o];
+    switch (o->get_tag()) {
+    case heap_data::kTagU16String:
+      WriteString(id, static_cast<u16string_data*>(o));
+      break;
+    case heap_data::kTagDouble: {
+      char buf[32];
+      snprintf(buf, sizeof buf, "%.17g", static_cast<double_data*>(o)->data());
+      WriteNode(id, "Number", block_size(o), buf);
+      break;
+    }
+    case heap_data::kTagObject:
+      WriteObject(id, o->as<Object>());
+      break;
+    case heap_data::kTagContext:
+      WriteContext(id, o->as<Context>());
+      break;
+    case heap_data::kTagScript:
+      WriteScript(id, static_cast<Script*>(o));
+      break;
+    case heap_data::kTagFunction:
+      WriteFunction(id, o->as<Function>());
+      break;
+    case heap_data::kTagArray:
+      WriteArray(id, o->as<Array>());
+      break;
+    case heap_data::kTagDeclarativeEnvironment:
+      WriteDeclarativeEnvironment(id, o->as<DeclarativeEnvironment>());
+      break;
+    case heap_data::kTagObjectEnvironment: {
+      ObjectEnvironment* env = o->as<ObjectEnvironment>();
+      WriteNode(id, "ObjectEnvironment", block_size(env), "");
+      WriteEdge(env->outer, "(outer)");
+      WriteEdge(env->bindings_obj, "(bindings)");
+      break;
+    }
+    case heap_data::kTagShape:
+      WriteShape(id, o->as<Shape>());
+      break;
+    default:
+      // Dates and regular expressions point to nothing in the GC heap.
+      WriteNode(id, tag_name(o->get_tag()), block_size(o), "");
+      break;
+    }
+  }
+  fflush(out_);
+  return !ferror(out_);
+}
+
+uint32_t HeapSnapshot::Id(heap_data* o) {
+  auto it = ids_.find(o);
+  if (it != ids_.end()) return it->second;
+  uint32_t id = next_id_++;
+  ids_[o] = id;
+  pending_.push_back(o);
+  return id;
+}
+
+void HeapSnapshot::WriteNode(uint32_t id, const char* kind, size_t size, const char* name, const u16string_data* s) {
+  fprintf(out_, "n %u %s %zu ", id, kind, size);
+  WriteQuoted(name, s);
+}
+
+void HeapSnapshot::WriteEdge(heap_data* to, const char* label, const u16string_data* name) {
+  if (!to) return;
+  fprintf(out_, "e %u ", Id(to));
+  WriteQuoted(label, name);
+}
+
+void HeapSnapshot::WriteEdge(any_ref to, const char* label, const u16string_data* name) {
+  if (!to.is_heap_data() || to.is_nil()) return;
+  WriteEdge(to.get(), label, name);
+}
+
+void HeapSnapshot::WriteQuoted(const char* a, const u16string_data* s) {
+  putc('"', out_);
+  for (const char* p = a; *p; p++) WriteUnit(static_cast<unsigned char>(*p));
+  if (s) {
+    // Reading the characters of a rope would flatten it into a new string.
+    const u16string_data* first;
+    const u16string_data* second;
+    s->get_parts(first, second);
+    if (s->is_rope() && second) {
+      fputs("(rope)", out_);
+    } else {
+      size_t n = s->length() < kMaxNameLength ? s->length() : kMaxNameLength;
+      for (size_t i = 0; i < n; i++) WriteUnit(s->at(i));
+      if (n < s->length()) fputs("...", out_);
+    }
+  }
+  fputs("\"\n", out_);
+}
+
+void HeapSnapshot::WriteUnit(char16_t u) {
+  if (u == '"' || u == '\\') {
+    putc('\\', out_);
+    putc(u, out_);
+  } else if (u < 0x20 || u >= 0x7f) {
+    fprintf(out_, "\\u%04x", static_cast<unsigned>(u));
+  } else {
+    putc(u, out_);
+  }
+}
+
+void HeapSnapshot::WriteObject(uint32_t id, Object* o) {
+  const u16string_data* name = nullptr;
+  if (o->host_data.is<Function>()) name = FunctionName(o->host_data.as<Function>());
+  WriteNode(id, "Object", block_size(o) + block_size(o->slots_), "", name);
+  WriteEdge(o->proto_, "__proto__");
+  WriteEdge(o->shape_, "(shape)");
+  for (uint32_t i = 0; i < o->num_own_slots(); i++) {
+    u16string key = o->OwnSlotName(i);
+    if (!key) continue;
+    const Property& prop = o->slots_[i];
+    if (prop.flags & Property::kAccessor) {
+      WriteEdge(prop.value_or_get, "get ", key.get__());
+      WriteEdge(prop.set, "set ", key.get__());
+    } else {
+      WriteEdge(prop.value_or_get, "", key.get__());
+    }
+  }
+  WriteEdge(o->host_data, "(host_data)");
+}
+
+void HeapSnapshot::WriteFunction(uint32_t id, Function* f) {
+  const u16string_data* name = FunctionName(f);
+  WriteNode(id, "Function", block_size(f), f->native_code ? "(native)" : "", name);
+  if (f->script) WriteEdge(static_cast<heap_data*>(f->script), "(script)");
+  WriteEdge(f->context, "(context)");
+  WriteEdge(f->scope, "(scope)");
+}
+
+void HeapSnapshot::WriteArray(uint32_t id, Array* a) {
+  WriteNode(id, "Array", block_size(a) + block_size(a->elements), "");
+  uint32_t n = a->length < a->capacity ? a->length : a->capacity;
+  for (uint32_t i = 0; i < n; i++) {
+    char label[16];
+    snprintf(label, sizeof label, "[%u]", i);
+    WriteEdge(a->elements[i], label);
+  }
+}
+
+void HeapSnapshot::WriteScript(uint32_t id, Script* s) {
+  WriteNode(id, "Script", block_size(s) + s->string_table_.heap_bytes(), "", s->name.get__());
+  WriteEdge(s->name, "(name)");
+  WriteEdge(s->source, "(source)");
+  for (auto it = s->string_table_.begin(); it != s->string_table_.end(); ++it) {
+    WriteEdge(*it, "(string_table)");
+  }
+}
+
+void HeapSnapshot::WriteDeclarativeEnvironment(uint32_t id, DeclarativeEnvironment* env) {
+  // Slots are in the same block as the environment.
+  WriteNode(id, "DeclarativeEnvironment", block_size(env) + env->bindings_.heap_bytes(), "");
+  WriteEdge(env->outer, "(outer)");
+  for (size_t i = 0; i < env->num_slots_; i++) {
+    WriteEdge(env->slots_[i], "", env->script_->string_table()[env->slot_names_[i]]);
+  }
+  if (env->num_slots_ > 0) WriteEdge(static_cast<heap_data*>(env->script_), "(script)");
+  for (auto it = env->bindings_.begin(); it != env->bindings_.end(); ++it) {
+    WriteEdge(it->second.value, "", it->first.get__());
+  }
+}
+
+void HeapSnapshot::WriteShape(uint32_t id, Shape* shape) {
+  size_t size = block_size(shape) + block_size(shape->keys_) + shape->transitions_.heap_bytes();
+  if (shape->table_) size += block_size(shape->table_) + shape->table_->heap_bytes();
+  WriteNode(id, "Shape", size, shape->dictionary_ ? "(dictionary)" : "");
+  for (uint32_t i = 0; i < shape->size_; i++) {
+    if (!!shape->keys_[i]) WriteEdge(shape->keys_[i], "(key)");
+  }
+  for (auto it = shape->transitions_.begin(); it != shape->transitions_.end(); ++it) {
+    WriteEdge(it->second, "(transition) ", it->first.get__());
+  }
+}
+
+void HeapSnapshot::WriteString(uint32_t id, u16string_data* s) {
+  const u16string_data* first;
+  const u16string_data* second;
+  s->get_parts(first, second);
+  WriteNode(id, "String", block_size(s), "", s);
+  if (s->is_slice()) {
+    WriteEdge(const_cast<u16string_data*>(first), "(parent)");
+  } else {
+    WriteEdge(const_cast<u16string_data*>(first), "(first)");
+    WriteEdge(const_cast<u16string_data*>(second), "(second)");
+  }
+}
+
+void HeapSnapshot::WriteContext(uint32_t id, Context* c) {
+  WriteNode(id, "Context", block_size(c), "");
+  WriteEdge(c->global_obj(), "(global)");
+  WriteEdge(c->object_proto(), "Object.prototype");
+  WriteEdge(c->function_proto(), "Function.prototype");
+  WriteEdge(c->array_proto(), "Array.prototype");
+  WriteEdge(c->string_proto(), "String.prototype");
+  WriteEdge(c->boolean_proto(), "Boolean.prototype");
+  WriteEdge(c->number_proto(), "Number.prototype");
+  WriteEdge(c->date_proto(), "Date.prototype");
+  WriteEdge(c->regexp_proto(), "RegExp.prototype");
+  WriteEdge(c->error_proto(), "Error.prototype");
+}
+
+const u16string_data* HeapSnapshot::FunctionName(Function* f) {
+  if (!f->code || !f->code->id || !f->script) return nullptr;
+  return f->script->string_table()[f->code->id->name];
+}
+
+bool WriteHeapSnapshot(Context* c, FILE* out) {
+  HeapSnapshot snapshot(out);
+  return snapshot.Write(c);
+}
+
+}  // namespace internal
+}  // namespace nabla
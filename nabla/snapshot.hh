@@ -0,0 +1,39 @@
+/* Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+ * Copyright (C) 2014 Katsuya Iida. All rights reserved.
+ */
+
+#pragma once
+
+#ifndef NABLA_SNAPSHOT_HH_
+#define NABLA_SNAPSHOT_HH_
+
+#include <cstdio>
+
+namespace nabla {
+namespace internal {
+
+class Context;
+
+// Writes the objects reachable from c, starting from its global object
+// and the builtin prototypes, as a graph for tools/heapsnapshot.py. The
+// format is line based:
+//
+//   nabla-heap-snapshot 1
+//   n <id> <kind> <size> "<name>"
+//   e <to> "<label>"
+//
+// Each node is followed by its outgoing edges, whose targets may be
+// written later. Node 0 is the root. Sizes are the bytes of the object
+// and of the blocks only it points to, such as the property slots. Names
+// and labels are JSON strings.
+//
+// Lines are written as the graph is walked. The walk keeps its state in
+// malloc memory and allocates nothing in the GC heap, so it doesn't grow
+// the heap it measures or start a collection.
+// Returns false if writing to out failed.
+bool WriteHeapSnapshot(Context* c, FILE* out);
+
+}  // namespace internal
+}  // namespace nabla
+
+#endif  // NABLA_SNAPSHOT_HH_
@@ -61,18 +61,6 @@
         return o;
     };
 
-    String.prototype.indexOf = function (searchString, position) {
-        searchString = String(searchString);
-        position = position === undefined ? 0 : Number(position);
-        var searchLen = searchString.length;
-        var end = this.length - searchLen;
-        while (position <= end) {
-            if (this.substring(position, position + searchLen) === searchString) return position;
-            position++;
-        }
-        return -1;
-    };
-
     String.prototype.charAt = function (index) {
         return this.valueOf()[index];
     };
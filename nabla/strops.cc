@@ -0,0 +1,473 @@
+/* Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+ * Copyright (C) 2014 Katsuya Iida. All rights reserved.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "strops.hh"
+
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define NABLA_STROPS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace nabla {
+namespace internal {
+namespace strops {
+
+namespace {
+
+// Scalar kernels. They also finish the units left over by the vector ones.
+
+template <typename charA, typename charB>
+size_t mismatch_scalar(const charA* a, const charB* b, size_t n) {
+  size_t i = 0;
+  while (i < n && a[i] == b[i]) i++;
+  return i;
+}
+
+size_t mismatch8_scalar(const uint8_t* a, const uint8_t* b, size_t n) {
+  return mismatch_scalar(a, b, n);
+}
+
+size_t mismatch_mixed_scalar(const uint8_t* a, const char16_t* b, size_t n) {
+  return mismatch_scalar(a, b, n);
+}
+
+template <typename charT>
+size_t find_scalar(const charT* haystack, size_t n, const charT* needle, size_t m) {
+  if (m == 0) return 0;
+  if (m > n) return npos;
+  charT first = needle[0];
+  for (size_t i = 0; i + m <= n; i++) {
+    if (haystack[i] == first &&
+        memcmp(haystack + i + 1, needle + 1, (m - 1) * sizeof (charT)) == 0) {
+      return i;
+    }
+  }
+  return npos;
+}
+
+size_t find8_scalar(const uint8_t* haystack, size_t n, const uint8_t* needle, size_t m) {
+  return find_scalar(haystack, n, needle, m);
+}
+
+size_t find16_scalar(const char16_t* haystack, size_t n, const char16_t* needle, size_t m) {
+  return find_scalar(haystack, n, needle, m);
+}
+
+// Flips bit 0x20 of the units in [lo, lo + 26), which maps the ASCII
+// letters starting at lo to the other case.
+template <typename charT>
+void flip_case_scalar(const charT* src, charT* dst, size_t n, charT lo) {
+  for (size_t i = 0; i < n; i++) {
+    charT ch = src[i];
+    if (static_cast<unsigned>(ch - lo) < 26) ch ^= 0x20;
+    dst[i] = ch;
+  }
+}
+
+void flip_case8_scalar(const uint8_t* src, uint8_t* dst, size_t n, uint8_t lo) {
+  flip_case_scalar(src, dst, n, lo);
+}
+
+void flip_case16_scalar(const char16_t* src, char16_t* dst, size_t n, char16_t lo) {
+  flip_case_scalar(src, dst, n, lo);
+}
+
+#ifdef NABLA_STROPS_X86
+
+// SSE2 kernels. SSE2 is part of every x86-64 CPU.
+//
+// find uses the first and last units of the needle as a filter: a block of
+// candidate positions is compared against both at once and only positions
+// where both match are checked in full.
+//
+// flip_case adds a bias that moves [lo, lo + 26) to the bottom of the signed
+// range, so that a single signed comparison tells which units are letters.
+
+size_t mismatch8_sse2(const uint8_t* a, const uint8_t* b, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+    if (mask) return i + __builtin_ctz(mask);
+  }
+  return i + mismatch_scalar(a + i, b + i, n - i);
+}
+
+size_t mismatch_mixed_sse2(const uint8_t* a, const char16_t* b, size_t n) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + i)), zero);
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi16(x, y)) ^ 0xffff;
+    if (mask) return i + __builtin_ctz(mask) / 2;
+  }
+  return i + mismatch_scalar(a + i, b + i, n - i);
+}
+
+size_t find8_sse2(const uint8_t* haystack, size_t n, const uint8_t* needle, size_t m) {
+  if (m == 0 || m > n) return find_scalar(haystack, n, needle, m);
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[m - 1]);
+  size_t middle = m > 2 ? m - 2 : 0;
+  size_t i = 0;
+  for (; i + m - 1 + 16 <= n; i += 16) {
+    __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + m - 1));
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(f, first), _mm_cmpeq_epi8(l, last)));
+    while (mask) {
+      size_t pos = i + __builtin_ctz(mask);
+      if (memcmp(haystack + pos + 1, needle + 1, middle) == 0) return pos;
+      mask &= mask - 1;
+    }
+  }
+  size_t r = find_scalar(haystack + i, n - i, needle, m);
+  return r == npos ? npos : i + r;
+}
+
+size_t find16_sse2(const char16_t* haystack, size_t n, const char16_t* needle, size_t m) {
+  if (m == 0 || m > n) return find_scalar(haystack, n, needle, m);
+  const __m128i first = _mm_set1_epi16(needle[0]);
+  const __m128i last = _mm_set1_epi16(needle[m - 1]);
+  size_t middle = m > 2 ? m - 2 : 0;
+  size_t i = 0;
+  for (; i + m - 1 + 8 <= n; i += 8) {
+    __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + m - 1));
+    // Each matching unit sets two adjacent bits; keep the low one.
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi16(f, first), _mm_cmpeq_epi16(l, last))) & 0x5555;
+    while (mask) {
+      size_t pos = i + __builtin_ctz(mask) / 2;
+      if (memcmp(haystack + pos + 1, needle + 1, middle * sizeof (char16_t)) == 0) return pos;
+      mask &= mask - 1;
+    }
+  }
+  size_t r = find_scalar(haystack + i, n - i, needle, m);
+  return r == npos ? npos : i + r;
+}
+
+void flip_case8_sse2(const uint8_t* src, uint8_t* dst, size_t n, uint8_t lo) {
+  const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80 - lo));
+  const __m128i limit = _mm_set1_epi8(-0x80 + 26);
+  const __m128i flip = _mm_set1_epi8(0x20);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i letters = _mm_cmplt_epi8(_mm_add_epi8(x, bias), limit);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(x, _mm_and_si128(letters, flip)));
+  }
+  flip_case_scalar(src + i, dst + i, n - i, lo);
+}
+
+void flip_case16_sse2(const char16_t* src, char16_t* dst, size_t n, char16_t lo) {
+  const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000 - lo));
+  const __m128i limit = _mm_set1_epi16(-0x8000 + 26);
+  const __m128i flip = _mm_set1_epi16(0x20);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i letters = _mm_cmplt_epi16(_mm_add_epi16(x, bias), limit);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(x, _mm_and_si128(letters, flip)));
+  }
+  flip_case_scalar(src + i, dst + i, n - i, lo);
+}
+
+// AVX2 kernels. They work on 32 bytes at a time and leave the rest to the
+// SSE2 ones. They are compiled for AVX2 regardless of the compiler flags
+// and only called when the CPU reports support for it.
+
+#define NABLA_AVX2 __attribute__((target("avx2")))
+
+NABLA_AVX2 size_t mismatch8_avx2(const uint8_t* a, const uint8_t* b, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+    if (mask) return i + __builtin_ctz(mask);
+  }
+  return i + mismatch8_sse2(a + i, b + i, n - i);
+}
+
+NABLA_AVX2 size_t mismatch_mixed_avx2(const uint8_t* a, const char16_t* b, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(x, y)));
+    if (mask) return i + __builtin_ctz(mask) / 2;
+  }
+  return i + mismatch_mixed_sse2(a + i, b + i, n - i);
+}
+
+NABLA_AVX2 size_t find8_avx2(const uint8_t* haystack, size_t n, const uint8_t* needle, size_t m) {
+  if (m == 0 || m > n) return find_scalar(haystack, n, needle, m);
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+  size_t middle = m > 2 ? m - 2 : 0;
+  size_t i = 0;
+  for (; i + m - 1 + 32 <= n; i += 32) {
+    __m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i));
+    __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i + m - 1));
+    uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(f, first), _mm256_cmpeq_epi8(l, last)));
+    while (mask) {
+      size_t pos = i + __builtin_ctz(mask);
+      if (memcmp(haystack + pos + 1, needle + 1, middle) == 0) return pos;
+      mask &= mask - 1;
+    }
+  }
+  size_t r = find8_sse2(haystack + i, n - i, needle, m);
+  return r == npos ? npos : i + r;
+}
+
+NABLA_AVX2 size_t find16_avx2(const char16_t* haystack, size_t n, const char16_t* needle, size_t m) {
+  if (m == 0 || m > n) return find_scalar(haystack, n, needle, m);
+  const __m256i first = _mm256_set1_epi16(needle[0]);
+  const __m256i last = _mm256_set1_epi16(needle[m - 1]);
+  size_t middle = m > 2 ? m - 2 : 0;
+  size_t i = 0;
+  for (; i + m - 1 + 16 <= n; i += 16) {
+    __m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i));
+    __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i + m - 1));
+    uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi16(f, first), _mm256_cmpeq_epi16(l, last))) & 0x55555555;
+    while (mask) {
+      size_t pos = i + __builtin_ctz(mask) / 2;
+      if (memcmp(haystack + pos + 1, needle + 1, middle * sizeof (char16_t)) == 0) return pos;
+      mask &= mask - 1;
+    }
+  }
+  size_t r = find16_sse2(haystack + i, n - i, needle, m);
+  return r == npos ? npos : i + r;
+}
+
+NABLA_AVX2 void flip_case8_avx2(const uint8_t* src, uint8_t* dst, size_t n, uint8_t lo) {
+  const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80 - lo));
+  const __m256i limit = _mm256_set1_epi8(-0x80 + 26);
+  const __m256i flip = _mm256_set1_epi8(0x20);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i letters = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(x, bias));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(x, _mm256_and_si256(letters, flip)));
+  }
+  flip_case8_sse2(src + i, dst + i, n - i, lo);
+}
+
+NABLA_AVX2 void flip_case16_avx2(const char16_t* src, char16_t* dst, size_t n, char16_t lo) {
+  const __m256i bias = _mm256_set1_epi16(static_cast<short>(0x8000 - lo));
+  const __m256i limit = _mm256_set1_epi16(-0x8000 + 26);
+  const __m256i flip = _mm256_set1_epi16(0x20);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i letters = _mm256_cmpgt_epi16(limit, _mm256_add_epi16(x, bias));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(x, _mm256_and_si256(letters, flip)));
+  }
+  flip_case16_sse2(src + i, dst + i, n - i, lo);
+}
+
+#undef NABLA_AVX2
+
+#endif  // NABLA_STROPS_X86
+
+struct kernels {
+  size_t (*mismatch8)(const uint8_t* a, const uint8_t* b, size_t n);
+  size_t (*mismatch_mixed)(const uint8_t* a, const char16_t* b, size_t n);
+  size_t (*find8)(const uint8_t* haystack, size_t n, const uint8_t* needle, size_t m);
+  size_t (*find16)(const char16_t* haystack, size_t n, const char16_t* needle, size_t m);
+  void (*flip_case8)(const uint8_t* src, uint8_t* dst, size_t n, uint8_t lo);
+  void (*flip_case16)(const char16_t* src, char16_t* dst, size_t n, char16_t lo);
+};
+
+const kernels scalar_kernels = {
+  mismatch8_scalar, mismatch_mixed_scalar, find8_scalar, find16_scalar,
+  flip_case8_scalar, flip_case16_scalar
+};
+
+#ifdef NABLA_STROPS_X86
+const kernels sse2_kernels = {
+  mismatch8_sse2, mismatch_mixed_sse2, find8_sse2, find16_sse2,
+  flip_case8_sse2, flip_case16_sse2
+};
+
+const kernels avx2_kernels = {
+  mismatch8_avx2, mismatch_mixed_avx2, find8_avx2, find16_avx2,
+  flip_case8_avx2, flip_case16_avx2
+};
+#endif
+
+level active_level;
+const kernels* active = nullptr;
+
+inline const kernels& k() {
+  if (!active) set_level(supported_level());
+  return *active;
+}
+
+}  // namespace
+
+level supported_level() {
+#ifdef NABLA_STROPS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return kAVX2;
+  return kSSE2;
+#else
+  return kScalar;
+#endif
+}
+
+level current_level() {
+  k();
+  return active_level;
+}
+
+void set_level(level l) {
+  level max = supported_level();
+  if (l > max) l = max;
+  active_level = l;
+  switch (l) {
+#ifdef NABLA_STROPS_X86
+    case kAVX2:
+      active = &avx2_kernels;
+      break;
+    case kSSE2:
+      active = &sse2_kernels;
+      break;
+#endif
+    default:
+      active = &scalar_kernels;
+      break;
+  }
+}
+
+size_t mismatch(const uint8_t* a, const uint8_t* b, size_t n) {
+  return k().mismatch8(a, b, n);
+}
+
+size_t mismatch(const char16_t* a, const char16_t* b, size_t n) {
+  // The first differing byte is in the first differing unit.
+  return k().mismatch8(reinterpret_cast<const uint8_t*>(a),
+                       reinterpret_cast<const uint8_t*>(b),
+                       n * sizeof (char16_t)) / sizeof (char16_t);
+}
+
+size_t mismatch(const uint8_t* a, const char16_t* b, size_t n) {
+  return k().mismatch_mixed(a, b, n);
+}
+
+size_t mismatch(const char16_t* a, const uint8_t* b, size_t n) {
+  return k().mismatch_mixed(b, a, n);
+}
+
+size_t find(const uint8_t* haystack, size_t n, const uint8_t* needle, size_t m) {
+  return k().find8(haystack, n, needle, m);
+}
+
+size_t find(const char16_t* haystack, size_t n, const char16_t* needle, size_t m) {
+  return k().find16(haystack, n, needle, m);
+}
+
+static bool fits_one_byte(const char16_t* s, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (s[i] > 0xff) return false;
+  }
+  return true;
+}
+
+// Mixed widths filter candidates on the first unit of the needle and check
+// them in full with the mixed mismatch kernel.
+template <typename charH, typename charN>
+static size_t find_mixed(const charH* haystack, size_t n, const charN* needle, size_t m) {
+  if (m == 0) return 0;
+  if (m > n) return npos;
+  charN first = needle[0];
+  for (size_t i = 0; i + m <= n; i++) {
+    if (haystack[i] == first && mismatch(haystack + i, needle, m) == m) return i;
+  }
+  return npos;
+}
+
+size_t find(const uint8_t* haystack, size_t n, const char16_t* needle, size_t m) {
+  if (!fits_one_byte(needle, m)) return npos;
+  return find_mixed(haystack, n, needle, m);
+}
+
+size_t find(const char16_t* haystack, size_t n, const uint8_t* needle, size_t m) {
+  return find_mixed(haystack, n, needle, m);
+}
+
+template <typename charT>
+static size_t rfind_units(const charT* haystack, size_t n, const charT* needle, size_t m, size_t from) {
+  if (m > n) return npos;
+  size_t i = n - m;
+  if (from < i) i = from;
+  if (m == 0) return i;
+  charT first = needle[0];
+  charT last = needle[m - 1];
+  for (;;) {
+    if (haystack[i] == first && haystack[i + m - 1] == last &&
+        memcmp(haystack + i, needle, m * sizeof (charT)) == 0) {
+      return i;
+    }
+    if (i == 0) return npos;
+    i--;
+  }
+}
+
+size_t rfind(const uint8_t* haystack, size_t n, const uint8_t* needle, size_t m, size_t from) {
+  return rfind_units(haystack, n, needle, m, from);
+}
+
+size_t rfind(const char16_t* haystack, size_t n, const char16_t* needle, size_t m, size_t from) {
+  return rfind_units(haystack, n, needle, m, from);
+}
+
+template <typename charH, typename charN>
+static size_t rfind_mixed(const charH* haystack, size_t n, const charN* needle, size_t m, size_t from) {
+  if (m > n) return npos;
+  size_t i = n - m;
+  if (from < i) i = from;
+  if (m == 0) return i;
+  charN first = needle[0];
+  for (;;) {
+    if (haystack[i] == first && mismatch(haystack + i, needle, m) == m) return i;
+    if (i == 0) return npos;
+    i--;
+  }
+}
+
+size_t rfind(const uint8_t* haystack, size_t n, const char16_t* needle, size_t m, size_t from) {
+  if (!fits_one_byte(needle, m)) return npos;
+  return rfind_mixed(haystack, n, needle, m, from);
+}
+
+size_t rfind(const char16_t* haystack, size_t n, const uint8_t* needle, size_t m, size_t from) {
+  return rfind_mixed(haystack, n, needle, m, from);
+}
+
+void to_lower(const uint8_t* src, uint8_t* dst, size_t n) {
+  k().flip_case8(src, dst, n, 'A');
+}
+
+void to_lower(const char16_t* src, char16_t* dst, size_t n) {
+  k().flip_case16(src, dst, n, 'A');
+}
+
+void to_upper(const uint8_t* src, uint8_t* dst, size_t n) {
+  k().flip_case8(src, dst, n, 'a');
+}
+
+void to_upper(const char16_t* src, char16_t* dst, size_t n) {
+  k().flip_case16(src, dst, n, 'a');
+}
+
+}  // namespace strops
+}  // namespace internal
+}  // namespace nabla
@@ -0,0 +1,71 @@
+/* Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+ * Copyright (C) 2014 Katsuya Iida. All rights reserved.
+ */
+
+#pragma once
+
+#ifndef NABLA_STROPS_HH_
+#define NABLA_STROPS_HH_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nabla {
+namespace internal {
+
+// Kernels over runs of code units, used by string_data and the String
+// builtins. mismatch, find and the case conversions have a scalar version
+// and, on x86, SSE2 and AVX2 versions picked on first use from what the CPU
+// supports.
+namespace strops {
+
+enum level {
+  kScalar,
+  kSSE2,
+  kAVX2
+};
+
+const size_t npos = static_cast<size_t>(-1);
+
+// The best level the CPU supports, and the level in use. Tests lower the
+// level to check the vector kernels against the scalar ones.
+level supported_level();
+level current_level();
+void set_level(level l);
+
+// Returns the index of the first unit where a and b differ, or n.
+size_t mismatch(const uint8_t* a, const uint8_t* b, size_t n);
+size_t mismatch(const char16_t* a, const char16_t* b, size_t n);
+size_t mismatch(const uint8_t* a, const char16_t* b, size_t n);
+size_t mismatch(const char16_t* a, const uint8_t* b, size_t n);
+
+// Returns the index of the first occurrence of the m units at needle in the
+// n units at haystack, or npos.
+size_t find(const uint8_t* haystack, size_t n, const uint8_t* needle, size_t m);
+size_t find(const char16_t* haystack, size_t n, const char16_t* needle, size_t m);
+// Mixed widths are compared unit by unit without converting either side. A
+// needle with a unit above 0xff is never in a one-byte haystack, so that
+// case returns npos before the haystack is read.
+size_t find(const uint8_t* haystack, size_t n, const char16_t* needle, size_t m);
+size_t find(const char16_t* haystack, size_t n, const uint8_t* needle, size_t m);
+
+// Returns the index of the last occurrence that starts at or before from,
+// or npos.
+size_t rfind(const uint8_t* haystack, size_t n, const uint8_t* needle, size_t m, size_t from);
+size_t rfind(const char16_t* haystack, size_t n, const char16_t* needle, size_t m, size_t from);
+size_t rfind(const uint8_t* haystack, size_t n, const char16_t* needle, size_t m, size_t from);
+size_t rfind(const char16_t* haystack, size_t n, const uint8_t* needle, size_t m, size_t from);
+
+// Copies n units from src to dst mapping ASCII letters to lower or upper
+// case. Other units are copied unchanged.
+void to_lower(const uint8_t* src, uint8_t* dst, size_t n);
+void to_lower(const char16_t* src, char16_t* dst, size_t n);
+void to_upper(const uint8_t* src, uint8_t* dst, size_t n);
+void to_upper(const char16_t* src, char16_t* dst, size_t n);
+
+}  // namespace strops
+
+}  // namespace internal
+}  // namespace nabla
+
+#endif  // NABLA_STROPS_HH_
@@ -10,10 +10,15 @@
 #include <iostream>
 #include <string>
 #include <cassert>
+#include <csignal>
+#include <cstring>
 
 #include "data.hh"
 #include "debug.hh"
 #include "context.hh"
+#include "profile.hh"
+#include "snapshot.hh"
+#include "strops.hh"
 
 using namespace nabla::internal;
 
@@ -40,32 +45,41 @@ struct libtest
     assert(v.is_smi());
     assert(v.smi() == 123);
 
-    v = undefined_data::alloc();
+    v = any_ref::undefined();
     assert(!v.is_nil());
     assert(!v.is_smi());
     assert(!v.is_double());
+    assert(v.is_undefined());
+    assert(!v.is_heap_data());
 
-    v = null_data::alloc();
+    v = any_ref::null();
     assert(!v.is_nil());
     assert(!v.is_smi());
     assert(!v.is_double());
+    assert(v.is_null());
+    assert(!v.is_undefined());
 
-    v = bool_data::alloc(true);
+    v = any_ref(true);
     assert(!v.is_nil());
     assert(!v.is_smi());
     assert(!v.is_double());
+    assert(v.is_bool());
+    assert(v.as_bool());
 
-    v = bool_data::alloc(false);
+    v = any_ref(false);
     assert(!v.is_nil());
     assert(!v.is_smi());
     assert(!v.is_double());
+    assert(v.is_bool());
+    assert(!v.as_bool());
+    assert(!v.is_null());
 
     v = u16string_data::alloc("abc", 3);
     assert(!v.is_nil());
     assert(!v.is_smi());
     assert(!v.is_double());
 
-    v = double_data::alloc(-10.38);
+    v = -10.38;
     assert(!v.is_nil());
     assert(!v.is_smi());
     assert(v.is_double());
@@ -99,24 +113,613 @@ struct libtest
     std::wstring rets(ret.begin(), ret.end());
     assert(rets == L"foo");
   }
+
+  void shape_test(const std::string& test_name)
+  {
+    Context* c = Context::Alloc(false);
+    Object* o1 = Object::Alloc(nullptr);
+    Object* o2 = Object::Alloc(nullptr);
+    u16string foo("foo");
+    u16string bar("bar");
+
+    assert(o1->shape() == o2->shape());
+    o1->Put(c, foo, 1, false);
+    o1->Put(c, bar, 2, false);
+    o2->Put(c, foo, 3, false);
+    assert(o1->shape() != o2->shape());
+    o2->Put(c, bar, 4, false);
+    assert(o1->shape() == o2->shape());
+    assert(!o1->shape()->is_dictionary());
+
+    o2->Delete(c, foo, false);
+    assert(o1->shape() != o2->shape());
+    assert(o2->shape()->is_dictionary());
+    assert(o2->Get(foo).is_undefined());
+    assert(o2->Get(bar).smi() == 4);
+    assert(o1->Get(foo).smi() == 1);
+  }
+
+  void atom_test(const std::string& test_name)
+  {
+    Context* c = Context::Alloc(false);
+    u16string a1("atom_test_name");
+    u16string a2("atom_test_name");
+    assert(!find_atom(a1));
+
+    u16string atom = intern(a1);
+    assert(atom.get__() == a1.get__());
+    assert(a1.is_atom());
+    assert(!a2.is_atom());
+    assert(find_atom(a2).get__() == a1.get__());
+    assert(intern(a2).get__() == a1.get__());
+
+    Object* o = Object::Alloc(nullptr);
+    u16string key("atom_test_key");
+    o->Put(c, key, 5, false);
+    assert(key.is_atom());
+    assert(o->Get(u16string("atom_test_key")).smi() == 5);
+    assert(!o->GetOwnProperty(u16string("atom_test_missing")));
+    assert(!find_atom(u16string("atom_test_missing")));
+
+    // Ropes and slices are interned as flat strings, so that the atom
+    // doesn't keep the strings they point to alive.
+    const u16string_data* first;
+    const u16string_data* second;
+    u16string rope = u16string("atom_test_rope_left_") + u16string("atom_test_rope_right");
+    u16string rope_atom = intern(rope);
+    rope_atom.get__()->get_parts(first, second);
+    assert(rope_atom.is_atom() && !first && !second);
+    assert(find_atom(u16string("atom_test_rope_left_atom_test_rope_right")).get__() == rope_atom.get__());
+    u16string parent("atom_test_slice_parent");
+    u16string slice = parent.substring(2, 18);
+    assert(slice.get__()->is_slice());
+    u16string slice_atom = intern(slice);
+    slice_atom.get__()->get_parts(first, second);
+    assert(slice_atom.is_atom() && !slice.is_atom() && !first);
+    assert(slice_atom == slice);
+
+    // The table grows without losing atoms.
+    for (int i = 0; i < 5000; i++) {
+      intern(u16string(("atom_test_generated_" + std::to_string(i)).c_str()));
+    }
+    assert(find_atom(a2).get__() == a1.get__());
+    assert(find_atom(u16string("atom_test_generated_4999")).is_atom());
+  }
+
+  void string_hash_test(const std::string& test_name)
+  {
+    u16string s1("some_long_generated_identifier_1");
+    u16string s2("some_long_generated_identifier_1");
+    u16string s3("some_long_generated_identifier_2");
+    assert(s1.hash() != 0);
+    assert(s1.hash() == s2.hash());
+    assert(s1.hash() == s1.hash());
+    assert(s1.hash() != s3.hash());
+    assert(u16string("").hash() == u16string("").hash());
+    assert((s1 + s3).hash() != (s3 + s1).hash());
+  }
+
+  void rope_test(const std::string& test_name)
+  {
+    u16string a("abcdefgh");
+    u16string b("ijklmnop");
+    u16string ab = a + b;
+    assert(ab.get__()->is_rope());
+    assert(ab.length() == 16);
+    assert(ab == u16string("abcdefghijklmnop"));
+    assert(ab[8] == 'i');
+    assert(!(a + u16string("x")).get__()->is_rope());
+
+    // Deep left and right leaning ropes are flattened before they get
+    // deeper than the limit.
+    u16string left("");
+    u16string right("");
+    u16string one("0123456789");
+    for (int i = 0; i < 3000; i++) {
+      left = left + one;
+      right = one + right;
+    }
+    assert(left.length() == 30000);
+    assert(left == right);
+    assert(left[29999] == '9');
+  }
+
+  void substring_test(const std::string& test_name)
+  {
+    u16string s("The quick brown fox jumps over the lazy dog");
+    u16string sub = s.substring(4, 15);
+    assert(sub == u16string("quick brown fox"));
+    assert(sub.get__()->is_slice());
+    // A slice of a slice refers to the original characters.
+    u16string longer = s.substring(4, 35);
+    u16string subsub = longer.substring(6, 20);
+    assert(subsub == u16string("brown fox jumps over"));
+    assert(subsub.get__()->one_byte_data() == s.get__()->one_byte_data() + 10);
+    // Short results are copied.
+    assert(!s.substring(4, 5).get__()->is_slice());
+    assert(s.substring(0, s.length()).get__() == s.get__());
+
+    assert(char_string('a').get__() == char_string('a').get__());
+    assert(char_string('a') == u16string("a"));
+    assert(char_string('a').is_atom());
+    assert(char_string(0x3bb).length() == 1);
+  }
+
+  void one_byte_string_test(const std::string& test_name)
+  {
+    u16string ascii("abc");
+    assert(ascii.get__()->is_one_byte());
+    u16string lambda = char_string(0x3bb);
+    assert(!lambda.get__()->is_one_byte());
+    // Mixing widths widens the result but keeps the code units.
+    u16string mixed = ascii + lambda;
+    assert(!mixed.get__()->is_one_byte());
+    assert(mixed.length() == 4);
+    assert(mixed[0] == 'a' && mixed[3] == 0x3bb);
+    assert(mixed.substring(0, 3) == ascii);
+    // Equality and hashing do not depend on the representation.
+    const char16_t wide[] = { 'a', 'b', 'c' };
+    string_data<char16_t>* buf = string_data<char16_t>::alloc(3);
+    std::copy(wide, wide + 3, buf->data());
+    u16string widened(buf);
+    assert(!widened.get__()->is_one_byte());
+    assert(widened == ascii);
+    assert(widened.get__()->hash() == ascii.get__()->hash());
+    // data() widens one-byte strings into the caller's buffer only.
+    std::u16string scratch;
+    const char16_t* units = ascii.data(scratch);
+    assert(units == scratch.data() && scratch == u"abc");
+    scratch.clear();
+    assert(widened.data(scratch) == buf->data() && scratch.empty());
+  }
+
+  // Every kernel level must agree with the scalar one, including on the
+  // units left over after the last full vector.
+  void strops_test(const std::string& test_name)
+  {
+    const size_t n = 100;
+    uint8_t a[n], b[n], lower[n], upper[n];
+    char16_t wa[n], wb[n], wlower[n], wupper[n];
+    for (size_t i = 0; i < n; i++) {
+      a[i] = b[i] = "Log line: ERROR at [x] {y} @z "[i % 30];
+      wa[i] = wb[i] = a[i];
+    }
+    strops::level saved = strops::current_level();
+    for (int l = strops::kScalar; l <= strops::supported_level(); l++) {
+      strops::set_level(static_cast<strops::level>(l));
+      for (size_t i = 0; i < n; i++) {
+        b[i] ^= 1;
+        wb[i] ^= 0x100;
+        assert(strops::mismatch(a, b, n) == i);
+        assert(strops::mismatch(wa, wb, n) == i);
+        assert(strops::mismatch(a, wb, n) == i);
+        assert(strops::mismatch(a, wb, i) == i);
+        b[i] ^= 1;
+        wb[i] ^= 0x100;
+      }
+      assert(strops::mismatch(a, b, n) == n);
+      assert(strops::mismatch(a, wa, n) == n);
+
+      const uint8_t* needle = reinterpret_cast<const uint8_t*>("ERROR at [x] {y} @z Log");
+      const char16_t* wneedle = u"ERROR at [x] {y} @z Log";
+      for (size_t m = 1; m <= 23; m++) {
+        assert(strops::find(a, n, needle, m) == 10);
+        assert(strops::find(wa, n, wneedle, m) == 10);
+        assert(strops::find(a + 11, n - 11, needle, m) == 29);
+        assert(strops::find(wa + 11, n - 11, wneedle, m) == 29);
+        assert(strops::rfind(a, n, needle, m, n) == 70);
+        assert(strops::rfind(wa, n, wneedle, m, 69) == 40);
+        assert(strops::find(a + 11, n - 11, wneedle, m) == 29);
+        assert(strops::find(wa + 11, n - 11, needle, m) == 29);
+        assert(strops::rfind(a, n, wneedle, m, 69) == 40);
+        assert(strops::rfind(wa, n, needle, m, n) == 70);
+      }
+      assert(strops::find(a, n, needle, 0) == 0);
+      assert(strops::find(a, n, u"ERROR\u0100", 6) == strops::npos);
+      assert(strops::rfind(a, n, u"\u0145RROR", 5, n) == strops::npos);
+      assert(strops::find(a, 5, needle, 6) == strops::npos);
+      assert(strops::find(a + 91, 9, needle, 5) == strops::npos);
+
+      strops::to_lower(a, lower, n);
+      strops::to_upper(a, upper, n);
+      strops::to_lower(wa, wlower, n);
+      strops::to_upper(wa, wupper, n);
+      for (size_t i = 0; i < n; i++) {
+        uint8_t ch = a[i];
+        assert(lower[i] == (ch >= 'A' && ch <= 'Z' ? ch + 0x20 : ch));
+        assert(upper[i] == (ch >= 'a' && ch <= 'z' ? ch - 0x20 : ch));
+        assert(wlower[i] == lower[i] && wupper[i] == upper[i]);
+      }
+    }
+    strops::set_level(saved);
+  }
+
+  void map_test(const std::string& test_name)
+  {
+    map<u16string, int, 2> m;
+    m.init();
+    assert(m.find("a") == m.end());
+    // Grows from the inline entries to a linear block and then to an
+    // indexed one.
+    char name[8];
+    for (int i = 0; i < 100; i++) {
+      snprintf(name, sizeof name, "k%d", i);
+      m[name] = i;
+      assert(m.size() == static_cast<size_t>(i + 1));
+    }
+    for (int i = 0; i < 100; i++) {
+      snprintf(name, sizeof name, "k%d", i);
+      assert(m.find(name) != m.end() && (*m.find(name)).second == i);
+    }
+    m.erase(m.find("k50"));
+    assert(m.find("k50") == m.end());
+    assert((*m.find("k51")).second == 51);
+    // Iteration keeps the insertion order.
+    int expected = 0;
+    for (auto it = m.begin(); it != m.end(); ++it) {
+      if (expected == 50) expected++;
+      assert((*it).second == expected++);
+    }
+    assert(expected == 100);
+    m["k50"] = 50;
+    assert((*(m.end() - 1)).first == u16string("k50"));
+    // An inline size that isn't a power of two still gives a power-of-two
+    // index once the map grows past it.
+    map<u16string, int, 3> m3;
+    m3.init();
+    for (int i = 0; i < 100; i++) {
+      snprintf(name, sizeof name, "k%d", i);
+      m3[name] = i;
+    }
+    for (int i = 0; i < 100; i++) {
+      snprintf(name, sizeof name, "k%d", i);
+      assert(m3.find(name) != m3.end() && (*m3.find(name)).second == i);
+    }
+    assert(m3.find("k100") == m3.end());
+    typedef map<u16string, int, 3>::value_type entry;
+    assert(m3.heap_bytes() == 128 * sizeof (entry) + 256 * sizeof (uint32_t));
+  }
+
+  void hash_map_test(const std::string& test_name)
+  {
+    hash_map<u16string, int> m;
+    m.init();
+    assert(m.empty() && m.begin() == m.end());
+    assert(m.find("a") == m.end());
+    char name[8];
+    for (int i = 0; i < 1000; i++) {
+      snprintf(name, sizeof name, "k%d", i);
+      m[name] = i;
+    }
+    assert(m.size() == 1000);
+    for (int i = 0; i < 1000; i++) {
+      snprintf(name, sizeof name, "k%d", i);
+      assert(m.find(name) != m.end() && m.find(name)->second == i);
+    }
+    for (int i = 0; i < 1000; i += 2) {
+      snprintf(name, sizeof name, "k%d", i);
+      m.erase(m.find(name));
+    }
+    assert(m.size() == 500);
+    assert(m.find("k0") == m.end() && m.find("k998") == m.end());
+    assert(m.find("k999")->second == 999);
+    // Iteration skips the erased entries and keeps the insertion order,
+    // also across the rehashes that reclaim them.
+    for (int i = 1000; i < 2000; i++) {
+      snprintf(name, sizeof name, "k%d", i);
+      m[name] = i;
+    }
+    int expected = 1;
+    for (auto it = m.begin(); it != m.end(); ++it) {
+      assert(it->second == expected);
+      expected += expected < 999 ? 2 : 1;
+    }
+    assert(expected == 2000);
+  }
+
+  struct counted {
+    counted() : v(0) {}
+    counted(int v) : v(v) {}
+    counted(const counted& o) : v(o.v) {}
+    counted(counted&& o) : v(o.v) { moves++; }
+    counted& operator = (const counted& o) { v = o.v; return *this; }
+    int v;
+    static int moves;
+  };
+
+  void vector_test(const std::string& test_name)
+  {
+    arg_vector args;
+    args.init();
+    const any_ref* inline_data = args.data();
+    for (int i = 0; i < 8; i++) args.push_back(i);
+    assert(args.data() == inline_data && args.capacity() == 8);
+    args.push_back(args[0]);
+    assert(args.data() != inline_data && args.size() == 9);
+    for (int i = 0; i < 9; i++) assert(args[i].smi() == (i < 8 ? i : 0));
+
+    // Growth is geometric, so n pushes only reallocate O(log n) times.
+    any_vector v;
+    v.init();
+    int reallocs = 0;
+    size_t capacity = v.capacity();
+    for (int i = 0; i < 10000; i++) {
+      v.push_back(i);
+      if (v.capacity() != capacity) reallocs++;
+      capacity = v.capacity();
+    }
+    assert(reallocs < 16 && v.size() == 10000 && v[9999].smi() == 9999);
+    v.erase(v.begin(), v.begin() + 5000);
+    assert(v.size() == 5000 && v[0].smi() == 5000);
+
+    // Types that aren't trivially relocatable are moved one by one.
+    assert(!is_trivially_relocatable<counted>::value);
+    assert(is_trivially_relocatable<any_ref>::value);
+    vector<counted, 2> c;
+    c.init();
+    for (int i = 0; i < 3; i++) c.push_back(counted(i));
+    assert(c.size() == 3 && c[2].v == 2);
+    assert(counted::moves >= 2 + 3);
+  }
+
+  void guard_test(const std::string& test_name)
+  {
+    assert(find_overrun() == nullptr);
+#ifdef NABLA_GC_GUARD
+    uint8_t* p = reinterpret_cast<uint8_t*>(gc_malloc_atomic(10));
+    assert(find_overrun() == nullptr);
+    uint8_t saved = p[10];
+    p[10] = 0;
+    assert(find_overrun() == p);
+    p[10] = saved;
+    assert(find_overrun() == nullptr);
+    assert(get_guard_bytes() > 0);
+    p = reinterpret_cast<uint8_t*>(gc_realloc(p, 100));
+    p[99] = 1;
+    assert(find_overrun() == nullptr);
+#else
+    assert(get_guard_bytes() == 0);
+#endif
+  }
+
+  void alloc_test(const std::string& test_name)
+  {
+    size_t counts[heap_data::kNumTags], bytes[heap_data::kNumTags];
+    size_t cached, refills;
+    get_alloc_stats(counts, bytes, cached, refills);
+    size_t num_objects = counts[heap_data::kTagObject];
+    size_t num_cached = cached;
+
+    // Blocks from the caches are distinct and cleared, including the word
+    // that chained them.
+    const int n = 1000;
+    any_ref* blocks[n];
+    for (int i = 0; i < n; i++) {
+      any_ref* p = reinterpret_cast<any_ref*>(alloc_heap_data(heap_data::kTagObject, 40));
+      assert(p && !p[0] && !p[4]);
+      p[0] = i;
+      p[4] = i;
+      blocks[i] = p;
+    }
+    for (int i = 0; i < n; i++) {
+      assert(blocks[i][0].smi() == i && blocks[i][4].smi() == i);
+    }
+    double* d = reinterpret_cast<double*>(alloc_heap_data_atomic(heap_data::kTagDouble, 16));
+    d[0] = d[1] = 1.5;
+
+    // Large blocks go to the collector directly.
+    void* large = alloc_heap_data(heap_data::kTagObject, kMaxCachedSize + 1);
+    assert(large);
+
+    get_alloc_stats(counts, bytes, cached, refills);
+    assert(counts[heap_data::kTagObject] == num_objects + n + 1);
+    assert(cached == num_cached + n + 1);
+    assert(refills > 0);
+    assert(std::string(tag_name(heap_data::kTagShape)) == "Shape");
+  }
+
+  struct layout_probe {
+    uint64_t tag;
+    any_ref first;
+    size_t length;
+    any_ref second;
+  };
+
+  void layout_test(const std::string& test_name)
+  {
+    // Layouts must be statics so the collector sees their cached blocks.
+    static heap_layout layout;
+    alignas(layout_probe) char buf[sizeof (layout_probe)];
+    const layout_probe* probe = reinterpret_cast<const layout_probe*>(buf);
+    layout.init(sizeof (layout_probe));
+    layout.add(probe, &probe->first);
+    layout.add(probe, &probe->second);
+    assert(layout.size() == sizeof (layout_probe));
+    assert(layout.is_pointer(0) && layout.is_pointer(1) && !layout.is_pointer(2) && layout.is_pointer(3));
+
+    // Before commit() blocks are allocated like any other.
+    layout_probe* p = reinterpret_cast<layout_probe*>(alloc_heap_data(heap_data::kTagObject, layout));
+    assert(p && !p->first && !p->second);
+    layout.commit();
+
+    size_t counts[heap_data::kNumTags], bytes[heap_data::kNumTags];
+    size_t cached, refills;
+    get_alloc_stats(counts, bytes, cached, refills);
+    size_t num_objects = counts[heap_data::kTagObject];
+    const int n = 500;
+    layout_probe* blocks[n];
+    for (int i = 0; i < n; i++) {
+      p = reinterpret_cast<layout_probe*>(alloc_heap_data(heap_data::kTagObject, layout));
+      assert(p && !p->tag && !p->first && !p->length && !p->second);
+      p->first = i;
+      p->length = i;
+      blocks[i] = p;
+    }
+    for (int i = 0; i < n; i++) {
+      assert(blocks[i]->first.smi() == i && blocks[i]->length == static_cast<size_t>(i));
+    }
+    get_alloc_stats(counts, bytes, cached, refills);
+    assert(counts[heap_data::kTagObject] == num_objects + n);
+  }
+
+  void live_objects_test(const std::string& test_name)
+  {
+    Object* o = Object::Alloc(nullptr);
+    size_t counts[heap_data::kNumTags], bytes[heap_data::kNumTags];
+    get_live_objects(counts, bytes);
+    assert(counts[heap_data::kTagObject] >= 1 && bytes[heap_data::kTagObject] >= sizeof (Object));
+    assert(counts[heap_data::kTagShape] >= 1);
+    // The caches were dropped and refill as needed.
+    Object* o2 = Object::Alloc(o);
+    assert(o2 && o2 != o && o2->proto() == o && !o->proto());
+    uint64_t total, max;
+    get_pause_times(total, max);
+    assert(max <= total);
+  }
+
+  void snapshot_test(const std::string& test_name)
+  {
+    Context* c = Context::Alloc(false);
+    u16string probe("snapshot_probe");
+    c->global_obj()->Put(c, probe, u16string("probe value"), false);
+
+    size_t counts[heap_data::kNumTags], bytes[heap_data::kNumTags];
+    size_t cached, refills;
+    get_alloc_stats(counts, bytes, cached, refills);
+    size_t before = 0;
+    for (int i = 0; i < heap_data::kNumTags; i++) before += counts[i];
+
+    FILE* f = tmpfile();
+    assert(f);
+    assert(WriteHeapSnapshot(c, f));
+
+    get_alloc_stats(counts, bytes, cached, refills);
+    size_t after = 0;
+    for (int i = 0; i < heap_data::kNumTags; i++) after += counts[i];
+    assert(after == before);
+
+    rewind(f);
+    char line[256];
+    assert(fgets(line, sizeof line, f) && std::string(line) == "nabla-heap-snapshot 1\n");
+    bool found_edge = false, found_value = false;
+    while (fgets(line, sizeof line, f)) {
+      std::string l(line);
+      if (l.compare(0, 2, "e ") == 0 && l.find(" \"snapshot_probe\"\n") != std::string::npos) found_edge = true;
+      if (l.compare(0, 2, "n ") == 0 && l.find(" String ") != std::string::npos && l.find("\"probe value\"") != std::string::npos) found_value = true;
+    }
+    fclose(f);
+    assert(found_edge && found_value);
+  }
+
+  void alloc_profile_test(const std::string& test_name)
+  {
+    Thread th;
+    Context* c = Context::Alloc(false);
+    // Every allocation is sampled with an interval of a byte.
+    StartAllocationProfile(1);
+    any_ref v = c->EvalString(u16string("var o = {};\nfunction f() { return [1, 2]; }\nf();"), u16string("alloc_profile_test"));
+    StopAllocationProfile();
+    assert(!!v);
+
+    FILE* f = tmpfile();
+    assert(f);
+    assert(WriteAllocationProfile(f));
+    rewind(f);
+    char line[1024];
+    bool found_object = false, found_array = false;
+    while (fgets(line, sizeof line, f)) {
+      std::string l(line);
+      if (l.compare(0, 38, "(program) alloc_profile_test:1;Object ") == 0) found_object = true;
+      if (l.compare(0, 60, "(program) alloc_profile_test:3;f alloc_profile_test:2;Array ") == 0) found_array = true;
+    }
+    fclose(f);
+    assert(found_object && found_array);
+    assert(!StackFrame::current());
+  }
+
+  void cpu_profile_test(const std::string& test_name)
+  {
+    Thread th;
+    Context* c = Context::Alloc(false);
+    // The timer is too slow to fire here, so the only samples are the ones
+    // sample() and fill() take. The two calls of fill() fill more than the
+    // buffer between them, so nothing is dropped only if the loop drains
+    // it, as no frame is popped there.
+    if (!StartCpuProfile(10 * 1000 * 1000)) return;
+    NativeCodeProc sample = [](Context* c, size_t argc, const any_ref* argv) {
+      raise(SIGPROF);
+      return any_ref::undefined();
+    };
+    NativeCodeProc fill = [](Context* c, size_t argc, const any_ref* argv) {
+      for (int i = 0; i < 10000; i++) raise(SIGPROF);
+      return any_ref::undefined();
+    };
+    c->global_obj()->Put(c, u16string("sample"), CreateNativeFunction(c, sample), false);
+    c->global_obj()->Put(c, u16string("fill"), CreateNativeFunction(c, fill), false);
+    any_ref v = c->EvalString(u16string("function f() {\n  sample();\n}\nf();\nfill();\nfor (var i = 0; i < 2; i++) {}\nfill();"), u16string("cpu_profile_test"));
+    StopCpuProfile();
+    assert(!!v);
+
+    FILE* f = tmpfile();
+    assert(f);
+    assert(WriteCpuProfile(f));
+    rewind(f);
+    char line[1024];
+    bool found = false, found_fill = false, found_dropped = false;
+    while (fgets(line, sizeof line, f)) {
+      if (strcmp(line, "(program) cpu_profile_test:4;f cpu_profile_test:2 1\n") == 0) found = true;
+      if (strcmp(line, "(program) cpu_profile_test:7 10000\n") == 0) found_fill = true;
+      if (strncmp(line, "(dropped)", 9) == 0) found_dropped = true;
+    }
+    fclose(f);
+    assert(found && found_fill && !found_dropped);
+  }
 };
 
+int libtest::counted::moves = 0;
+
 void run_test() {
   libtest test;
 #define DO(name) test.name(#name)
   DO(version_test);
   DO(type_test);
   DO(jsobj_test);
+  DO(shape_test);
+  DO(atom_test);
+  DO(string_hash_test);
+  DO(rope_test);
+  DO(substring_test);
+  DO(one_byte_string_test);
+  DO(strops_test);
+  DO(map_test);
+  DO(hash_map_test);
+  DO(vector_test);
+  DO(guard_test);
+  DO(alloc_test);
 #undef DO
 
 #if 0
   nabla::handle v = true;
   any_ref& v2 = *reinterpret_cast<any_ref*>(&v);
-  bool b = v2.as<bool_data>()->data();
+  bool b = v2.as_bool();
   std::cerr << b << std::endl;
 #endif
 }
 
+// Tests that change process-wide state: they register a GC kind, force
+// collections, leave profiles behind or handle SIGPROF. They only run with
+// --self-test, not at every startup.
+void run_self_test() {
+  libtest test;
+#define DO(name) test.name(#name)
+  DO(layout_test);
+  DO(live_objects_test);
+  DO(snapshot_test);
+  DO(alloc_profile_test);
+  DO(cpu_profile_test);
+#undef DO
+}
+
 void dumpMap(any_map* m)
 {
 #if 0
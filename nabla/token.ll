@@ -127,7 +127,7 @@ false                   { return TFALSE; }
 
 [a-zA-Z$_][a-zA-Z0-9$_]* { yylval.strval = new std::string(yytext, yytext + strlen(yytext)); return TIDENTIFIER; }
 (0|[1-9][0-9]*)\.([0-9]*([eE][-+]?[0-9]+)?)? { yylval.nval = atof(yytext); return TNUMBER; }
-[1-9][0-9]*             { yylval.nval = atoi(yytext); return TNUMBER; }
+[1-9][0-9]*             { yylval.nval = atof(yytext); return TNUMBER; }
 0[xX][0-9a-zA-Z]+       { yylval.nval = strtol(yytext + 2, nullptr, 16); return TNUMBER; }
 0                       { yylval.nval = 0; return TNUMBER; }
 [\.+\-*/%=,;:\{\}\(\)\[\]<>!~&^|?:] { return yytext[0]; }
@@ -139,7 +139,7 @@ false                   { return TFALSE; }
 [a-zA-Z$_][a-zA-Z0-9$_]* { yylval.strval = new std::string(yytext, yytext + strlen(yytext)); BEGIN(INITIAL); return TIDENTIFIER; }
 [\.+\-*/%=,;:\{\}\(\)\[\]<>!~&^|?:] { BEGIN(INITIAL); return yytext[0]; }
 (0|[1-9][0-9]*)\.([0-9]*([eE][-+]?[0-9]+)?)? { yylval.nval = atof(yytext); BEGIN(INITIAL); return TNUMBER; }
-[1-9][0-9]*      { yylval.nval = atoi(yytext); BEGIN(INITIAL); return TNUMBER; }
+[1-9][0-9]*      { yylval.nval = atof(yytext); BEGIN(INITIAL); return TNUMBER; }
 0[xX][0-9a-zA-Z]+ { yylval.nval = strtol(yytext + 2, nullptr, 16); BEGIN(INITIAL); return TNUMBER; }
 0                { yylval.nval = 0; BEGIN(INITIAL); return TNUMBER; }
 }
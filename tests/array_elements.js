@@ -0,0 +1,51 @@
+var a = [];
+for (var i = 0; i < 100; i++) {
+    a[i] = i * i;
+}
+print(a.length, a[0], a[10], a[99], a[100]);
+print(a['10'], a[10.0], 10 in a, 100 in a, a.hasOwnProperty('99'));
+
+print('--- holes');
+var h = [1, 2, 3];
+h[6] = 7;
+print(h.length, h[4], h);
+delete h[1];
+print(h.length, h[1], 1 in h, Object.keys(h));
+h.length = 2;
+print(h.length, h[2], h);
+
+print('--- sparse');
+var s = [];
+s[0] = 'first';
+s[1000000] = 'far';
+print(s.length, s[0], s[1000000], s[500]);
+s[1] = 'second';
+print(Object.keys(s), s.length);
+s.length = 1;
+print(s.length, s[0], s[1], s[1000000]);
+
+print('--- prototype');
+Array.prototype[3] = 'inherited';
+var p = [0, 1];
+print(p[3], p.hasOwnProperty(3), p.length);
+delete Array.prototype[3];
+print(p[3]);
+
+print('--- enumeration');
+var e = [10, 20, 30];
+e.name = 'e';
+var names = [];
+for (var k in e) {
+    names.push(k);
+}
+print(names);
+var d = [1, 2, 3];
+Object.defineProperty(d, "1", { value: 9 });
+names = [];
+for (var k in d) {
+    names.push(k);
+}
+print(d[1], d.length, names);
+var sum = 0;
+e.forEach(function (x) { sum += x; });
+print(sum, e.pop(), e.length, e);
@@ -0,0 +1,13 @@
+var values = [undefined, null, true, false, 0, 1, "", "a"];
+var names = ["undefined", "null", "true", "false", "0", "1", "''", "'a'"];
+for (var i = 0; i < values.length; i++) {
+  var line = names[i] + ": " + typeof values[i];
+  line += " " + (values[i] ? "truthy" : "falsy");
+  for (var j = 0; j < values.length; j++) {
+    line += values[i] === values[j] ? " S" : " -";
+  }
+  print(line);
+}
+print(true === false, false === false, true !== false);
+var o = {};
+print(o.missing === undefined, o.missing == null, o.missing === null);
@@ -0,0 +1,64 @@
+function getX(o) {
+    return o.x;
+}
+
+function A() { this.x = 'A'; }
+function B() {}
+B.prototype.x = 'B';
+function C() {}
+C.prototype = new B();
+
+print('--- polymorphic');
+var objs = [new A(), new B(), new C(), { x: 'o' }, { y: 1, x: 'p' }, {}];
+var s = '';
+for (var i = 0; i < 3; i++) {
+    for (var j = 0; j < objs.length; j++) {
+        s += getX(objs[j]) + ',';
+    }
+}
+print(s);
+
+print('--- prototype changes');
+var b = new B();
+print(getX(b));
+B.prototype.x = 'B2';
+print(getX(b));
+b.x = 'own';
+print(getX(b));
+delete b.x;
+print(getX(b));
+delete B.prototype.x;
+print(getX(b));
+B.prototype.x = 'B3';
+print(getX(b), getX(new C()));
+
+print('--- accessors');
+var g = { get x() { return 'getter'; } };
+print(getX(g), getX(g));
+
+print('--- stores');
+function setX(o, v) {
+    o.x = v;
+}
+var p = { x: 1 };
+setX(p, 2);
+setX(p, 3);
+print(p.x);
+var f = { get x() { return 'fixed'; } };
+setX(f, 4);
+print(f.x);
+var a = [1, 2, 3];
+setX(a, 5);
+print(a.x, a.length);
+
+print('--- globals');
+var gv = 1;
+function readGlobal() {
+    return gv;
+}
+print(readGlobal());
+gv = 2;
+print(readGlobal());
+delete gv;
+gv = 3;
+print(readGlobal());
@@ -0,0 +1,65 @@
+function outer(a) {
+    var x = 10;
+    function inner(b) {
+	return a + x + b;
+    }
+    var g = function () {
+	x++;
+	return x;
+    };
+    return [inner(1), g(), g(), inner(2)];
+}
+print(outer(5));
+
+function args() {
+    return arguments.length + ":" + arguments[1];
+}
+print(args(1, 2, 3));
+
+function nested_args(a) {
+    var f = function () {
+	return arguments[0];
+    };
+    return f(a * 2);
+}
+print(nested_args(21));
+
+function with_local(o) {
+    var y = 1;
+    with (o) {
+	y = y + z;
+    }
+    return y;
+}
+print(with_local({z: 5}));
+print(with_local({y: 100, z: 5}));
+
+var gv = 3;
+function global_var() {
+    gv = gv + 1;
+    return typeof gv + "," + typeof nonexistent;
+}
+print(global_var(), gv);
+
+function param_var(q) {
+    var q;
+    return q;
+}
+print(param_var(4));
+
+function delete_var() {
+    var y = 1;
+    return delete y;
+}
+print(delete_var());
+
+function deep() {
+    var a = 1;
+    return function () {
+	var b = 2;
+	return function () {
+	    return a + b;
+	};
+    };
+}
+print(deep()()());
@@ -17,3 +17,10 @@ print(re.multiline);
 var res = re.exec("    func(xyz)   ");
 print(res.length + ":" + res[0] + ":" + res[1]);
 try { /a/.exec.apply({}); } catch (e) { print('OK'); }
+
+var wide = String.fromCharCode(256);
+res = /(b+)(x)?(c)/.exec("aabbbc" + wide + "bc");
+print(res.length + ":" + res[0] + ":" + res[1] + ":" + res[2] + ":" + res[3]);
+res = new RegExp(wide + "(b)").exec("abc" + wide + "bc");
+print(res.index + ":" + res[1]);
+print("xxabc".search("abc") + " " + ("x" + wide + "abc").search("abc") + " " + "xyz".search("abc"));
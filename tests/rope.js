@@ -0,0 +1,28 @@
+var s = "";
+for (var i = 0; i < 3000; i++) {
+  s += "x" + i + ";";
+}
+print(s.length);
+print(s.substring(0, 20));
+print(s.indexOf("2999;"));
+
+var r = "";
+for (var i = 0; i < 3000; i++) {
+  r = i % 10 + r;
+}
+print(r.length, r.substring(0, 12), r.charAt(2999));
+
+var a = "abcdefghij" + "klmnopqrst";
+var b = "abcdefghijklm" + "nopqrst";
+print(a == b, a === b, a.length);
+
+var o = {};
+o["generated_" + "key_" + "name_" + "one"] = 1;
+print(o.generated_key_name_one);
+
+var nested = "";
+for (var i = 0; i < 50; i++) {
+  nested = "[" + nested + "]" + "(" + i + ")";
+}
+print(nested.length, nested.substring(0, 16));
+print(/\(49\)$/.test(nested));
@@ -1,14 +1,19 @@
 #!/bin/sh
 
-for jsfile in *.js ; do
-    echo "Testing $jsfile..."
-    tmpfile=`mktemp`
-    rspfile=${jsfile%.js}.rsp
-    ../nabla/nabla $jsfile | sed -e 's/\r$//' > $tmpfile
-    cmp $rspfile $tmpfile
-    res=$?
-    rm $tmpfile
-    test $res -eq 0 || exit $res
+../nabla/nabla --self-test || exit $?
+
+# Every script is run by both evaluators.
+for flags in "" "--ast" ; do
+    for jsfile in *.js ; do
+        echo "Testing $jsfile $flags..."
+        tmpfile=`mktemp`
+        rspfile=${jsfile%.js}.rsp
+        ../nabla/nabla $flags $jsfile | sed -e 's/\r$//' > $tmpfile
+        cmp $rspfile $tmpfile
+        res=$?
+        rm $tmpfile
+        test $res -eq 0 || exit $res
+    done
 done
 
 exit 0
@@ -0,0 +1,40 @@
+function Point(x, y) {
+    this.x = x;
+    this.y = y;
+}
+
+var p = new Point(1, 2);
+var q = new Point(3, 4);
+q.z = 5;
+print(p.x + p.y, q.x + q.y + q.z);
+print(Object.keys(p), Object.keys(q));
+
+print('--- delete');
+delete q.x;
+print(Object.keys(q), q.x, q.y, q.z);
+q.x = 6;
+print(Object.keys(q), q.x);
+print(p.hasOwnProperty('x'), q.hasOwnProperty('x'), 'z' in p);
+
+print('--- many properties');
+var o = {};
+for (var i = 0; i < 100; i++) {
+    o['p' + i] = i;
+}
+var sum = 0;
+for (var k in o) {
+    sum += o[k];
+}
+print(sum, o.p0, o.p50, o.p99);
+for (var i = 0; i < 100; i += 2) {
+    delete o['p' + i];
+}
+print(Object.keys(o).length, o.p0, o.p1, o.p98, o.p99);
+o.p0 = 'a';
+var keys = Object.keys(o);
+print(keys[0], keys[keys.length - 1], o.p0);
+
+print('--- accessors');
+var a = { get v() { return this.w * 2; }, set v(x) { this.w = x; } };
+a.v = 21;
+print(a.v, Object.keys(a));
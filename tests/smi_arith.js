@@ -0,0 +1,27 @@
+// int32 results stay exact; anything outside int32 or -0 becomes a double.
+var max = 2147483647;
+var min = -2147483648;
+print(max + 1 === 2147483648, min - 1 === -2147483649);
+print(max * 2 === 4294967294, min * -1 === 2147483648);
+var i = max;
+i++;
+print(i === 2147483648);
+var j = min;
+j--;
+print(j === -2147483649);
+print(7 / 2, 8 / 2, -8 / 2, 1 / 0, -1 / 0);
+print(1 / (0 * -1), 1 / (-3 % 3), 1 / (0 / -5));
+print(7 % 3, -7 % 3, 7 % -3, min % -1 === 0);
+print((1 << 31) / ~0 === 2147483648, (1 << 31) / 1, 1 / ((1 << 31) % ~0));
+var z = 0;
+print(5 % z, z / z);
+print(5.5 % 2, -5.5 % 2);
+print(1 << 31, 1 << 32, -1 >> 1, -1 >>> 0 === 4294967295, -1 >>> 28);
+print(4294967296 | 0, 4294967297 | 0, 2147483648 | 0, 3.7 | 0, -3.7 | 0);
+print(0x7fffffff & -1, 6 ^ 3, 5 | 2);
+print(1 < 2, 2 <= 2, 3 > 4, 4 >= 5, 3 == 3, 3 != 3, 3 === 3, 3 !== 4);
+var s = 0;
+for (var k = 0; k < 100000; k++) {
+  s = s + k;
+}
+print(s === 4999950000);
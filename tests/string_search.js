@@ -0,0 +1,24 @@
+var line = "2014-05-01 12:00:03 INFO  [worker-3] request id=4711 path=/api/items status=200 time=12ms";
+print(line.indexOf("status="), line.indexOf("INFO"), line.indexOf("ERROR"));
+print(line.indexOf("i"), line.indexOf("i", 40), line.lastIndexOf("i"), line.lastIndexOf("i", 40));
+print(line.indexOf(""), line.indexOf("", 1000), line.lastIndexOf(""));
+print(line.indexOf("2014", -5), line.lastIndexOf("2014", -5), line.lastIndexOf("ms", NaN));
+print(line.substring(line.indexOf("path=") + 5, line.indexOf(" status")));
+print("abc".indexOf("abcd"), "aaa".lastIndexOf("aa"), "undefined".indexOf());
+
+var long = "";
+for (var i = 0; i < 200; i++) long += "abcdefghij";
+long += "needle";
+print(long.indexOf("needle"), long.lastIndexOf("abc"), long.indexOf("jab", 1995));
+var lambda = String.fromCharCode(955);
+print((long + lambda).indexOf("needle" + lambda), (long + lambda).indexOf(lambda));
+print(long.indexOf("ne" + lambda), (lambda + long).lastIndexOf("needle"));
+var e = String.fromCharCode(0x145);
+print("ERROR".indexOf(e), "ERROR".lastIndexOf(e + "R"), (lambda + "ERROR").indexOf("RO"));
+
+print(line.toUpperCase());
+print("MiXeD [Case] @ `x` {Z}".toLowerCase(), "MiXeD [Case] @ `x` {Z}".toUpperCase());
+var s = long.toUpperCase();
+print(s.length, s.substring(0, 12), s.toLowerCase() === long);
+var wide = (lambda + "Hello World, Hello World").toUpperCase();
+print(wide.substring(1), wide.charCodeAt(0));
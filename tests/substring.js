@@ -0,0 +1,26 @@
+var base = "The quick brown fox jumps over the lazy dog, again and again.";
+print(base.substring(4, 19));
+print(base.substring(4, 19).substring(6, 15));
+print(base.substring(10).substring(0, 30));
+print(base.substr(4, 5));
+print(base.substring(4, 19) === "quick brown fox");
+
+var o = {};
+o[base.substring(4, 19)] = 1;
+print(o["quick brown fox"]);
+
+var abc = "abc";
+print(abc[0], abc[1] === "b", abc.charAt(2), abc[3]);
+print(String.fromCharCode(65), String.fromCharCode(97) === "a");
+
+var csv = "";
+for (var i = 0; i < 500; i++) {
+  csv += (i ? "," : "") + "col" + i;
+}
+var cols = csv.split(",");
+print(cols.length, cols[0], cols[499]);
+var count = 0;
+for (var i = 0; i < csv.length; i++) {
+  if (csv[i] === ",") count++;
+}
+print(count);
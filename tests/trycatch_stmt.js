@@ -37,3 +37,54 @@ try {
 } finally {
     print("c");
 }
+
+print("---");
+
+function catchClosures() {
+    var fs = [];
+    for (var i = 0; i < 2; i++) {
+        try {
+            throw i;
+        } catch (x) {
+            fs.push(function() { return x + i; });
+        }
+    }
+    return fs[0]() + " " + fs[1]();
+}
+print(catchClosures());
+
+var gs = [];
+for (var j = 0; j < 2; j++) {
+    try {
+        throw j;
+    } catch (y) {
+        gs.push(function() { return y; });
+    }
+}
+print(gs[0]() + " " + gs[1]());
+print(typeof y);
+
+function catchBreak() {
+    var e = "outer";
+    for (;;) {
+        try {
+            throw "inner";
+        } catch (e) {
+            break;
+        }
+    }
+    return e;
+}
+print(catchBreak());
+
+// var in a catch block declares a variable of the function, and its
+// initializer reaches it there.
+function catchVar() {
+    try {
+        throw 5;
+    } catch (e) {
+        var r = e;
+    }
+    return r;
+}
+print(catchVar());
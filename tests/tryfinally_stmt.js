@@ -0,0 +1,101 @@
+function test1() {
+    print("---");
+    try {
+	print("1");
+    } finally {
+	print("2");
+    }
+    print("3");
+}
+
+function test2() {
+    print("---");
+    for (var i = 0; i < 3; i++) {
+	try {
+	    if (i == 1) continue;
+	    if (i == 2) break;
+	    print("1");
+	} finally {
+	    print("2");
+	}
+    }
+    print("3");
+}
+
+function test3() {
+    print("---");
+    try {
+	return "1";
+    } finally {
+	print("2");
+    }
+}
+
+function test4() {
+    print("---");
+    try {
+	try {
+	    throw "1";
+	} finally {
+	    print("2");
+	}
+    } catch (e) {
+	print(e);
+    }
+}
+
+function test5() {
+    print("---");
+    foo:
+    for (var k in { a: 1, b: 2 }) {
+	try {
+	    try {
+		print(k);
+		break foo;
+	    } finally {
+		print("1");
+	    }
+	} finally {
+	    print("2");
+	}
+    }
+    print("3");
+}
+
+function test6() {
+    print("---");
+    var o = { x: 1 };
+    try {
+	with (o) {
+	    try {
+		throw x;
+	    } finally {
+		x = 2;
+	    }
+	}
+    } catch (e) {
+	print(e);
+    }
+    print(o.x);
+}
+
+function test7() {
+    print("---");
+    try {
+	throw "1";
+    } finally {
+	return "2";
+    }
+}
+
+try {
+    test1();
+    test2();
+    print(test3());
+    test4();
+    test5();
+    test6();
+    print(test7());
+} catch (e) {
+    print('NG: ' + e);
+}
@@ -0,0 +1,150 @@
+# Nabla JS - A small EMCAScript interpreter with straight-forward implementation.
+# Copyright (C) 2014 Katsuya Iida. All rights reserved.
+
+# Reports what keeps memory alive in a heap snapshot written by
+# nabla --heap-snapshot=FILE. An object dominates another when every path
+# from the root to the other goes through it, and its retained size is the
+# size of all the objects it dominates: what would be freed if it were
+# collected.
+#
+# usage: heapsnapshot.py [-n COUNT] FILE
+
+from __future__ import print_function
+
+import getopt
+import json
+import sys
+
+class Node:
+    def __init__(self, kind, size, name):
+        self.kind = kind
+        self.size = size
+        self.name = name
+        self.edges = []
+        self.retained = size
+
+def read_snapshot(filename):
+    nodes = {}
+    with open(filename, 'r') as f:
+        header = f.readline().split()
+        if header != ['nabla-heap-snapshot', '1']:
+            raise ValueError('%s: not a heap snapshot' % filename)
+        node = None
+        for line in f:
+            if line.startswith('e '):
+                to, label = line[2:].split(' ', 1)
+                node.edges.append((int(to), json.loads(label)))
+            elif line.startswith('n '):
+                id, kind, size, name = line[2:].split(' ', 3)
+                node = Node(kind, int(size), json.loads(name))
+                nodes[int(id)] = node
+    return nodes
+
+def postorder(nodes, root):
+    # The first edge found to each node is the one shown in its path.
+    order = []
+    parent = {root: None}
+    stack = [(root, 0)]
+    while stack:
+        id, i = stack.pop()
+        edges = nodes[id].edges
+        while i < len(edges) and edges[i][0] in parent:
+            i += 1
+        if i == len(edges):
+            order.append(id)
+            continue
+        to = edges[i][0]
+        parent[to] = (id, edges[i][1])
+        stack.append((id, i + 1))
+        stack.append((to, 0))
+    return order, parent
+
+def dominators(nodes, root, order):
+    # Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+    index = dict((id, i) for i, id in enumerate(order))
+    preds = dict((id, []) for id in order)
+    for id in order:
+        for to, label in nodes[id].edges:
+            preds[to].append(id)
+    idom = {root: root}
+    changed = True
+    while changed:
+        changed = False
+        for id in reversed(order):
+            if id == root:
+                continue
+            new = None
+            for p in preds[id]:
+                if p not in idom:
+                    continue
+                if new is None:
+                    new = p
+                    continue
+                a, b = p, new
+                while a != b:
+                    while index[a] < index[b]:
+                        a = idom[a]
+                    while index[b] < index[a]:
+                        b = idom[b]
+                new = a
+            if idom.get(id) != new:
+                idom[id] = new
+                changed = True
+    return idom
+
+def path(parent, id):
+    labels = []
+    while parent[id]:
+        id, label = parent[id]
+        labels.append(label)
+    return ' > '.join(reversed(labels))
+
+def describe(nodes, id):
+    node = nodes[id]
+    if node.name:
+        return '%s %s' % (node.kind, json.dumps(node.name))
+    return '%s @%d' % (node.kind, id)
+
+def main():
+    count = 20
+    opts, args = getopt.getopt(sys.argv[1:], 'n:')
+    for opt, value in opts:
+        if opt == '-n':
+            count = int(value)
+    if len(args) != 1:
+        print('usage: heapsnapshot.py [-n COUNT] FILE', file=sys.stderr)
+        return 1
+
+    nodes = read_snapshot(args[0])
+    order, parent = postorder(nodes, 0)
+    idom = dominators(nodes, 0, order)
+    # Postorder visits the objects a node dominates before the node.
+    for id in order:
+        if id != 0:
+            nodes[idom[id]].retained += nodes[id].retained
+
+    kinds = {}
+    for id in order:
+        node = nodes[id]
+        n, size = kinds.get(node.kind, (0, 0))
+        kinds[node.kind] = (n + 1, size + node.size)
+    print('%d objects, %d bytes' % (len(order) - 1, nodes[0].retained))
+    print()
+    print('%-24s %10s %12s' % ('kind', 'count', 'bytes'))
+    for kind, (n, size) in sorted(kinds.items(), key=lambda k: -k[1][1]):
+        if kind != 'Root':
+            print('%-24s %10d %12d' % (kind, n, size))
+
+    print()
+    print('Biggest retainers:')
+    top = sorted((id for id in order if id != 0), key=lambda id: -nodes[id].retained)
+    for id in top[:count]:
+        node = nodes[id]
+        print('%12d %s (self %d)' % (node.retained, describe(nodes, id), node.size))
+        print('%12s via %s' % ('', path(parent, id)))
+        if idom[id] != 0:
+            print('%12s dominated by %s' % ('', describe(nodes, idom[id])))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())